@@ -0,0 +1,30 @@
+import pytest
+
+from uxibxx import UxibxxIoBoard
+from uxibxx._bench import ScriptedPort
+
+
+class RecordingScriptedPort(ScriptedPort):
+    """
+    :class:`ScriptedPort` that also keeps every line written to it.
+    """
+    def __init__(self, tags: bool = True):
+        super().__init__(tags)
+        self.written = []
+
+    def write(self, data: bytes) -> int:
+        self.written.append(data)
+        return super().write(data)
+
+
+@pytest.fixture(params=[True, False], ids=["tags", "no-tags"])
+def port(request):
+    return RecordingScriptedPort(tags=request.param)
+
+
+@pytest.fixture
+def board(port):
+    board = UxibxxIoBoard(port, use_vendor_interface=False)
+    port.written.clear()
+    yield board
+    board.close()
@@ -0,0 +1,34 @@
+"""
+Per-call CPU cost of the driver, as a pytest-benchmark suite. Skipped unless
+pytest-benchmark is installed; ``pytest --benchmark-autosave`` and
+``pytest --benchmark-compare`` keep a baseline across driver changes.
+"""
+import pytest
+
+pytest.importorskip("pytest_benchmark")
+
+from uxibxx import UxibxxIoBoard  # noqa: E402
+from uxibxx._bench import ScriptedPort, benchmarks, measure_board  # noqa
+
+
+_NAMES = [name for name, _ in benchmarks(
+    UxibxxIoBoard(ScriptedPort(), use_vendor_interface=False), ScriptedPort())]
+
+
+@pytest.mark.parametrize("name", _NAMES)
+def test_call_overhead(benchmark, board, port, name):
+    call = dict(benchmarks(board, port))[name]
+    benchmark(call)
+
+
+def test_measure_board(board):
+    results = measure_board(board, round_trips=50, idle_s=0.)
+    latencies = [results[f"round trip {q} us"]
+                 for q in ("p50", "p90", "p99", "max")]
+    assert 0 < latencies[0] <= latencies[1] <= latencies[2] <= latencies[3]
+    assert results["timer wakeups/s"] == 6.
+    assert results["timer busy %"] == pytest.approx(0.0024)
+    assert results["awake %"] == pytest.approx(5.)
+    assert results["loop wakeups/s"] == pytest.approx(1006.)
+    assert results["max pass us"] == 180
+    assert results["max observed latency us"] == 180
@@ -0,0 +1,48 @@
+import os
+import sys
+import threading
+
+import pytest
+
+from uxibxx import RemoteIoBoard, UxibxxIoBoard
+
+pytestmark = pytest.mark.skipif(
+    sys.platform == "win32", reason="the daemon needs Unix domain sockets")
+
+
+@pytest.fixture
+def remote(tmp_path, port):
+    from uxibxx import _daemon
+    board = UxibxxIoBoard(port, use_vendor_interface=False)
+    worker = _daemon.BoardWorker(board, poll_interval_s=0.01)
+    socket_path = os.path.join(str(tmp_path), "uxibxx.sock")
+    server = _daemon._Server(socket_path, {board.board_id: worker})
+    worker.start()
+    thread = threading.Thread(target=server.serve_forever, daemon=True)
+    thread.start()
+    client = RemoteIoBoard(socket_path=socket_path)
+    yield client
+    client.close()
+    server.shutdown()
+    server.server_close()
+    worker.stop()
+    worker.join()
+
+
+def test_forwarded_calls(remote, port):
+    assert remote.board_id == "BENCH"
+    remote.set_output(3, True)
+    assert port.outputs[3] == 1
+    assert remote.get_outputs([3, 4]) == {3: True, 4: False}
+    with pytest.raises(RemoteIoBoard.InvalidTerminalNo):
+        remote.set_output(99, True)
+
+
+def test_counters_and_metrics(remote):
+    assert remote.edges_lost == 0
+    assert remote.reconnects == 0
+    assert remote.metrics is None
+
+
+def test_timeout_outlasts_reconnect():
+    assert RemoteIoBoard.TIMEOUT_S > UxibxxIoBoard.RECONNECT_TIMEOUT_S
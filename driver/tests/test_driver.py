@@ -0,0 +1,74 @@
+import pytest
+
+from uxibxx import UxibxxIoBoard
+from uxibxx._bench import INPUT_TERMINALS, N_TERMINALS
+
+
+def _untagged(port):
+    return [
+        line.split(b" ", 1)[-1] if line.startswith(b"#") else line
+        for line in port.written
+        ]
+
+
+def test_capabilities_indexed_at_connect(board):
+    assert board.terminal_nos == list(range(1, N_TERMINALS + 1))
+    assert board.output_nos == list(range(1, N_TERMINALS + 1))
+    assert board.input_nos == list(INPUT_TERMINALS)
+    board.output_nos.append(99)
+    # ^ Callers get a copy, not the index itself
+    assert 99 not in board.output_nos
+
+
+def test_set_output_sends_precomputed_command(board, port):
+    board.set_output(3, True)
+    board.set_output(3, 0)
+    written = b"".join(port.written)
+    assert written.count(b"OUT:3=1\r") == 1
+    assert written.count(b"OUT:3=0\r") == 1
+    assert port.outputs[3] == 0
+
+
+def test_get_input(board, port):
+    assert board.get_input(13) is True
+    assert board.get_input(14) is False
+    assert b"INP:13?\r" in b"".join(port.written)
+
+
+def test_get_and_set_outputs(board, port):
+    board.set_outputs({1: True, 2: False, 5: 1})
+    assert board.get_outputs([1, 2, 5]) == {1: True, 2: False, 5: True}
+
+
+@pytest.mark.parametrize("n", [0, N_TERMINALS + 1, -1])
+def test_invalid_terminal(board, port, n):
+    with pytest.raises(UxibxxIoBoard.InvalidTerminalNo):
+        board.set_output(n, True)
+    with pytest.raises(UxibxxIoBoard.InvalidTerminalNo):
+        board.get_input(n)
+    assert port.written == []
+
+
+def test_input_only_checks(board, port):
+    with pytest.raises(UxibxxIoBoard.Unsupported):
+        board.get_input(1)
+    assert port.written == []
+
+
+def test_run_commands_returns_errors_in_place(board):
+    assert board.run_commands(["OUT:1=1", "XYZ:1", "OUT:1?"]) == [
+        "OK", "ERROR:CMD", "OUT:1=1"]
+
+
+@pytest.mark.parametrize("line", ["OUT:1=é", "OUT:" + "1," * 40 + "=1"])
+def test_run_commands_rejects_bad_lines(board, port, line):
+    with pytest.raises(ValueError):
+        board.run_commands([line])
+    assert port.written == []
+
+
+@pytest.mark.parametrize("trigger", ["low", "high"])
+def test_pulse_rule_needs_edge_trigger(board, port, trigger):
+    with pytest.raises(ValueError):
+        board.define_rule(1, 13, trigger, "pulse", [1], pulse_ms=100)
+    assert port.written == []
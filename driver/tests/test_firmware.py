@@ -0,0 +1,35 @@
+"""
+Runs the firmware's host-built unit tests (``make test`` in ``firmware/``),
+one pytest test per test program. Skipped when the firmware sources aren't
+alongside the driver or there is no host C compiler.
+"""
+import pathlib
+import shutil
+import subprocess
+
+import pytest
+
+
+FIRMWARE_DIR = pathlib.Path(__file__).resolve().parents[2] / "firmware"
+TEST_NAMES = sorted(
+    path.stem for path in (FIRMWARE_DIR / "tests").glob("test_*.c"))
+
+pytestmark = pytest.mark.skipif(
+    not TEST_NAMES or shutil.which("make") is None
+    or shutil.which("cc") is None,
+    reason="needs the firmware tree, make and a host C compiler")
+
+
+@pytest.mark.parametrize("name", TEST_NAMES)
+def test_firmware_host(name):
+    target = f"_test/{name}"
+    build = subprocess.run(
+        ["make", "-s", "-C", str(FIRMWARE_DIR), target],
+        stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+        universal_newlines=True)
+    assert build.returncode == 0, build.stdout
+    run = subprocess.run(
+        [str(FIRMWARE_DIR / target)],
+        stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+        universal_newlines=True)
+    assert run.returncode == 0, run.stdout
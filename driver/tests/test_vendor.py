@@ -0,0 +1,156 @@
+"""
+Tests of the vendor interface report codec in ``uxibxx._vendor``. The byte
+strings are the same ones firmware/tests/test_vendorrpt.c checks the
+firmware's encoder against, and the round trip tests run requests through
+the firmware's own decoder and reply encoder (src/vendorrpt.c, built as a
+shared library for a board with 16-bit and one with 32-bit terminal masks)
+where a host C compiler is available.
+"""
+import ctypes
+import pathlib
+import shutil
+import subprocess
+import sys
+from typing import NamedTuple
+
+import pytest
+
+from uxibxx._vendor import (
+    REPORT_LEN, WIDE_REPORT_LEN, Event, Reply, VendorOp, VendorStatus,
+    decode_report, encode_request)
+
+
+FIRMWARE_DIR = pathlib.Path(__file__).resolve().parents[2] / "firmware"
+
+REQUEST_BYTES = bytes([0x02, 0x07, 0x34, 0x12, 0xCD, 0xAB, 0x00, 0x00])
+REPLY_BYTES = bytes([0x82, 0x07, 0x02, 0x00, 0xFF, 0x0F, 0x00, 0x30])
+EVENT_BYTES = bytes([0xC0, 0x01, 0x10, 0x27, 0x00, 0x30, 0x00, 0x10])
+
+# The same reports from a board with 32-bit terminal masks
+WIDE_REQUEST_BYTES = bytes([
+    0x02, 0x07, 0x34, 0x12, 0xAB, 0x89, 0xCD, 0xAB, 0x02, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00])
+WIDE_REPLY_BYTES = bytes([
+    0x82, 0x07, 0x02, 0x00, 0xFF, 0x0F, 0xFF, 0x00, 0x00, 0x30, 0xFE, 0x00,
+    0x00, 0x00, 0x00, 0x00])
+WIDE_EVENT_BYTES = bytes([
+    0xC0, 0x01, 0x10, 0x27, 0x00, 0x30, 0xFE, 0x00, 0x00, 0x10, 0x80, 0x00,
+    0x00, 0x00, 0x00, 0x00])
+
+
+def test_encode_request():
+    assert encode_request(
+        VendorOp.WRITE_OUTPUTS, 7, 0x1234, 0xABCD) == REQUEST_BYTES
+    assert len(encode_request(VendorOp.READ, 1)) == REPORT_LEN
+    assert encode_request(VendorOp.READ, 0x107)[1] == 0x07
+    # ^ Tags wrap at 8 bits
+
+
+def test_encode_wide_request():
+    assert encode_request(
+        VendorOp.WRITE_OUTPUTS, 7, 0x89AB1234, 0x0102ABCD,
+        WIDE_REPORT_LEN) == WIDE_REQUEST_BYTES
+
+
+def test_decode_reply():
+    assert decode_report(REPLY_BYTES) == Reply(
+        VendorOp.WRITE_OUTPUTS, 7, VendorStatus.BAD_VAL, 0x0FFF, 0x3000)
+    assert decode_report(WIDE_REPLY_BYTES) == Reply(
+        VendorOp.WRITE_OUTPUTS, 7, VendorStatus.BAD_VAL, 0x00FF0FFF,
+        0x00FE3000)
+
+
+def test_decode_event():
+    assert decode_report(EVENT_BYTES) == Event(0x01, 10000, 0x3000, 0x1000)
+    assert decode_report(WIDE_EVENT_BYTES) == Event(
+        0x01, 10000, 0x00FE3000, 0x00801000)
+
+
+@pytest.mark.parametrize("data", [
+    REQUEST_BYTES, REPLY_BYTES[:-1], REPLY_BYTES + b"\0", b"",
+    WIDE_REQUEST_BYTES, WIDE_REPLY_BYTES[:-1]])
+def test_decode_rejects_other_data(data):
+    assert decode_report(data) is None
+
+
+def _request_struct(mask_type):
+    class Request(ctypes.Structure):
+        _fields_ = [
+            ("op", ctypes.c_uint8),
+            ("tag", ctypes.c_uint8),
+            ("arg0", mask_type),
+            ("arg1", mask_type),
+            ]
+    return Request
+
+
+class _Firmware(NamedTuple):
+    lib: ctypes.CDLL
+    report_len: int
+    mask_type: type
+    request_struct: type
+
+
+@pytest.fixture(scope="module", params=[
+    ("boards/uxib-dn12.json", REPORT_LEN, ctypes.c_uint16),
+    ("tests/boards/wide24.json", WIDE_REPORT_LEN, ctypes.c_uint32),
+    ], ids=["narrow", "wide"])
+def vendorrpt(request, tmp_path_factory):
+    # src/vendorrpt.c gets its mask width from the generated board.h
+    if shutil.which("cc") is None:
+        pytest.skip("needs a host C compiler")
+    board_file, report_len, mask_type = request.param
+    out_dir = tmp_path_factory.mktemp("vendorrpt")
+    subprocess.run(
+        [sys.executable, str(FIRMWARE_DIR / "tools/gen_board.py"),
+         "-o", str(out_dir), str(FIRMWARE_DIR / board_file)],
+        check=True)
+    lib_path = out_dir / "libvendorrpt.so"
+    subprocess.run(
+        ["cc", "-shared", "-fPIC", "-std=gnu99",
+         f"-I{FIRMWARE_DIR / 'src'}", f"-I{out_dir}",
+         "-o", str(lib_path), str(FIRMWARE_DIR / "src/vendorrpt.c")],
+        check=True)
+    return _Firmware(
+        ctypes.CDLL(str(lib_path)), report_len, mask_type,
+        _request_struct(mask_type))
+
+
+def _firmware_reply(fw: _Firmware, request: bytes, status: int, outputs: int,
+                    inputs: int) -> bytes:
+    # What vendorctl.c does with a request: decode it, then echo its op and
+    # tag in the reply
+    req = fw.request_struct()
+    reply = ctypes.create_string_buffer(fw.report_len)
+    fw.lib.vendorrpt__decodeRequest(ctypes.byref(req), request)
+    fw.lib.vendorrpt__encodeReply(
+        reply, ctypes.byref(req), ctypes.c_uint8(status),
+        fw.mask_type(outputs), fw.mask_type(inputs))
+    return reply.raw
+
+
+@pytest.mark.parametrize("op", list(VendorOp))
+@pytest.mark.parametrize("tag", [0, 1, 0x7F, 0xFF])
+def test_round_trip_through_firmware(vendorrpt, op, tag):
+    args = [(0, 0), (0x1234, 0xABCD), (0xFFFF, 0x8001)]
+    if vendorrpt.report_len == WIDE_REPORT_LEN:
+        args += [(0x89AB1234, 0x00FFFFFF), (0xFFFFFFFF, 0x80000001)]
+    for arg0, arg1 in args:
+        request = encode_request(op, tag, arg0, arg1, vendorrpt.report_len)
+        req = vendorrpt.request_struct()
+        vendorrpt.lib.vendorrpt__decodeRequest(ctypes.byref(req), request)
+        assert (req.op, req.tag, req.arg0, req.arg1) == (op, tag, arg0, arg1)
+        reply = _firmware_reply(
+            vendorrpt, request, VendorStatus.OK, arg0, arg1)
+        assert decode_report(reply) == Reply(
+            op, tag, VendorStatus.OK, arg0, arg1)
+
+
+def test_firmware_event_decodes(vendorrpt):
+    report = ctypes.create_string_buffer(vendorrpt.report_len)
+    vendorrpt.lib.vendorrpt__encodeEvent(
+        report, ctypes.c_uint8(1), ctypes.c_uint16(10000),
+        vendorrpt.mask_type(0x3000), vendorrpt.mask_type(0x1000))
+    if vendorrpt.report_len == REPORT_LEN:
+        assert report.raw == EVENT_BYTES
+    assert decode_report(report.raw) == Event(1, 10000, 0x3000, 0x1000)
@@ -1,4 +1,6 @@
 from ._driver import UxibxxIoBoard
+from ._client import RemoteIoBoard
+from ._metrics import DriverMetrics
 
 
-__all__ = ["UxibxxIoBoard"]
+__all__ = ["UxibxxIoBoard", "RemoteIoBoard", "DriverMetrics"]
@@ -0,0 +1,302 @@
+"""
+Micro-benchmarks for the host-side cost of :class:`UxibxxIoBoard` calls.
+
+The board is opened on :class:`ScriptedPort`, an in-memory stand-in for the
+serial port that answers every command instantly, so the figures are the
+driver's own CPU time per call (plus the small, fixed cost of the stand-in,
+reported as ``port only``). Save a run with ``--save`` and check later driver
+changes against it with ``--compare``.
+
+With ``--port`` or ``--board-id`` a real board is measured instead (see
+:func:`measure_board`), which is how firmware changes are compared: save a
+run on the old firmware, flash the new one and compare.
+"""
+import argparse
+import json
+import re
+import sys
+import time
+import timeit
+from typing import Callable, Dict, List, Sequence, Tuple
+
+from . import _metrics
+from ._driver import UxibxxIoBoard
+
+
+N_TERMINALS = 14
+INPUT_TERMINALS = (13, 14)
+# ^ Same layout as UXIB-DN12
+
+
+class ScriptedPort:
+    """
+    Stand-in serial port emulating a UXIB-DN12's command set closely enough
+    for the benchmarked calls. Replies are queued on ``write()`` and handed
+    back by ``readline()`` without any delay.
+    """
+    _tag_re = re.compile(rb"#(\d+)(.*)")
+
+    def __init__(self, tags: bool = True):
+        self.port = "bench"
+        self.timeout = None
+        self.tags = tags
+        self.outputs = [0] * (N_TERMINALS + 1)
+        self._rx = b""
+        self._replies: List[bytes] = []
+
+    def write(self, data: bytes) -> int:
+        self._rx += data
+        while b"\r" in self._rx:
+            line, self._rx = self._rx.split(b"\r", 1)
+            match = self._tag_re.match(line)
+            if match and not self.tags:
+                self._replies.append(b"ERROR:CMD\r\n")
+                continue
+            reply = self._handle(
+                (match.group(2) if match else line).decode('ascii'))
+            if match:
+                reply = f"#{match.group(1).decode('ascii')} {reply}"
+            self._replies.append(reply.encode('ascii') + b"\r\n")
+        return len(data)
+
+    def readline(self) -> bytes:
+        return self._replies.pop(0) if self._replies else b""
+
+    def close(self):
+        pass
+
+    def _handle(self, line: str) -> str:
+        mnem, query = line[:3], line.endswith("?")
+        if mnem == "IDN":
+            return "IDN=UXIB-DN12,BENCH"
+        if mnem == "TLS":
+            return "TLS=" + ",".join(
+                str(n) for n in range(1, N_TERMINALS + 1))
+        if mnem == "TML":
+            return "TML=12,48,2000000"
+            # ^ What an idle board reports over 2 s
+        if mnem == "IDL":
+            return "IDL=2012,1900000,2000000,180,180"
+        args = line[4:-1] if query else line[4:]
+        if query:
+            terminals = [int(n) for n in args.split(",")]
+            if mnem == "TCP":
+                values = [
+                    "IO" if n in INPUT_TERMINALS else "O" for n in terminals]
+            elif mnem == "OUT":
+                values = [str(self.outputs[n]) for n in terminals]
+            elif mnem in ("INP", "DIR"):
+                values = [str(n % 2) for n in terminals]
+            else:
+                return "ERROR:CMD"
+            return f"{line[:-1]}=" + ",".join(values)
+        if mnem in ("OUT", "DIR"):
+            left, right = args.split("=")
+            terminals = [int(n) for n in left.split(",")]
+            values = [int(v) for v in right.split(",")]
+            if len(values) == 1:
+                values *= len(terminals)
+            if mnem == "OUT":
+                for n, v in zip(terminals, values):
+                    self.outputs[n] = v
+            return "OK"
+        return "ERROR:CMD"
+
+
+def _port_only(port: ScriptedPort) -> Callable[[], None]:
+    def call():
+        port.write(b"OUT:3=1\r")
+        port.readline()
+    return call
+
+
+def benchmarks(board: UxibxxIoBoard,
+               port: ScriptedPort) -> List[Tuple[str, Callable[[], None]]]:
+    all_outputs = {n: True for n in board.output_nos}
+    return [
+        ("port only", _port_only(port)),
+        ("set_output", lambda: board.set_output(3, True)),
+        ("get_output", lambda: board.get_output(3)),
+        ("get_input", lambda: board.get_input(13)),
+        ("set_outputs (all)", lambda: board.set_outputs(all_outputs)),
+        ("get_inputs (all)", lambda: board.get_inputs()),
+        ("get_outputs (all)", lambda: board.get_outputs()),
+        ("set_direction", lambda: board.set_direction(
+            14, board.IoDirection.INPUT)),
+        ("output_nos", lambda: board.output_nos),
+        ]
+
+
+def _quantile(sorted_values: Sequence[float], q: float) -> float:
+    return sorted_values[min(len(sorted_values) - 1,
+                             int(q * len(sorted_values)))]
+
+
+def measure_board(board: UxibxxIoBoard, round_trips: int = 1000,
+                  idle_s: float = 2.) -> Dict[str, float]:
+    """
+    Measures a real board. Every figure is one where lower is better, so
+    ``--compare`` treats them all alike.
+
+    - ``round trip``: quantiles of the time from writing a one-terminal
+      ``OUT?`` query to reading its reply. The query needs next to no work
+      on the board, so this is USB and command handling latency.
+    - ``timer``: how often the timer interrupt ran and the share of time it
+      took while the board sat idle for ``idle_s`` seconds (see
+      :meth:`UxibxxIoBoard.get_timer_load`).
+    - ``awake``, ``loop``, ``max pass`` and ``max observed latency``: over
+      the same idle period, the share of time the CPU was out of sleep and
+      how often it woke, then the longest main loop pass since reset and the
+      longest command latency that follows from it (see
+      :meth:`UxibxxIoBoard.get_idle_stats`). Time awake is what idle
+      current follows, short of measuring it.
+
+    The idle figures are left out if the firmware doesn't report them.
+    """
+    terminal = board.output_nos[0]
+    latencies = []
+    for _ in range(round_trips):
+        start = time.perf_counter()
+        board.get_output(terminal)
+        latencies.append((time.perf_counter() - start) * 1e6)
+    latencies.sort()
+    results = {
+        f"round trip {name} us": _quantile(latencies, q)
+        for name, q in (("p50", .5), ("p90", .9), ("p99", .99), ("max", 1.))
+        }
+    readers = []
+    for reader in (board.get_timer_load, board.get_idle_stats):
+        try:
+            reader()
+            # ^ Starts a new measurement period
+        except board.RemoteError:
+            continue
+        readers.append(reader)
+    if not readers:
+        return results
+    time.sleep(idle_s)
+    for reader in readers:
+        stats = reader()
+        if not stats.elapsed_us:
+            continue
+        if isinstance(stats, board.TimerLoad):
+            results["timer wakeups/s"] = (
+                stats.wakeups * 1e6 / stats.elapsed_us)
+            results["timer busy %"] = stats.busy_us * 100. / stats.elapsed_us
+        else:
+            results["awake %"] = (
+                (stats.elapsed_us - stats.asleep_us) * 100.
+                / stats.elapsed_us)
+            results["loop wakeups/s"] = stats.wakeups * 1e6 / stats.elapsed_us
+            results["max pass us"] = stats.max_pass_us
+            results["max observed latency us"] = stats.max_observed_latency_us
+    return results
+
+
+def _open_board(args) -> UxibxxIoBoard:
+    kwargs = dict(use_vendor_interface=False)
+    # ^ Latency over the serial port, which is what the driver mostly uses
+    if args.port:
+        return UxibxxIoBoard.from_serial_portname(args.port, **kwargs)
+    return UxibxxIoBoard.from_board_id(args.board_id, **kwargs)
+
+
+def run(tags: bool = True, metrics: bool = False,
+        repeat: int = 5) -> Dict[str, float]:
+    """
+    Runs every benchmark and returns the best per-call time of each, in
+    microseconds.
+    """
+    port = ScriptedPort(tags)
+    board = UxibxxIoBoard(
+        port, use_vendor_interface=False,
+        metrics=_metrics.DriverMetrics() if metrics else None)
+    results = {}
+    for name, call in benchmarks(board, port):
+        timer = timeit.Timer(call)
+        number, _ = timer.autorange()
+        best = min(timer.repeat(repeat, number))
+        results[name] = best / number * 1e6
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Measure the host CPU cost of UXIBxx driver calls, or "
+                    "the latency of a real board")
+    target = parser.add_mutually_exclusive_group()
+    target.add_argument(
+        "-p", "--port", help="Measure the board on this serial port")
+    target.add_argument(
+        "-b", "--board-id", help="Measure the board with this ID")
+    parser.add_argument(
+        "--round-trips", type=int, default=1000,
+        help="With a board, number of queries timed (default 1000)")
+    parser.add_argument(
+        "--idle", type=float, default=2., metavar="SECONDS",
+        help="With a board, how long to leave it idle while measuring its "
+             "background load (default 2)")
+    parser.add_argument(
+        "--no-tags", action="store_true",
+        help="Emulate firmware without request tags")
+    parser.add_argument(
+        "--metrics", action="store_true",
+        help="Open the board with metrics collection enabled")
+    parser.add_argument(
+        "--repeat", type=int, default=5,
+        help="Timing runs per benchmark; the best one is reported")
+    parser.add_argument(
+        "--save", metavar="FILE", help="Write the results to a JSON file")
+    parser.add_argument(
+        "--compare", metavar="FILE",
+        help="Compare against results saved earlier with --save")
+    parser.add_argument(
+        "--max-regression", type=float, default=0.2, metavar="FRACTION",
+        help="With --compare, exit with status 1 if any call got slower "
+             "by more than this fraction (default 0.2)")
+    args = parser.parse_args()
+
+    if args.port or args.board_id:
+        try:
+            board = _open_board(args)
+        except (UxibxxIoBoard.UxibxxIoBoardError, OSError) as exc:
+            print(f"Can't open board: {exc}", file=sys.stderr)
+            sys.exit(2)
+        try:
+            results = measure_board(board, args.round_trips, args.idle)
+        finally:
+            board.close()
+        label, unit = "figure", "value"
+    else:
+        results = run(not args.no_tags, args.metrics, args.repeat)
+        label, unit = "call", "us/call"
+    baseline = {}
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+    regressed = []
+    print(f"{label:<20}{unit:>10}" + (
+        f"{'baseline':>10}{'change':>9}" if baseline else ""))
+    for name, us in results.items():
+        row = f"{name:<20}{us:>10.2f}"
+        if name in baseline:
+            if baseline[name]:
+                change = us / baseline[name] - 1.
+            else:
+                change = float("inf") if us else 0.
+                # ^ Board figures such as busy time can be zero
+            row += f"{baseline[name]:>10.2f}{change:>+9.0%}"
+            if change > args.max_regression and name != "port only":
+                regressed.append(name)
+        print(row)
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump(results, f, indent=2)
+    if regressed:
+        print("Slower than baseline: " + ", ".join(regressed),
+              file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
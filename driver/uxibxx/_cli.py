@@ -0,0 +1,312 @@
+"""
+Runs a script of board commands over a single connection.
+
+A script has one statement per line::
+
+    # Comment
+    OUT:1,2,3=1     Lines starting with an upper-case letter are board
+    INP:13,14?      commands, sent as they are
+    wait 0.25       Pause for 0.25 s (or e.g. "wait 250ms")
+    repeat 10       Run the lines up to the matching "end" 10 times
+    OUT:3=1
+    wait 50ms
+    OUT:3=0
+    end
+
+Runs of consecutive commands, including across loop iterations, go to the
+board in pipelined batches (see :meth:`UxibxxIoBoard.run_commands`). A wait
+ends the batch before it, so everything sent so far has been answered when
+the wait starts. Every command and wait is printed with the time since the
+script started and its own duration: for a command, the time from sending its
+batch to receiving its reply.
+
+By default the script stops after the batch in which a command gets an error
+reply; the rest of that batch has already been sent by then.
+"""
+import argparse
+import re
+import sys
+import time
+from typing import Iterable, List, NamedTuple, Optional, TextIO, Tuple, Union
+
+from . import _metrics
+from ._driver import UxibxxIoBoard
+
+
+class Command(NamedTuple):
+    line_no: int
+    text: str
+
+
+class Wait(NamedTuple):
+    line_no: int
+    seconds: float
+
+
+class Repeat(NamedTuple):
+    line_no: int
+    count: int
+    body: List['Statement']
+
+
+Statement = Union[Command, Wait, Repeat]
+
+
+class ScriptError(ValueError):
+    def __init__(self, line_no: int, message: str):
+        super().__init__(f"line {line_no}: {message}")
+        self.line_no = line_no
+
+
+class CommandFailed(Exception):
+    pass
+
+
+_WAIT_RE = re.compile(r"(\d+(?:\.\d*)?|\.\d+)\s*(ms|s)?")
+_COUNT_RE = re.compile(r"[0-9]+")
+MAX_COMMAND_LEN = UxibxxIoBoard.MAX_LINE_LEN - UxibxxIoBoard.TAG_LEN
+# ^ What run_commands() accepts, so bad lines fail before anything is sent
+
+
+class ScriptParser:
+    """
+    Turns script lines into statements. Lines are fed one at a time and a
+    statement comes back once it is complete (a loop when its ``end`` is
+    read), so statements typed at a terminal can run straight away. A line
+    that raises :exc:`ScriptError` leaves the parser as it was.
+    """
+    def __init__(self):
+        self._open_loops: List[Repeat] = []
+
+    def feed(self, line_no: int, line: str) -> Optional[Statement]:
+        line = line.strip()
+        if not line or line.startswith("#"):
+            return None
+        if line[0].isupper():
+            if not all(" " <= ch <= "~" for ch in line):
+                raise ScriptError(line_no, "Command is not printable ASCII")
+            if len(line) > MAX_COMMAND_LEN:
+                raise ScriptError(
+                    line_no,
+                    f"Command is longer than {MAX_COMMAND_LEN} characters")
+            statement = Command(line_no, line)
+        else:
+            word, _, arg = line.partition(" ")
+            arg = arg.strip()
+            if word == "wait":
+                match = _WAIT_RE.fullmatch(arg)
+                if match is None:
+                    raise ScriptError(line_no, f"Bad wait time {arg!r}")
+                seconds = float(match.group(1))
+                if match.group(2) == "ms":
+                    seconds /= 1000.
+                statement = Wait(line_no, seconds)
+            elif word == "repeat":
+                if _COUNT_RE.fullmatch(arg) is None:
+                    raise ScriptError(line_no, f"Bad repeat count {arg!r}")
+                self._open_loops.append(Repeat(line_no, int(arg), []))
+                return None
+            elif word == "end":
+                if arg or not self._open_loops:
+                    raise ScriptError(line_no, "'end' without 'repeat'")
+                statement = self._open_loops.pop()
+            else:
+                raise ScriptError(line_no, f"Unknown statement {word!r}")
+        if self._open_loops:
+            self._open_loops[-1].body.append(statement)
+            return None
+        return statement
+
+    def finish(self):
+        if self._open_loops:
+            raise ScriptError(
+                self._open_loops[-1].line_no, "'repeat' without 'end'")
+
+
+def parse(lines: Iterable[str]) -> List[Statement]:
+    parser = ScriptParser()
+    statements = []
+    for line_no, line in enumerate(lines, 1):
+        statement = parser.feed(line_no, line)
+        if statement is not None:
+            statements.append(statement)
+    parser.finish()
+    return statements
+
+
+class ScriptRunner:
+    """
+    Runs statements on a board, batching consecutive commands, and prints a
+    line with timings for each step. The board must have been opened with
+    ``metrics`` set to ``metrics``, which supplies the reply timings.
+    """
+    def __init__(self, board: UxibxxIoBoard,
+                 metrics: _metrics.DriverMetrics, out: TextIO,
+                 keep_going: bool = False, quiet: bool = False):
+        self._board = board
+        self._out = out
+        self._keep_going = keep_going
+        self._quiet = quiet
+        self._pending: List[Command] = []
+        self._replies: List[Tuple[float, float]] = []
+        # ^ Arrival time and latency of each reply in the current batch
+        metrics.on_sample = self._on_sample
+        self.start = time.perf_counter()
+        self.commands = 0
+        self.batches = 0
+        self.errors = 0
+
+    def _on_sample(self, sample: _metrics.CommandSample):
+        self._replies.append((time.perf_counter(), sample.latency_s))
+
+    def _print(self, t: float, duration_s: float, text: str):
+        t_ms = (t - self.start) * 1e3
+        self._out.write(f"{t_ms:10.3f} {duration_s * 1e3:9.3f}  {text}\n")
+
+    def print_header(self):
+        if not self._quiet:
+            self._out.write(f"{'t/ms':>10} {'step/ms':>9}  step\n")
+
+    def flush(self):
+        if not self._pending:
+            return
+        batch, self._pending = self._pending, []
+        self._replies.clear()
+        responses = self._board.run_commands(
+            command.text for command in batch)
+        self.batches += 1
+        failed = None
+        for command, response, (t, latency_s) in zip(
+                batch, responses, self._replies):
+            self.commands += 1
+            error = response.startswith("ERROR")
+            if error:
+                self.errors += 1
+                failed = failed or command
+            if error or not self._quiet:
+                self._print(t, latency_s, f"{command.text}  {response}")
+        self._out.flush()
+        if failed is not None and not self._keep_going:
+            raise CommandFailed(
+                f"line {failed.line_no}: {failed.text} failed")
+
+    def run(self, statement: Statement):
+        if isinstance(statement, Command):
+            self._pending.append(statement)
+            if len(self._pending) >= self._board.MAX_PIPELINED:
+                self.flush()
+        elif isinstance(statement, Wait):
+            self.flush()
+            start = time.perf_counter()
+            time.sleep(statement.seconds)
+            end = time.perf_counter()
+            if not self._quiet:
+                self._print(end, end - start, f"wait {statement.seconds:g} s")
+        else:
+            for _ in range(statement.count):
+                for inner in statement.body:
+                    self.run(inner)
+
+
+def _open_board(args, metrics: _metrics.DriverMetrics) -> UxibxxIoBoard:
+    kwargs = dict(use_vendor_interface=False, metrics=metrics)
+    # ^ Everything goes over the serial port, so skip the USB scan
+    if args.port:
+        return UxibxxIoBoard.from_serial_portname(args.port, **kwargs)
+    if args.board_id:
+        return UxibxxIoBoard.from_board_id(args.board_id, **kwargs)
+    return UxibxxIoBoard.open_first_device(**kwargs)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Run a script of commands on a UXIBxx board over one "
+                    "connection")
+    parser.add_argument(
+        "script", nargs="?", default="-",
+        help="Script file; '-' (the default) reads standard input")
+    parser.add_argument(
+        "-e", "--execute", action="append", metavar="LINE",
+        help="Script line to run instead of a file (repeatable)")
+    target = parser.add_mutually_exclusive_group()
+    target.add_argument(
+        "-b", "--board-id",
+        help="ID of the board to use; default is the first one found")
+    target.add_argument("-p", "--port", help="Serial port of the board")
+    parser.add_argument(
+        "-k", "--keep-going", action="store_true",
+        help="Carry on after a command gets an error reply")
+    parser.add_argument(
+        "-q", "--quiet", action="store_true",
+        help="Only print failed commands and the summary")
+    args = parser.parse_args()
+
+    interactive = (
+        args.execute is None and args.script == "-" and sys.stdin.isatty())
+    statements: List[Statement] = []
+    if not interactive:
+        # Whole scripts are checked before anything is sent
+        try:
+            if args.execute is not None:
+                statements = parse(args.execute)
+            elif args.script == "-":
+                statements = parse(sys.stdin)
+            else:
+                with open(args.script) as f:
+                    statements = parse(f)
+        except (ScriptError, OSError) as exc:
+            print(exc, file=sys.stderr)
+            sys.exit(2)
+
+    metrics = _metrics.DriverMetrics()
+    connect_start = time.perf_counter()
+    try:
+        board = _open_board(args, metrics)
+    except (UxibxxIoBoard.UxibxxIoBoardError, OSError) as exc:
+        print(f"Can't open board: {exc}", file=sys.stderr)
+        sys.exit(2)
+    runner = ScriptRunner(
+        board, metrics, sys.stdout, args.keep_going, args.quiet)
+    connect_s = runner.start - connect_start
+    status = 0
+    try:
+        runner.print_header()
+        if interactive:
+            script_parser = ScriptParser()
+            for line_no, line in enumerate(sys.stdin, 1):
+                try:
+                    statement = script_parser.feed(line_no, line)
+                except ScriptError as exc:
+                    print(exc, file=sys.stderr)
+                    continue
+                if statement is not None:
+                    runner.run(statement)
+                    runner.flush()
+                    # ^ Typed lines run as soon as they are complete
+        else:
+            for statement in statements:
+                runner.run(statement)
+            runner.flush()
+    except CommandFailed as exc:
+        print(exc, file=sys.stderr)
+        status = 1
+    except (UxibxxIoBoard.UxibxxIoBoardError, OSError) as exc:
+        print(f"{type(exc).__name__}: {exc}", file=sys.stderr)
+        status = 1
+    except KeyboardInterrupt:
+        status = 1
+    finally:
+        board.close()
+    if runner.errors:
+        status = 1
+    run_s = time.perf_counter() - runner.start
+    print(
+        f"{board.board_id}: {runner.commands} commands in {runner.batches} "
+        f"batches, {runner.errors} errors; connect {connect_s * 1e3:.1f} ms, "
+        f"run {run_s * 1e3:.1f} ms",
+        file=sys.stderr)
+    sys.exit(status)
+
+
+if __name__ == "__main__":
+    main()
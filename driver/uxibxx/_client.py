@@ -0,0 +1,220 @@
+import collections
+import functools
+import itertools
+import select
+import socket
+import threading
+import time
+from typing import Deque, Dict, Optional
+
+from . import _ipc
+from . import types
+from ._driver import UxibxxIoBoard
+
+
+class RemoteIoBoard:
+    """
+    Client for a board served by the ``uxibxx-daemon`` process, which lets
+    several processes share one board. It has the same methods and properties
+    as :class:`UxibxxIoBoard` (except for the input event methods; see
+    :meth:`subscribe_inputs`) and raises the same exceptions.
+
+    Requests from all clients are coalesced by the daemon, so concurrent
+    output writes and reads cost fewer round trips to the hardware than the
+    same calls made one after another.
+    """
+    TIMEOUT_S = UxibxxIoBoard.RECONNECT_TIMEOUT_S + 5.
+    # ^ A daemon started with --auto-reconnect holds calls for up to
+    # RECONNECT_TIMEOUT_S while the board comes back, then restores its
+    # state and retries, all before replying
+
+    UxibxxIoBoardError = types.UxibxxIoBoardError
+    DeviceNotFound = types.DeviceNotFound
+    IdMismatch = types.IdMismatch
+    InvalidTerminalNo = types.InvalidTerminalNo
+    ResponseTimeout = types.ResponseTimeout
+    Unsupported = types.Unsupported
+    RemoteError = types.RemoteError
+    BadResponse = types.BadResponse
+    DeviceDisconnected = types.DeviceDisconnected
+
+    IoDirection = types.IoDirection
+    ReconnectPolicy = types.ReconnectPolicy
+    PowerOnState = types.PowerOnState
+    RuleTrigger = types.RuleTrigger
+    RuleAction = types.RuleAction
+    Rule = types.Rule
+    StartupTiming = types.StartupTiming
+    TimerLoad = types.TimerLoad
+    MemoryUsage = types.MemoryUsage
+    IdleStats = types.IdleStats
+    SetSampleResult = types.SetSampleResult
+    AnalogReading = types.AnalogReading
+    AnalogConfig = types.AnalogConfig
+    AnalogBlock = types.AnalogBlock
+    DeviceRecord = types.DeviceRecord
+    InrushStatus = types.InrushStatus
+    InputEvent = types.InputEvent
+    ArmState = types.ArmState
+    ArmStatus = types.ArmStatus
+    EdgeRecord = types.EdgeRecord
+
+    def __init__(self, board_id: Optional[str] = None,
+                 socket_path: Optional[str] = None):
+        """
+        :param board_id: ID of the board to use. May be omitted if the daemon
+            serves only one board.
+        :param socket_path: Path of the daemon's socket, if it isn't running
+            at the default location
+        :raises DeviceNotFound: if the daemon isn't serving the requested
+            board
+        :raises OSError: if the daemon can't be reached
+        """
+        self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._sock.connect(socket_path or _ipc.default_socket_path())
+        self._rx_buf = b""
+        self._lock = threading.Lock()
+        self._msg_ids = itertools.count(1)
+        self._input_updates: Deque[Dict[int, bool]] = \
+            collections.deque(maxlen=256)
+        self._requested_board_id = board_id
+        info = self._call("_open")
+        self._board_model = info["board_model"]
+        self._board_id = info["board_id"]
+        self._requested_board_id = self._board_id
+        self._terminal_capabilities = info["terminal_capabilities"]
+        self._index_capabilities()
+        self._uses_vendor_interface = info["uses_vendor_interface"]
+
+    def _handle_message(self, message: dict):
+        if message.get("event") == "inputs":
+            self._input_updates.append(_ipc.decode(message["inputs"]))
+
+    def _read_message(self, timeout_s: float) -> Optional[dict]:
+        deadline = time.monotonic() + timeout_s
+        while b"\n" not in self._rx_buf:
+            remaining = max(0., deadline - time.monotonic())
+            if not select.select([self._sock], [], [], remaining)[0]:
+                return None
+            data = self._sock.recv(4096)
+            if not data:
+                raise ConnectionError("Daemon closed the connection")
+            self._rx_buf += data
+        line, self._rx_buf = self._rx_buf.split(b"\n", 1)
+        return _ipc.unpack(line)
+
+    def _call(self, method: str, *args, **kwargs):
+        with self._lock:
+            msg_id = next(self._msg_ids)
+            self._sock.sendall(_ipc.pack({
+                "id": msg_id,
+                "board": self._requested_board_id,
+                "method": method,
+                "args": _ipc.encode(list(args)),
+                "kwargs": {k: _ipc.encode(v) for k, v in kwargs.items()},
+                }))
+            deadline = time.monotonic() + self.TIMEOUT_S
+            while True:
+                message = self._read_message(
+                    max(0., deadline - time.monotonic()))
+                if message is None:
+                    raise self.ResponseTimeout(
+                        f"No reply from daemon to {method}")
+                if message.get("id") != msg_id:
+                    self._handle_message(message)
+                    continue
+                if "error" in message:
+                    raise _ipc.decode_error(message["error"])
+                return _ipc.decode(message.get("result"))
+
+    def subscribe_inputs(self):
+        """
+        Asks the daemon to send this client a snapshot of every input each
+        time any of them changes, starting with the current state. Retrieve
+        snapshots with :meth:`read_input_update`. The daemon polls the inputs
+        once for all of its subscribers.
+        """
+        self._call("_subscribe_inputs")
+
+    def read_input_update(
+            self, timeout_s: float = 0.
+            ) -> Optional[Dict[int, bool]]:
+        """
+        Returns the next input snapshot sent by the daemon, waiting up to
+        ``timeout_s`` seconds for one to arrive. Requires a previous call to
+        :meth:`subscribe_inputs`.
+
+        :returns: Mapping of terminal number to input state, or ``None`` on
+            timeout
+        """
+        deadline = time.monotonic() + timeout_s
+        with self._lock:
+            while not self._input_updates:
+                message = self._read_message(
+                    max(0., deadline - time.monotonic()))
+                if message is None:
+                    return None
+                self._handle_message(message)
+            return self._input_updates.popleft()
+
+    def close(self):
+        """
+        Disconnects from the daemon; the board itself stays open for other
+        clients. Calling multiple times is harmless.
+        """
+        if self._sock is not None:
+            self._sock.close()
+            self._sock = None
+
+    _index_capabilities = UxibxxIoBoard._index_capabilities
+    board_model = UxibxxIoBoard.board_model
+    board_id = UxibxxIoBoard.board_id
+    terminal_nos = UxibxxIoBoard.terminal_nos
+    input_nos = UxibxxIoBoard.input_nos
+    output_nos = UxibxxIoBoard.output_nos
+    analog_nos = UxibxxIoBoard.analog_nos
+
+    @property
+    def uses_vendor_interface(self) -> bool:
+        """
+        ``True`` if the daemon talks to the board over its vendor-specific USB
+        interface
+        """
+        return self._uses_vendor_interface
+
+    @property
+    def edges_lost(self) -> int:
+        """
+        Total number of captured edges the board has dropped because its
+        buffer was full, across all of the daemon's clients (see
+        :meth:`UxibxxIoBoard.read_edges`)
+        """
+        return self._call("_counters")["edges_lost"]
+
+    @property
+    def reconnects(self) -> int:
+        """
+        Number of times the daemon has reconnected to the board after it
+        dropped off the bus (see ``uxibxx-daemon --auto-reconnect``)
+        """
+        return self._call("_counters")["reconnects"]
+
+    @property
+    def metrics(self) -> None:
+        """
+        Always ``None``: the daemon's board connection isn't instrumented, and
+        its timings would include other clients' calls anyway. Time calls on
+        the client side instead.
+        """
+        return None
+
+
+def _make_forwarder(name: str):
+    @functools.wraps(getattr(UxibxxIoBoard, name))
+    def forwarder(self, *args, **kwargs):
+        return self._call(name, *args, **kwargs)
+    return forwarder
+
+
+for _name in _ipc.forwarded_methods():
+    setattr(RemoteIoBoard, _name, _make_forwarder(_name))
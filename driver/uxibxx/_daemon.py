@@ -0,0 +1,397 @@
+"""
+Daemon that owns the serial connections to one or more UXIBxx boards and
+serves any number of client processes over a Unix domain socket. See
+:class:`uxibxx.RemoteIoBoard` for the client side and :mod:`uxibxx._ipc`
+for the wire format.
+
+Each board gets one worker thread, which is the only thing that talks to the
+hardware. Requests from all clients go into the worker's queue; whatever has
+piled up while the previous batch was being handled is taken as the next
+batch, and within it consecutive output writes are merged into a single
+``set_outputs`` and consecutive reads are answered from a single snapshot.
+Input snapshots for subscribed clients are taken the same way, so any number
+of subscribers costs one device read per poll interval.
+"""
+import argparse
+import inspect
+import logging
+import os
+import queue
+import socket
+import socketserver
+import threading
+import time
+from typing import Callable, Dict, List, Optional
+
+from . import _ipc
+from . import types
+from ._driver import UxibxxIoBoard
+
+
+logger = logging.getLogger(__name__)
+
+WRITE_METHODS = {"set_output", "set_outputs"}
+READ_METHODS = {"get_input", "get_inputs", "get_output", "get_outputs"}
+
+
+class _Call:
+    __slots__ = ("method", "args", "kwargs", "reply")
+
+    def __init__(self, method: str, args: list, kwargs: dict,
+                 reply: Callable[[Optional[Exception], object], None]):
+        self.method = method
+        self.args = args
+        self.kwargs = kwargs
+        self.reply = reply
+
+    def bind(self):
+        return inspect.signature(
+            getattr(UxibxxIoBoard, self.method)
+            ).bind(None, *self.args, **self.kwargs).arguments
+
+
+class BoardWorker(threading.Thread):
+    def __init__(self, board: UxibxxIoBoard, poll_interval_s: float):
+        super().__init__(name=f"uxibxx-{board.board_id}", daemon=True)
+        self.board = board
+        self.poll_interval_s = poll_interval_s
+        self._calls = queue.Queue()
+        self._subscribers: Dict[object, Callable[[dict], None]] = {}
+        self._last_sent: Dict[object, Dict[int, bool]] = {}
+        self._subscribers_lock = threading.Lock()
+        self._next_poll = 0.
+        self._stopping = False
+        self._methods = set(_ipc.forwarded_methods())
+
+    def info(self) -> dict:
+        return {
+            "board_model": self.board.board_model,
+            "board_id": self.board.board_id,
+            "terminal_capabilities": self.board._terminal_capabilities,
+            "uses_vendor_interface": self.board.uses_vendor_interface,
+            }
+
+    def counters(self) -> dict:
+        return {
+            "edges_lost": self.board.edges_lost,
+            "reconnects": self.board.reconnects,
+            }
+
+    def submit(self, call: _Call):
+        self._calls.put(call)
+
+    def subscribe(self, key, push: Callable[[dict], None]):
+        with self._subscribers_lock:
+            self._subscribers[key] = push
+            self._last_sent.pop(key, None)
+        self._calls.put(None)
+        # ^ Wake the worker so the new subscriber gets a snapshot right away
+
+    def unsubscribe(self, key):
+        with self._subscribers_lock:
+            self._subscribers.pop(key, None)
+            self._last_sent.pop(key, None)
+
+    def stop(self):
+        self._stopping = True
+        self._calls.put(None)
+
+    def run(self):
+        while not self._stopping:
+            timeout = None
+            if self._subscribers:
+                timeout = max(0., self._next_poll - time.monotonic())
+            batch = []
+            try:
+                batch.append(self._calls.get(timeout=timeout))
+                while True:
+                    batch.append(self._calls.get_nowait())
+            except queue.Empty:
+                pass
+            batch = [call for call in batch if call is not None]
+            poll = bool(self._subscribers) \
+                and time.monotonic() >= self._next_poll
+            if poll:
+                self._next_poll = time.monotonic() + self.poll_interval_s
+                batch.append(_Call(
+                    "get_inputs", [], {}, self._fan_out_inputs))
+            self._handle_batch(batch)
+        self.board.close()
+
+    def _fan_out_inputs(self, exc: Optional[Exception], inputs):
+        if exc is not None:
+            logger.warning(
+                "Input poll failed on board %s: %s", self.board.board_id, exc)
+            return
+        message = {
+            "event": "inputs",
+            "board": self.board.board_id,
+            "inputs": _ipc.encode(inputs),
+            }
+        with self._subscribers_lock:
+            pushes = [
+                push for key, push in self._subscribers.items()
+                if self._last_sent.get(key) != inputs
+                ]
+            for key in self._subscribers:
+                self._last_sent[key] = inputs
+        for push in pushes:
+            push(message)
+
+    def _handle_batch(self, batch: List[_Call]):
+        i = 0
+        while i < len(batch):
+            group = [batch[i]]
+            kind = self._coalesce_kind(batch[i].method)
+            i += 1
+            while (kind is not None and i < len(batch)
+                    and self._coalesce_kind(batch[i].method) == kind):
+                group.append(batch[i])
+                i += 1
+            if len(group) > 1 and kind == "write":
+                self._handle_writes(group)
+            elif len(group) > 1 and kind == "read":
+                self._handle_reads(group)
+            else:
+                self._handle_one(group[0])
+
+    @staticmethod
+    def _coalesce_kind(method: str) -> Optional[str]:
+        if method in WRITE_METHODS:
+            return "write"
+        if method in READ_METHODS:
+            return "read"
+        return None
+
+    def _handle_one(self, call: _Call):
+        try:
+            if call.method not in self._methods:
+                raise types.Unsupported(
+                    f"{call.method!r} is not available through the daemon")
+            result = getattr(self.board, call.method)(
+                *call.args, **call.kwargs)
+        except Exception as exc:
+            call.reply(exc, None)
+        else:
+            call.reply(None, result)
+
+    def _handle_each(self, group: List[_Call]):
+        # Used when a merged operation fails, so each caller gets the error
+        # (or result) its own request would have produced
+        for call in group:
+            self._handle_one(call)
+
+    def _handle_writes(self, group: List[_Call]):
+        merged = {}
+        try:
+            for call in group:
+                args = call.bind()
+                if call.method == "set_output":
+                    merged[args["n"]] = args["on"]
+                else:
+                    merged.update(args["outputs"])
+            self.board.set_outputs(merged)
+        except Exception:
+            self._handle_each(group)
+            return
+        for call in group:
+            call.reply(None, None)
+
+    def _handle_reads(self, group: List[_Call]):
+        bound = []
+        want = {"input": set(), "output": set()}
+        try:
+            for call in group:
+                args = call.bind()
+                kind = "input" if "input" in call.method else "output"
+                if call.method.endswith("s"):
+                    terminals = args.get("terminals")
+                    if terminals is None:
+                        terminals = (
+                            self.board.input_nos if kind == "input"
+                            else self.board.output_nos
+                            )
+                    terminals = list(terminals)
+                else:
+                    terminals = [args["n"]]
+                want[kind].update(terminals)
+                bound.append((call, kind, terminals))
+            snapshots = {
+                "input": (self.board.get_inputs(sorted(want["input"]))
+                          if want["input"] else {}),
+                "output": (self.board.get_outputs(sorted(want["output"]))
+                           if want["output"] else {}),
+                }
+        except Exception:
+            self._handle_each(group)
+            return
+        for call, kind, terminals in bound:
+            snapshot = snapshots[kind]
+            if call.method.endswith("s"):
+                call.reply(None, {n: snapshot[n] for n in terminals})
+            else:
+                call.reply(None, snapshot[terminals[0]])
+
+
+class _ClientHandler(socketserver.StreamRequestHandler):
+    server: '_Server'
+
+    def setup(self):
+        super().setup()
+        self._send_lock = threading.Lock()
+        self._subscribed_to = []
+
+    def _send(self, message: dict):
+        try:
+            with self._send_lock:
+                self.wfile.write(_ipc.pack(message))
+                self.wfile.flush()
+        except (OSError, ValueError):
+            pass
+            # Client went away; its handler thread will notice and clean up
+
+    def _reply(self, msg_id):
+        def reply(exc: Optional[Exception], result):
+            if exc is not None:
+                self._send({"id": msg_id, "error": _ipc.encode_error(exc)})
+            else:
+                self._send({"id": msg_id, "result": _ipc.encode(result)})
+        return reply
+
+    def handle(self):
+        for line in self.rfile:
+            try:
+                message = _ipc.unpack(line)
+                msg_id = message["id"]
+            except (ValueError, KeyError, TypeError):
+                logger.warning("Dropping malformed request %r", line)
+                continue
+            reply = self._reply(msg_id)
+            try:
+                worker = self.server.find_worker(message.get("board"))
+                method = message.get("method")
+                if method == "_open":
+                    reply(None, worker.info())
+                elif method == "_counters":
+                    reply(None, worker.counters())
+                elif method == "_subscribe_inputs":
+                    worker.subscribe(self, self._send)
+                    self._subscribed_to.append(worker)
+                    reply(None, None)
+                else:
+                    worker.submit(_Call(
+                        method,
+                        _ipc.decode(message.get("args", [])),
+                        _ipc.decode(message.get("kwargs", {})),
+                        reply
+                        ))
+            except Exception as exc:
+                reply(exc, None)
+
+    def finish(self):
+        for worker in self._subscribed_to:
+            worker.unsubscribe(self)
+        super().finish()
+
+
+class _Server(socketserver.ThreadingMixIn, socketserver.UnixStreamServer):
+    daemon_threads = True
+
+    def __init__(self, socket_path: str, workers: Dict[str, BoardWorker]):
+        self.workers = workers
+        super().__init__(socket_path, _ClientHandler)
+
+    def find_worker(self, board_id: Optional[str]) -> BoardWorker:
+        if board_id is None:
+            if len(self.workers) != 1:
+                raise types.DeviceNotFound(
+                    "Daemon serves several boards; specify a board ID")
+            return next(iter(self.workers.values()))
+        if board_id not in self.workers:
+            raise types.DeviceNotFound(
+                f"Daemon has no board with ID {board_id!r}")
+        return self.workers[board_id]
+
+
+def serve(board_ids: Optional[List[str]] = None,
+          socket_path: Optional[str] = None,
+          poll_interval_s: float = 0.01,
+          auto_reconnect: bool = False):
+    """
+    Opens the given boards (or every connected board if ``board_ids`` is
+    empty) and serves them until interrupted. With ``auto_reconnect``, a
+    board that drops off the bus is reopened and its state restored while
+    clients' calls wait (see :class:`UxibxxIoBoard`).
+    """
+    socket_path = socket_path or _ipc.default_socket_path()
+    if not board_ids:
+        board_ids = [
+            board_id for _, board_id in UxibxxIoBoard.list_connected_devices()
+            if board_id
+            ]
+    if not board_ids:
+        raise types.DeviceNotFound("No device(s) found")
+    workers = {}
+    for board_id in board_ids:
+        board = UxibxxIoBoard.from_board_id(
+            board_id, auto_reconnect=auto_reconnect)
+        workers[board.board_id] = BoardWorker(board, poll_interval_s)
+        logger.info("Opened board %s (%s)", board.board_id, board.board_model)
+    if os.path.exists(socket_path):
+        probe = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            probe.connect(socket_path)
+        except OSError:
+            os.unlink(socket_path)
+            # Stale socket from a daemon that didn't shut down cleanly
+        else:
+            raise OSError(f"Another daemon is serving {socket_path}")
+        finally:
+            probe.close()
+    old_umask = os.umask(0o077)
+    try:
+        server = _Server(socket_path, workers)
+    finally:
+        os.umask(old_umask)
+    for worker in workers.values():
+        worker.start()
+    logger.info("Listening on %s", socket_path)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.server_close()
+        os.unlink(socket_path)
+        for worker in workers.values():
+            worker.stop()
+            worker.join()
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Share UXIBxx boards between processes")
+    parser.add_argument(
+        "-b", "--board-id", action="append", dest="board_ids",
+        help="Board to serve (repeatable); default is every connected board")
+    parser.add_argument(
+        "-s", "--socket", dest="socket_path",
+        help=f"Socket path (default {_ipc.default_socket_path()})")
+    parser.add_argument(
+        "--poll-interval", type=float, default=0.01, metavar="SECONDS",
+        help="Input polling interval while clients are subscribed")
+    parser.add_argument(
+        "--auto-reconnect", action="store_true",
+        help="Reopen boards that drop off the bus and restore their state")
+    parser.add_argument("-v", "--verbose", action="store_true")
+    args = parser.parse_args()
+    logging.basicConfig(
+        level=logging.INFO if args.verbose else logging.WARNING,
+        format="%(asctime)s %(levelname)s %(message)s"
+        )
+    serve(args.board_ids, args.socket_path, args.poll_interval,
+          args.auto_reconnect)
+
+
+if __name__ == "__main__":
+    main()
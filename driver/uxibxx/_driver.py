@@ -1,9 +1,19 @@
+import array
+import concurrent.futures
+import glob
+import os
+import sys
+import time
 from enum import Enum
-from typing import List, Optional, Tuple, Union
+from typing import Callable, Dict, Iterable, List, Optional, Tuple, Union
 
 import serial
 import serial.tools.list_ports
 
+from . import _hotplug
+from . import _metrics
+from . import _trace
+from . import _vendor
 from . import types
 
 
@@ -13,6 +23,22 @@ class UxibxxIoBoard:
     UXIB-DN12.
     """
     SERIAL_TIMEOUT_S = 1.
+    DISCOVERY_TIMEOUT_S = 0.25
+    RECONNECT_TIMEOUT_S = 5.
+    RECONNECT_POLL_S = 0.1
+    # ^ How long a retrying call waits for a lost board to come back, and
+    # how often it looks for the board between hotplug events
+    MAX_LINE_LEN = 64
+    MAX_LIST_ARGS = 24
+    # ^ Firmware limits on command length and total argument count
+    N_TAGS = 100
+    TAG_LEN = 3
+    # ^ Request tags go from #0 to #99; line lengths allow for the longest
+    MAX_PIPELINED = 16
+    ANALOG_OVERSAMPLE_MAX = 64
+    ANALOG_BUFFER_LEN = 32
+    # ^ Firmware limits on analog sampling; the buffer is per terminal
+    _tag_prefixes = tuple(f"#{tag}".encode('ascii') for tag in range(N_TAGS))
     USB_HW_IDS = {
         (0x4743, 0xB499),
         }
@@ -25,17 +51,62 @@ class UxibxxIoBoard:
     Unsupported = types.Unsupported
     RemoteError = types.RemoteError
     BadResponse = types.BadResponse
+    DeviceDisconnected = types.DeviceDisconnected
 
     IoDirection = types.IoDirection
+    ReconnectPolicy = types.ReconnectPolicy
+    PowerOnState = types.PowerOnState
+    RuleTrigger = types.RuleTrigger
+    RuleAction = types.RuleAction
+    Rule = types.Rule
+    StartupTiming = types.StartupTiming
+    TimerLoad = types.TimerLoad
+    MemoryUsage = types.MemoryUsage
+    IdleStats = types.IdleStats
+    SetSampleResult = types.SetSampleResult
+    AnalogReading = types.AnalogReading
+    AnalogConfig = types.AnalogConfig
+    AnalogBlock = types.AnalogBlock
+    DeviceRecord = types.DeviceRecord
+    InrushStatus = types.InrushStatus
+    InputEvent = types.InputEvent
+    ArmState = types.ArmState
+    ArmStatus = types.ArmStatus
+    EdgeRecord = types.EdgeRecord
+    DriverMetrics = _metrics.DriverMetrics
 
     _direction_codes = [
         (0, IoDirection.INPUT),
         (1, IoDirection.OUTPUT),
+        (2, IoDirection.ANALOG),
+        ]
+    _rule_trigger_codes = [
+        (0, RuleTrigger.LOW),
+        (1, RuleTrigger.HIGH),
+        (2, RuleTrigger.RISING),
+        (3, RuleTrigger.FALLING),
+        (4, RuleTrigger.EDGE),
+        ]
+    _arm_state_codes = [
+        (0, ArmState.IDLE),
+        (1, ArmState.ARMED),
+        (2, ArmState.FIRED),
+        ]
+    _rule_action_codes = [
+        (0, RuleAction.SET),
+        (1, RuleAction.CLEAR),
+        (2, RuleAction.PULSE),
         ]
 
     def __init__(self, ser_port: serial.Serial,
                  board_model: Optional[str] = None,
-                 board_id: Optional[str] = None):
+                 board_id: Optional[str] = None,
+                 use_vendor_interface: bool = True,
+                 metrics: Optional[_metrics.DriverMetrics] = None,
+                 record_to: Optional[str] = None,
+                 auto_reconnect: bool = False,
+                 reconnect_policy: Union[
+                     'types.ReconnectPolicy', str] = "retry"):
         """
         :param ser_port: a ``serial.Serial`` instance that will be used to
             communicate with the hardware
@@ -43,11 +114,51 @@ class UxibxxIoBoard:
             board model string reported by the hardware and :exc:`IdMismatch`
             will be raised in case of a mismatch
         :param board_id: Same as ``board_model`` but for the board ID string
+        :param use_vendor_interface: If ``True`` (and pyusb is installed),
+            look for the board's vendor-specific USB interface and use it for
+            reading and writing I/O states, which cuts per-command latency to
+            about a millisecond. The serial port is still used for everything
+            else. See :attr:`uses_vendor_interface`.
+        :param metrics: If not ``None``, record command latencies, error
+            counts and traffic into this :class:`DriverMetrics` instance. See
+            :attr:`metrics`.
+        :param record_to: If not ``None``, record all serial traffic with
+            timestamps to a trace file at this path, which can be replayed
+            later with ``uxibxx-trace``. Traffic over the vendor interface
+            isn't recorded, so pass ``use_vendor_interface=False`` to capture
+            everything.
+        :param auto_reconnect: If ``True``, recover when the board drops off
+            the USB bus (a hub glitch, a reset, a replugged cable) instead of
+            failing every later call. The board is found again by its board
+            ID, and the output levels and I/O directions last set or read
+            through this instance are restored in one batch, along with the
+            input event selection (see :meth:`enable_input_events`). Other
+            settings aren't restored, and output changes the board makes by
+            itself, e.g. through rules, are only known once read back.
+        :param reconnect_policy: What calls do while the board is gone; see
+            :class:`ReconnectPolicy`
         """
+        self._vendor = None
+        self._metrics = metrics
+        self._edges_lost = 0
+        self._auto_reconnect = False
+        self._reconnect_policy = self.ReconnectPolicy(reconnect_policy)
+        self._recovering = False
+        self._reconnects = 0
+        self._known_outputs: Optional[Dict[int, bool]] = None
+        self._known_directions: Optional[
+            Dict[int, types.IoDirection]] = None
+        self._armed_outputs: Dict[int, bool] = {}
+        self._event_mask = 0
+        if record_to is not None:
+            ser_port = _trace.RecordingPort(ser_port, record_to)
         if hasattr(ser_port, 'timeout'):
             ser_port.timeout = self.SERIAL_TIMEOUT_S
         self._ser_port = ser_port
         portname = self._ser_port.port
+        self._use_tags = False
+        self._next_tag = 1
+        self._use_tags = self._probe_tags()
         self._board_model, self._board_id = self._ask("IDN").split(",")
         for (desc, expected, actual) in [
                 ("board model", board_model, self.board_model),
@@ -61,10 +172,29 @@ class UxibxxIoBoard:
                     f"board reported {actual!r}) for device on "
                     f"port {portname!r}"
                     )
-        term_nos = self._get_term_nos()
-        self._terminal_capabilities = {
-            term_no: self._ask(f"TCP:{term_no}") for term_no in term_nos
+        self._terminal_capabilities = self._ask_list(
+            "TCP", self._get_term_nos())
+        self._index_capabilities()
+        self._out_cmds = {
+            n: tuple(f"OUT:{n}={v}\r".encode('ascii') for v in (0, 1))
+            for n in self._output_nos
+            }
+        self._inp_cmds = {
+            n: f"INP:{n}?\r".encode('ascii') for n in self._input_nos
             }
+        # ^ The hot single-terminal commands, encoded once up front
+        if use_vendor_interface:
+            self._vendor = _vendor.VendorTransport.find(
+                self.USB_HW_IDS, board_id=self.board_id)
+        self._reconnect_vendor = self._vendor is not None
+        if auto_reconnect:
+            self._known_outputs = {}
+            self._known_directions = {}
+            self.get_outputs()
+            self.get_directions(sorted(self._direction_set))
+            self._auto_reconnect = True
+        # ^ The state restored after reconnecting starts from what the board
+        # has now and follows every change made through this instance
 
     @classmethod
     def list_connected_devices(
@@ -95,6 +225,113 @@ class UxibxxIoBoard:
             if (info.vid, info.pid) in usb_vidpids
             ]
 
+    @classmethod
+    def find_device_node(cls, board_id: str) -> Optional[str]:
+        """
+        Looks up the serial device node of the board with the given ID
+        through the ``/dev/serial/by-id`` links that udev maintains, without
+        opening any ports or scanning the USB devices. Linux only.
+
+        :param board_id: board ID string of the board to look for
+        :returns: Path of the device node, or ``None`` if there is no link
+            for that board ID
+        """
+        pattern = os.path.join(
+            "/dev/serial/by-id", f"usb-*_{glob.escape(board_id)}-if*")
+        # ^ Link names end in <serial number>-if<interface no.>
+        for link in sorted(glob.glob(pattern)):
+            return os.path.realpath(link)
+        return None
+
+    @classmethod
+    def _probe_port(cls, portname: str,
+                    timeout_s: float) -> Optional['types.DeviceRecord']:
+        # The leading CR ends any partial line left in the board's buffer;
+        # the error it gets in reply (if any) is skipped along with anything
+        # else that comes before the IDN reply
+        try:
+            ser = serial.Serial(portname, timeout=timeout_s)
+        except (serial.SerialException, OSError):
+            return None
+        replies = []
+        try:
+            ser.reset_input_buffer()
+            ser.write(b"\rIDN?\rFWV?\r")
+            deadline = time.monotonic() + timeout_s
+            while len(replies) < 2 and time.monotonic() < deadline:
+                line = ser.readline().decode('ascii', 'replace')
+                if not line.endswith("\n"):
+                    break
+                line = line.strip()
+                if replies or line.startswith("IDN="):
+                    replies.append(line)
+        except (serial.SerialException, OSError):
+            return None
+        finally:
+            ser.close()
+        if not replies:
+            return None
+        board_model, _, board_id = replies[0][4:].partition(",")
+        version = None
+        if len(replies) > 1 and replies[1].startswith("FWV="):
+            version = replies[1][4:]
+        return types.DeviceRecord(portname, board_model, board_id, version)
+
+    @classmethod
+    def discover_devices(
+            cls, usb_vidpid: Optional[Tuple[int, int]] = None,
+            timeout_s: Optional[float] = None
+            ) -> List['types.DeviceRecord']:
+        """
+        Finds the connected UXIBxx devices like
+        :meth:`list_connected_devices`, then checks that each one answers by
+        asking it for its identity and firmware version. All ports are
+        probed at the same time, so this takes about as long as the slowest
+        one. Ports that can't be opened (e.g. because they're in use) or
+        don't answer in time are left out.
+
+        :param usb_vidpid: A tuple ``(vid, pid)`` specifying a particular
+            USB vendor and product ID to look for instead of using the default
+            list of IDs.
+        :param timeout_s: How long to wait for each device to answer;
+            defaults to :attr:`DISCOVERY_TIMEOUT_S`
+        :returns: A :class:`DeviceRecord` for each device that answered,
+            in the order :meth:`list_connected_devices` lists them
+        """
+        if timeout_s is None:
+            timeout_s = cls.DISCOVERY_TIMEOUT_S
+        portnames = [
+            portname for portname, _
+            in cls.list_connected_devices(usb_vidpid=usb_vidpid)
+            ]
+        if not portnames:
+            return []
+        with concurrent.futures.ThreadPoolExecutor(
+                max_workers=len(portnames)) as pool:
+            records = list(pool.map(
+                lambda portname: cls._probe_port(portname, timeout_s),
+                portnames
+                ))
+        return [record for record in records if record is not None]
+
+    @classmethod
+    def _find_portname(
+            cls,
+            usb_vidpid: Optional[Tuple[int, int]] = None,
+            board_id: Optional[str] = None
+            ) -> Optional[str]:
+        if (board_id is not None and usb_vidpid is None
+                and sys.platform.startswith("linux")):
+            portname = cls.find_device_node(board_id)
+            if portname is not None:
+                return portname
+        for portname, board_id_ in cls.list_connected_devices(
+                usb_vidpid=usb_vidpid):
+            if board_id is not None and board_id != board_id_:
+                continue
+            return portname
+        return None
+
     @classmethod
     def _select_and_open(
             cls,
@@ -103,10 +340,8 @@ class UxibxxIoBoard:
             board_id: Optional[str] = None,
             **kwargs
             ):
-        for portname, board_id_ in cls.list_connected_devices(
-                usb_vidpid=usb_vidpid):
-            if board_id is not None and board_id != board_id_:
-                continue
+        portname = cls._find_portname(usb_vidpid, board_id)
+        if portname is not None:
             return cls.from_serial_portname(
                 portname, board_model=board_model, board_id=board_id, **kwargs)
         filter_desc = ", ".join(
@@ -171,6 +406,22 @@ class UxibxxIoBoard:
         ser = serial.Serial(portname, timeout=cls.SERIAL_TIMEOUT_S)
         return cls(ser, *args, **kwargs)
 
+    def _index_capabilities(self):
+        # Capabilities never change after connecting, so the checks made on
+        # every call use sets built once here
+        caps = self._terminal_capabilities
+        self._terminal_nos = tuple(caps)
+        self._input_nos = tuple(n for n in caps if "I" in caps[n])
+        self._output_nos = tuple(n for n in caps if "O" in caps[n])
+        self._input_set = frozenset(self._input_nos)
+        self._output_set = frozenset(self._output_nos)
+        self._dirchange_set = self._input_set & self._output_set
+        self._analog_nos = tuple(n for n in caps if "A" in caps[n])
+        self._analog_set = frozenset(self._analog_nos)
+        self._direction_set = self._dirchange_set | self._analog_set
+        # ^ Terminals whose direction can be changed
+        self._terminal_bits = {n: 1 << (n - 1) for n in caps}
+
     def _get_term_nos(self):
         response = self._ask("TLS").split(",")
         try:
@@ -179,49 +430,402 @@ class UxibxxIoBoard:
             raise self.BadResponse(response)
         return term_nos
 
-    def _read_response(self):
-        response = self._ser_port.readline().decode('ascii')
-        if not response.endswith("\n"):
-            raise self.ResponseTimeout()
-        response = response.strip()
+    def _probe_tags(self) -> bool:
+        # Firmware without request tags answers a tagged line with an
+        # untagged ERROR:CMD
+        self._ser_port.write(b"#0IDN?\r")
+        while True:
+            response = self._ser_port.readline().decode('ascii', 'replace')
+            if not response.endswith("\n"):
+                raise self.ResponseTimeout()
+            if not response.startswith("!"):
+                return response.startswith("#0 ")
+
+    def _read_response(self, tag: Optional[int] = None,
+                       extra_wait_s: float = 0.):
+        # With a tag, lines that don't carry it are skipped: leftovers of
+        # commands that timed out, partial lines and (with a "!" prefix)
+        # unsolicited event lines, which have their own tag space
+        deadline = time.monotonic() + self.SERIAL_TIMEOUT_S + extra_wait_s
+        while True:
+            response = self._ser_port.readline()
+            if self._metrics is not None:
+                self._metrics.add_bytes_read(len(response))
+            response = response.decode('ascii', 'replace')
+            if not response.endswith("\n"):
+                raise self.ResponseTimeout()
+            response = response.strip()
+            if tag is None:
+                break
+            prefix, _, rest = response.partition(" ")
+            if prefix == f"#{tag}":
+                response = rest
+                break
+            if time.monotonic() > deadline:
+                raise self.ResponseTimeout()
         if response.startswith("ERROR"):
             raise self.RemoteError(response)
         return response
 
+    def _commands(self, lines: List[str],
+                  check: Callable[[str], bool],
+                  raise_errors: bool = True) -> List[str]:
+        # With request tags, all lines are sent before any reply is read.
+        # The firmware works through them in order and holds off the host
+        # while its receive buffer is full.
+        bodies = [f"{line}\r".encode('ascii') for line in lines]
+        if not self._use_tags:
+            return [
+                self._exchange([body], check, raise_errors=raise_errors)[0]
+                for body in bodies
+                ]
+        results = []
+        for i in range(0, len(bodies), self.MAX_PIPELINED):
+            results += self._exchange(
+                bodies[i:i + self.MAX_PIPELINED], check,
+                raise_errors=raise_errors)
+        return results
+
+    def _exchange(self, bodies: List[bytes],
+                  check: Callable[[str], bool],
+                  extra_wait_s: float = 0.,
+                  raise_errors: bool = True) -> List[str]:
+        # Takes encoded command lines, terminator included but untagged.
+        # extra_wait_s is for commands the board takes a while to answer.
+        # Without raise_errors, error and malformed replies are returned in
+        # place rather than raised.
+        while True:
+            try:
+                return self._exchange_once(
+                    bodies, check, extra_wait_s, raise_errors)
+            except OSError:
+                # pySerial errors are OSErrors and mean the port has gone,
+                # where a board that is there but silent times out instead
+                if not self._auto_reconnect or self._recovering:
+                    raise
+                self._recover()
+
+    def _exchange_once(self, bodies: List[bytes],
+                       check: Callable[[str], bool],
+                       extra_wait_s: float,
+                       raise_errors: bool) -> List[str]:
+        tags = [None] * len(bodies)
+        data = bodies
+        if self._use_tags:
+            data = []
+            for i, body in enumerate(bodies):
+                tags[i] = self._next_tag
+                self._next_tag = (self._next_tag + 1) % self.N_TAGS
+                data.append(self._tag_prefixes[tags[i]] + body)
+        starts = []
+        if self._metrics is not None:
+            starts = [self._metrics.start(len(d)) for d in data]
+        responses = []
+        first_error = None
+        i = 0
+        try:
+            self._ser_port.write(b"".join(data))
+            for i, tag in enumerate(tags):
+                outcome = "ok"
+                try:
+                    response = self._read_response(tag, extra_wait_s)
+                    if not check(response):
+                        outcome = "bad_response"
+                        raise self.BadResponse(response)
+                    responses.append(response)
+                except self.ResponseTimeout:
+                    # Replies still on their way are told apart by their
+                    # tags and skipped by later commands
+                    if self._metrics is not None:
+                        for j in range(i, len(bodies)):
+                            self._metrics.finish(
+                                _body_command_type(bodies[j]), starts[j],
+                                "timeout")
+                    raise
+                except self.RemoteError as exc:
+                    outcome = "remote_error"
+                    first_error = first_error or exc
+                    responses.append(str(exc))
+                except self.BadResponse as exc:
+                    first_error = first_error or exc
+                    responses.append(str(exc))
+                if self._metrics is not None:
+                    self._metrics.finish(
+                        _body_command_type(bodies[i]), starts[i], outcome)
+            # ^ Every reply is read before raising so the stream stays in
+            # step
+        except OSError:
+            if self._metrics is not None:
+                for j in range(i, len(bodies)):
+                    self._metrics.finish(
+                        _body_command_type(bodies[j]), starts[j],
+                        "disconnected")
+            raise
+        if first_error is not None and raise_errors:
+            raise first_error
+        return responses
+
+    def _command(self, line: str, check: Callable[[str], bool]) -> str:
+        return self._exchange([f"{line}\r".encode('ascii')], check)[0]
+
     def _ask(self, cmd: str):
-        self._ser_port.write(f"{cmd}?\r".encode('ascii'))
-        response = self._read_response()
-        if "=" not in response:
-            raise self.BadResponse(response)
+        response = self._command(f"{cmd}?", _has_value)
         return response.rsplit("=", 1)[-1]
 
     def _tell(self, cmd: str):
-        self._ser_port.write(f"{cmd}\r".encode('ascii'))
-        response = self._read_response()
-        if response != "OK":
-            raise self.BadResponse(response)
+        self._command(cmd, _is_ok)
+
+    def _chunk_terminals(self, mnem: str, terminals: List[int],
+                         values: Optional[List[int]] = None):
+        # Splits a terminal list into runs that each fit in one command line
+        args_per_terminal = 1 if values is None else 2
+        chunk = []
+        line_len = len(mnem) + 2 + self.TAG_LEN
+        for i, n in enumerate(terminals):
+            arg_len = len(str(n)) + 1
+            if values is not None:
+                arg_len += len(str(values[i])) + 1
+            if chunk and (
+                    line_len + arg_len > self.MAX_LINE_LEN
+                    or (len(chunk) + 1) * args_per_terminal
+                    > self.MAX_LIST_ARGS
+                    ):
+                yield chunk
+                chunk = []
+                line_len = len(mnem) + 2 + self.TAG_LEN
+            chunk.append(i)
+            line_len += arg_len
+        if chunk:
+            yield chunk
+
+    def _ask_list(self, mnem: str, terminals: Iterable[int]) -> Dict[int, str]:
+        terminals = list(terminals)
+        chunks = [
+            [terminals[i] for i in chunk]
+            for chunk in self._chunk_terminals(mnem, terminals)
+            ]
+        responses = self._commands(
+            [f"{mnem}:" + ",".join(str(n) for n in chunk_terms) + "?"
+             for chunk_terms in chunks],
+            _has_value
+            )
+        answers = {}
+        for chunk_terms, response in zip(chunks, responses):
+            values = response.rsplit("=", 1)[-1].split(",")
+            if len(values) != len(chunk_terms):
+                raise self.BadResponse(response)
+            answers.update(zip(chunk_terms, values))
+        return answers
+
+    def _list_lines(self, mnem: str, values: Dict[int, int]) -> List[str]:
+        terminals = list(values)
+        vals = [values[n] for n in terminals]
+        return [
+            f"{mnem}:" + ",".join(str(terminals[i]) for i in chunk)
+            + "=" + ",".join(str(vals[i]) for i in chunk)
+            for chunk in self._chunk_terminals(mnem, terminals, vals)
+            ]
+
+    def _tell_list(self, mnem: str, values: Dict[int, int]):
+        self._commands(self._list_lines(mnem, values), _is_ok)
+
+    def _vendor_request(self, op: '_vendor.VendorOp', arg0: int = 0,
+                        arg1: int = 0) -> '_vendor.Reply':
+        while True:
+            try:
+                return self._vendor_request_once(op, arg0, arg1)
+            except OSError:
+                # pyusb errors other than timeouts mean the device has gone
+                if not self._auto_reconnect or self._recovering:
+                    raise
+                self._recover()
+
+    def _vendor_request_once(self, op: '_vendor.VendorOp', arg0: int,
+                             arg1: int) -> '_vendor.Reply':
+        report_len = self._vendor.report_len
+        if self._metrics is not None:
+            start = self._metrics.start(report_len)
+        outcome = "ok"
+        try:
+            reply = self._vendor.request(op, arg0, arg1)
+            if reply.status != _vendor.VendorStatus.OK:
+                outcome = "remote_error"
+                raise self.RemoteError(
+                    f"Vendor request {op.name} failed with status "
+                    f"{reply.status}")
+            return reply
+        except _vendor.usb.core.USBTimeoutError:
+            outcome = "timeout"
+            raise self.ResponseTimeout()
+        except OSError:
+            outcome = "disconnected"
+            raise
+        finally:
+            if self._metrics is not None:
+                if outcome not in ("timeout", "disconnected"):
+                    self._metrics.add_bytes_read(report_len)
+                self._metrics.finish(f"vendor:{op.name}", start, outcome)
+
+    def _close_link(self):
+        # Releases the handles of a board that has gone away. A trace keeps
+        # recording across the reconnect.
+        if self._vendor is not None:
+            try:
+                self._vendor.close()
+            except OSError:
+                pass
+            self._vendor = None
+        port = self._ser_port
+        if isinstance(port, _trace.RecordingPort):
+            port = port.wrapped_port
+        try:
+            port.close()
+        except OSError:
+            pass
+
+    def _recover(self):
+        # Called once the link has failed. With the retry policy this waits
+        # for the board to come back, waking on hotplug events rather than
+        # polling slowly, so the command can go out again within
+        # milliseconds of the board reappearing.
+        self._close_link()
+        retry = self._reconnect_policy is self.ReconnectPolicy.RETRY
+        deadline = time.monotonic() + (
+            self.RECONNECT_TIMEOUT_S if retry else 0.)
+        watch = _hotplug.DeviceWatch() if retry else None
+        # ^ Set up before the first look so no event can slip in between
+        try:
+            while True:
+                if self._reopen():
+                    self._reconnects += 1
+                    return
+                remaining = deadline - time.monotonic()
+                if remaining <= 0.:
+                    raise self.DeviceDisconnected(
+                        f"Board {self.board_id} is not connected")
+                watch.wait(min(remaining, self.RECONNECT_POLL_S))
+        finally:
+            if watch is not None:
+                watch.close()
+
+    def _reopen(self) -> bool:
+        portname = self._find_portname(board_id=self.board_id)
+        if portname is None:
+            return False
+        try:
+            port = serial.Serial(portname, timeout=self.SERIAL_TIMEOUT_S)
+        except OSError:
+            return False
+            # ^ e.g. udev hasn't set the node's permissions yet
+        timeout = getattr(self._ser_port, 'timeout', None)
+        if isinstance(self._ser_port, _trace.RecordingPort):
+            self._ser_port.replace_port(port)
+        else:
+            self._ser_port = port
+        self._recovering = True
+        try:
+            self._use_tags = self._probe_tags()
+            ok = self._ask("IDN") == f"{self.board_model},{self.board_id}"
+            if ok and self._reconnect_vendor:
+                self._vendor = _vendor.VendorTransport.find(
+                    self.USB_HW_IDS, board_id=self.board_id)
+                ok = self._vendor is not None
+                # ^ The interface may not be claimable just yet
+            if ok:
+                self._restore_state()
+        except (OSError, self.UxibxxIoBoardError):
+            ok = False
+        finally:
+            self._recovering = False
+        if not ok:
+            self._close_link()
+            return False
+        if timeout is not None:
+            self._ser_port.timeout = timeout
+            # ^ set_and_sample() may be waiting with a longer timeout
+        return True
+
+    def _restore_state(self):
+        # One pipelined batch, levels before directions so that terminals
+        # going back to output mode come up at their old level
+        directions = self._known_directions
+        dir_codes = dict((y, x) for (x, y) in self._direction_codes)
+        lines = self._list_lines("OUT", {
+            n: int(on) for n, on in self._known_outputs.items()
+            if directions.get(n) is not self.IoDirection.ANALOG
+            })
+        lines += self._list_lines("DIR", {
+            n: dir_codes[direction] for n, direction in directions.items()
+            })
+        if lines:
+            self._commands(lines, _is_ok)
+        if self._event_mask and self._vendor is not None:
+            self._vendor_request(
+                _vendor.VendorOp.SET_EVENT_MASK, self._event_mask)
+
+    def _note_outputs(self, outputs: Dict[int, bool]):
+        # Changes are noted before they are sent, so a command cut off by a
+        # disconnect is part of the state restored before it is resent
+        if self._known_outputs is not None:
+            self._known_outputs.update(outputs)
+
+    def _note_directions(self, directions: Dict[int, 'types.IoDirection']):
+        if self._known_directions is not None:
+            self._known_directions.update(
+                (n, direction) for n, direction in directions.items()
+                if n in self._direction_set
+                )
+
+    def _terminals_to_mask(self, terminals: Iterable[int]) -> int:
+        mask = 0
+        for n in terminals:
+            bit = self._terminal_bits.get(n)
+            if bit is None:
+                raise self.InvalidTerminalNo(n)
+            mask |= bit
+        return mask
+
+    def _mask_to_terminals(self, mask: int) -> List[int]:
+        return [n for n in self._terminal_nos if mask & (1 << (n - 1))]
 
     def _check_output_ok(self, n: int):
+        if n in self._output_set:
+            return
         if n not in self._terminal_capabilities:
             raise self.InvalidTerminalNo(n)
-        if n not in self.output_nos:
-            raise self.Unsupported(
-                f"Terminal {n} does not have output capability")
+        raise self.Unsupported(
+            f"Terminal {n} does not have output capability")
 
     def _check_input_ok(self, n: int):
+        if n in self._input_set:
+            return
         if n not in self._terminal_capabilities:
             raise self.InvalidTerminalNo(n)
-        if n not in self.input_nos:
-            raise self.Unsupported(
-                f"Terminal {n} does not have input capability")
+        raise self.Unsupported(
+            f"Terminal {n} does not have input capability")
 
     def _check_dirchange_ok(self, n: int):
+        if n in self._dirchange_set:
+            return
         if n not in self._terminal_capabilities:
             raise self.InvalidTerminalNo(n)
-        if n not in self.input_nos or n not in self.output_nos:
-            raise self.Unsupported(
+        raise self.Unsupported(
                 f"Terminal {n} does not support changing I/O direction")
 
+    def _check_analog_ok(self, n: int):
+        if n in self._analog_set:
+            return
+        if n not in self._terminal_capabilities:
+            raise self.InvalidTerminalNo(n)
+        raise self.Unsupported(
+            f"Terminal {n} does not have analog capability")
+
+    def _check_direction_ok(self, n: int, direction: 'types.IoDirection'):
+        if direction is self.IoDirection.ANALOG:
+            self._check_analog_ok(n)
+        else:
+            self._check_dirchange_ok(n)
+
     def get_input(self, n: int):
         """
         Reads out the current input state of the specified terminal.
@@ -237,13 +841,14 @@ class UxibxxIoBoard:
             capability
         :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
         """
-        if n not in self._terminal_capabilities:
-            raise self.InvalidTerminalNo(n)
-        if n not in self.input_nos:
-            raise self.Unsupported(
-                f"Terminal {n} does not have input capability")
-        answer = self._ask(f"INP:{n}")
-        return bool(int(answer))
+        cmd = self._inp_cmds.get(n)
+        if cmd is None:
+            self._check_input_ok(n)
+        if self._vendor is not None:
+            reply = self._vendor_request(_vendor.VendorOp.READ)
+            return bool(reply.inputs & (1 << (n - 1)))
+        response = self._exchange([cmd], _has_value)[0]
+        return bool(int(response.rsplit("=", 1)[-1]))
 
     def get_output(self, n: int):
         """
@@ -258,8 +863,14 @@ class UxibxxIoBoard:
         :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
         """
         self._check_output_ok(n)
-        answer = self._ask(f"OUT:{n}")
-        return bool(int(answer))
+        if self._vendor is not None:
+            reply = self._vendor_request(_vendor.VendorOp.READ)
+            on = bool(reply.outputs & (1 << (n - 1)))
+        else:
+            on = bool(int(self._ask(f"OUT:{n}")))
+        if self._known_outputs is not None:
+            self._known_outputs[n] = on
+        return on
 
     def set_output(self, n: int, on: Union[int, bool]):
         """
@@ -278,8 +889,194 @@ class UxibxxIoBoard:
             capability
         :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
         """
-        self._check_output_ok(n)
-        self._tell(f"OUT:{n}={int(bool(on))}")
+        cmds = self._out_cmds.get(n)
+        if cmds is None:
+            self._check_output_ok(n)
+        if self._known_outputs is not None:
+            self._known_outputs[n] = bool(on)
+        if self._vendor is not None:
+            bit = 1 << (n - 1)
+            self._vendor_request(
+                _vendor.VendorOp.WRITE_OUTPUTS, bit, bit if on else 0)
+            return
+        self._exchange([cmds[bool(on)]], _is_ok)
+
+    def get_outputs(
+            self, terminals: Optional[Iterable[int]] = None
+            ) -> Dict[int, bool]:
+        """
+        Reads out the current state of several outputs with a single command.
+
+        :param terminals: Terminal numbers to read; all outputs if ``None``
+        :returns: Mapping of terminal number to output state
+        :raises InvalidTerminalNo: if a specified terminal number is invalid
+        :raises Unsupported: if a specified terminal does not have output
+            capability
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        terminals = list(self._output_nos if terminals is None else terminals)
+        for n in terminals:
+            self._check_output_ok(n)
+        if self._vendor is not None:
+            reply = self._vendor_request(_vendor.VendorOp.READ)
+            outputs = {
+                n: bool(reply.outputs & (1 << (n - 1))) for n in terminals}
+        else:
+            try:
+                outputs = {
+                    n: bool(int(answer))
+                    for n, answer in self._ask_list("OUT", terminals).items()
+                    }
+            except ValueError:
+                raise self.BadResponse("Non-numeric output state")
+        self._note_outputs(outputs)
+        return outputs
+
+    def set_outputs(self, outputs: Dict[int, bool]):
+        """
+        Sets several outputs in one go.
+
+        The new states are applied together (within a few CPU cycles of each
+        other), unless turn-on staggering is enabled (see
+        :meth:`set_inrush_limit`). Over the serial port, a mapping too long to
+        fit in one command is sent as several commands, each of which is
+        applied together.
+
+        :param outputs: Mapping of terminal number to new output state
+        :raises InvalidTerminalNo: if a specified terminal number is invalid
+        :raises Unsupported: if a specified terminal does not have output
+            capability
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        for n in outputs:
+            self._check_output_ok(n)
+        if self._known_outputs is not None:
+            self._note_outputs({n: bool(on) for n, on in outputs.items()})
+        if self._vendor is None:
+            self._tell_list(
+                "OUT", {n: int(bool(on)) for n, on in outputs.items()})
+            return
+        mask = self._terminals_to_mask(outputs)
+        values = self._terminals_to_mask(n for n, on in outputs.items() if on)
+        self._vendor_request(_vendor.VendorOp.WRITE_OUTPUTS, mask, values)
+
+    def get_inputs(
+            self, terminals: Optional[Iterable[int]] = None
+            ) -> Dict[int, bool]:
+        """
+        Reads out the current state of several inputs as a single snapshot.
+
+        :param terminals: Terminal numbers to read; all inputs if ``None``
+        :returns: Mapping of terminal number to input state
+        :raises InvalidTerminalNo: if a specified terminal number is invalid
+        :raises Unsupported: if a specified terminal does not have input
+            capability
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        terminals = list(self._input_nos if terminals is None else terminals)
+        for n in terminals:
+            self._check_input_ok(n)
+        if self._vendor is not None:
+            reply = self._vendor_request(_vendor.VendorOp.READ)
+            return {n: bool(reply.inputs & (1 << (n - 1))) for n in terminals}
+        try:
+            return {
+                n: bool(int(answer))
+                for n, answer in self._ask_list("INP", terminals).items()
+                }
+        except ValueError:
+            raise self.BadResponse("Non-numeric input state")
+
+    def enable_input_events(self, terminals: Iterable[int]):
+        """
+        Asks the board to report changes on the given inputs as they happen;
+        retrieve them with :meth:`read_input_event`. Inputs are checked every
+        millisecond. Pass an empty list to stop events.
+
+        Requires the vendor USB interface.
+
+        :param terminals: Terminal numbers of the inputs to watch
+        :raises Unsupported: if the vendor interface isn't in use or a
+            terminal does not have input capability
+        :raises InvalidTerminalNo: if a specified terminal number is invalid
+        :raises ResponseTimeout,RemoteError: see class descriptions
+        """
+        terminals = list(terminals)
+        for n in terminals:
+            self._check_input_ok(n)
+        if self._vendor is None:
+            raise self.Unsupported("Input events need the vendor interface")
+        mask = self._terminals_to_mask(terminals)
+        self._vendor_request(_vendor.VendorOp.SET_EVENT_MASK, mask)
+        self._event_mask = mask
+
+    def read_input_event(
+            self, timeout_s: float = 0.
+            ) -> Optional['types.InputEvent']:
+        """
+        Returns the next input change event, waiting up to ``timeout_s``
+        seconds for one to arrive.
+
+        :returns: The event, or ``None`` on timeout
+        :raises Unsupported: if the vendor interface isn't in use
+        """
+        if self._vendor is None:
+            raise self.Unsupported("Input events need the vendor interface")
+        event = self._vendor.read_event(max(1, int(timeout_s * 1000)))
+        if event is None:
+            return None
+        return self.InputEvent(
+            timestamp_ms=event.timestamp_ms,
+            inputs={
+                n: bool(event.inputs & (1 << (n - 1))) for n in self._input_nos
+                },
+            changed=self._mask_to_terminals(event.changed),
+            overrun=bool(event.flags & _vendor.EVENTFLAG_OVERRUN),
+            )
+
+    def enable_edge_capture(self, terminals: Iterable[int]):
+        """
+        Asks the board to timestamp every edge on the given inputs and buffer
+        them until collected with :meth:`read_edges`. Inputs with a pin change
+        interrupt (terminal 14 on the UXIB-DN12) are timestamped to within a
+        few microseconds; the others are sampled every millisecond. Pass an
+        empty list to stop capturing.
+
+        :param terminals: Terminal numbers of the inputs to capture
+        :raises Unsupported: if a terminal does not have input capability
+        :raises InvalidTerminalNo: if a specified terminal number is invalid
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        terminals = list(terminals)
+        for n in terminals:
+            self._check_input_ok(n)
+        self._tell(f"EDC={self._terminals_to_mask(terminals)}")
+
+    def read_edges(self) -> List['types.EdgeRecord']:
+        """
+        Collects the edges captured since the last call, oldest first. The
+        board buffers a limited number of edges; any it had to drop are
+        counted in :attr:`edges_lost`. If edges are arriving faster than one
+        reply can carry, call again until an empty list comes back.
+
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        response = self._ask("EDG")
+        try:
+            fields = [int(x) for x in response.split(",")]
+        except ValueError:
+            raise self.BadResponse(response)
+        if (len(fields) - 1) % 3:
+            raise self.BadResponse(response)
+        self._edges_lost += fields[0]
+        return [
+            self.EdgeRecord(
+                terminal_no=fields[i],
+                level=bool(fields[i + 1]),
+                device_time_us=fields[i + 2],
+                )
+            for i in range(1, len(fields), 3)
+            ]
 
     def get_direction(self, n: int) -> 'types.IoDirection':
         """
@@ -295,9 +1092,11 @@ class UxibxxIoBoard:
         response = self._ask(f"DIR:{n}")
         try:
             dir_int = int(response)
-            return dict(self._direction_codes)[dir_int]
+            direction = dict(self._direction_codes)[dir_int]
         except (ValueError, KeyError):
             raise self.BadResponse(response)
+        self._note_directions({n: direction})
+        return direction
 
     def set_direction(
             self, n: int,
@@ -315,16 +1114,784 @@ class UxibxxIoBoard:
             requested mode.
         :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
         """
-        self._check_dirchange_ok(n)
         direction = self.IoDirection(direction)
+        self._check_direction_ok(n, direction)
         dir_code = dict((y, x) for (x, y) in self._direction_codes)[direction]
+        self._note_directions({n: direction})
         self._tell(f"DIR:{n}={dir_code}")
 
+    def get_directions(
+            self, terminals: Optional[Iterable[int]] = None
+            ) -> Dict[int, 'types.IoDirection']:
+        """
+        Reads out the current I/O direction of several terminals with a
+        single command.
+
+        :param terminals: Terminal numbers to read; all terminals if ``None``
+        :returns: Mapping of terminal number to I/O direction
+        :raises InvalidTerminalNo: if a specified terminal number is invalid
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        terminals = list(self._terminal_nos if terminals is None else terminals)
+        for n in terminals:
+            if n not in self._terminal_capabilities:
+                raise self.InvalidTerminalNo(n)
+        directions = {}
+        for n, answer in self._ask_list("DIR", terminals).items():
+            try:
+                directions[n] = dict(self._direction_codes)[int(answer)]
+            except (ValueError, KeyError):
+                raise self.BadResponse(answer)
+        self._note_directions(directions)
+        return directions
+
+    def set_directions(
+            self, directions: Dict[int, types._IoDirectionOrLiteral]):
+        """
+        Sets the I/O direction of several terminals. The board checks every
+        terminal in a command before changing any of them.
+
+        :param directions: Mapping of terminal number to I/O direction
+        :raises InvalidTerminalNo: if a specified terminal number is invalid
+        :raises Unsupported: if a specified terminal does not support the
+            requested mode
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        directions = {
+            n: self.IoDirection(direction)
+            for n, direction in directions.items()
+            }
+        for n, direction in directions.items():
+            self._check_direction_ok(n, direction)
+        dir_codes = dict((y, x) for (x, y) in self._direction_codes)
+        self._note_directions(directions)
+        self._tell_list("DIR", {
+            n: dir_codes[direction] for n, direction in directions.items()
+            })
+
+    def arm_outputs(self, outputs: Dict[int, bool], trigger_no: int,
+                    rising: bool = True):
+        """
+        Loads output states to be applied all at once on an edge of a trigger
+        terminal. Wiring the same trigger line to several boards and arming
+        each of them makes their outputs switch within microseconds of each
+        other, which sequential commands can't do.
+
+        If the trigger terminal is in input mode, the update is applied on
+        the next matching edge. On UXIB-DN12 only terminal 14 can be used
+        this way. If it's in output mode, this board is the *master*: arming
+        sets the trigger to its idle level and :meth:`fire` drives the edge
+        together with this board's own update. See also
+        :meth:`fire_synchronized`.
+
+        Arming again replaces any update that hasn't fired yet.
+
+        :param outputs: Mapping of terminal number to the output state to
+            apply; outputs not included are left alone
+        :param trigger_no: Terminal number of the trigger terminal
+        :param rising: Fire on a rising (``True``) or falling edge
+        :raises InvalidTerminalNo: if a specified terminal number is invalid
+        :raises Unsupported: if a specified terminal does not have output
+            capability
+        :raises RemoteError: if the trigger terminal can't be used as one
+        :raises ResponseTimeout,BadResponse: see class descriptions
+        """
+        for n in outputs:
+            self._check_output_ok(n)
+        if trigger_no not in self._terminal_capabilities:
+            raise self.InvalidTerminalNo(trigger_no)
+        mask = self._terminals_to_mask(outputs)
+        values = self._terminals_to_mask(n for n, on in outputs.items() if on)
+        self._tell(f"ARM={mask},{values},{trigger_no},{int(bool(rising))}")
+        self._armed_outputs = {n: bool(on) for n, on in outputs.items()}
+
+    def set_and_sample(self, outputs: Dict[int, bool],
+                       settle_s: float) -> 'types.SetSampleResult':
+        """
+        Applies output states, waits ``settle_s`` seconds on the board and
+        then reads every input, all in one command. The wait is timed by the
+        board, so it doesn't pick up the jitter of a host-side sleep and an
+        extra round trip; use this e.g. to switch a valve and check its
+        feedback input once it has had time to move.
+
+        Turn-ons delayed by the inrush limiter (see :meth:`set_inrush_limit`)
+        happen later than the change the wait is measured from.
+
+        :param outputs: Mapping of terminal number to the output state to
+            apply; outputs not included are left alone
+        :param settle_s: Time to wait before sampling, in seconds (0 to
+            65.535, 1 us resolution; the board's timer has 4 us resolution)
+        :returns: The input states and the actual time from applying the
+            outputs to sampling
+        :raises InvalidTerminalNo: if a specified terminal number is invalid
+        :raises Unsupported: if a specified terminal does not have output
+            capability
+        :raises ValueError: if ``settle_s`` is out of range
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        for n in outputs:
+            self._check_output_ok(n)
+        settle_us = round(settle_s * 1e6)
+        if not 0 <= settle_us <= 65535999:
+            raise ValueError(f"Settle time out of range: {settle_s}")
+        mask = self._terminals_to_mask(outputs)
+        values = self._terminals_to_mask(n for n, on in outputs.items() if on)
+        ms, us = divmod(settle_us, 1000)
+        line = f"SAS={mask},{values},{ms},{us}"
+        self._note_outputs({n: bool(on) for n, on in outputs.items()})
+        if hasattr(self._ser_port, 'timeout'):
+            self._ser_port.timeout = self.SERIAL_TIMEOUT_S + settle_s
+        try:
+            response = self._exchange(
+                [f"{line}\r".encode('ascii')], _has_value, settle_s)[0]
+        finally:
+            if hasattr(self._ser_port, 'timeout'):
+                self._ser_port.timeout = self.SERIAL_TIMEOUT_S
+        try:
+            levels, elapsed_us = (
+                int(x) for x in response.rsplit("=", 1)[-1].split(","))
+        except ValueError:
+            raise self.BadResponse(response)
+        return self.SetSampleResult(
+            {n: bool(levels & (1 << (n - 1))) for n in self._input_nos},
+            elapsed_us
+            )
+
+    def configure_analog(self, oversample: int = 4, average_count: int = 8):
+        """
+        Sets how the board's ADC samples terminals in analog mode (see
+        :class:`IoDirection`). The ADC runs continuously, taking turns
+        between analog terminals at one conversion per 104 us. Every
+        ``oversample`` conversions of a terminal are averaged into one
+        buffered sample, and :meth:`get_analog_values` also reports the mean
+        of the last ``average_count`` samples. The settings apply to every
+        analog terminal and are lost on reset; the values shown are the
+        power-on defaults.
+
+        :param oversample: Conversions per sample; a power of two from 1 to
+            :attr:`ANALOG_OVERSAMPLE_MAX`
+        :param average_count: Samples to average, from 1 to
+            :attr:`ANALOG_BUFFER_LEN`
+        :raises ValueError: if either value is out of range
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        if (not 1 <= oversample <= self.ANALOG_OVERSAMPLE_MAX
+                or oversample & (oversample - 1)):
+            raise ValueError(f"Invalid oversampling factor: {oversample}")
+        if not 1 <= average_count <= self.ANALOG_BUFFER_LEN:
+            raise ValueError(f"Invalid average count: {average_count}")
+        self._tell(f"ANC={oversample},{average_count}")
+
+    def get_analog_config(self) -> 'types.AnalogConfig':
+        """
+        Reads out the ADC sampling settings and the resulting sample period.
+
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        response = self._ask("ANC")
+        try:
+            return self.AnalogConfig(*(int(x) for x in response.split(",")))
+        except (ValueError, TypeError):
+            raise self.BadResponse(response)
+
+    def get_analog_values(
+            self, terminals: Optional[Iterable[int]] = None
+            ) -> Dict[int, 'types.AnalogReading']:
+        """
+        Reads out the latest and averaged readings of several analog
+        terminals with a single command.
+
+        :param terminals: Terminal numbers to read; all analog-capable
+            terminals if ``None``. Each has to be in analog mode.
+        :returns: Mapping of terminal number to readings
+        :raises InvalidTerminalNo: if a specified terminal number is invalid
+        :raises Unsupported: if a specified terminal does not have analog
+            capability
+        :raises RemoteError: if a specified terminal isn't in analog mode
+        :raises ResponseTimeout,BadResponse: see class descriptions
+        """
+        terminals = list(self._analog_nos if terminals is None else terminals)
+        for n in terminals:
+            self._check_analog_ok(n)
+        if not terminals:
+            return {}
+        response = self._ask("ANV:" + ",".join(str(n) for n in terminals))
+        try:
+            values = [int(x) for x in response.split(",")]
+        except ValueError:
+            raise self.BadResponse(response)
+        if len(values) != 2 * len(terminals):
+            raise self.BadResponse(response)
+        return {
+            n: self.AnalogReading(values[2 * i], values[2 * i + 1])
+            for i, n in enumerate(terminals)
+            }
+
+    def get_analog(self, n: int) -> 'types.AnalogReading':
+        """
+        Reads out the latest and averaged readings of one analog terminal.
+
+        :param n: Terminal number; the terminal has to be in analog mode
+        :raises InvalidTerminalNo: if the specified terminal number is invalid
+        :raises Unsupported: if the specified terminal does not have analog
+            capability
+        :raises RemoteError: if the terminal isn't in analog mode
+        :raises ResponseTimeout,BadResponse: see class descriptions
+        """
+        return self.get_analog_values([n])[n]
+
+    def read_analog_samples(self, n: int) -> 'types.AnalogBlock':
+        """
+        Takes the samples of an analog terminal that have been buffered
+        since the previous call (up to :attr:`ANALOG_BUFFER_LEN`), oldest
+        first. To record continuously, call this at least once per
+        ``ANALOG_BUFFER_LEN`` sample periods (see :meth:`get_analog_config`)
+        and check :attr:`AnalogBlock.dropped` for gaps.
+
+        :param n: Terminal number; the terminal has to be in analog mode
+        :raises InvalidTerminalNo: if the specified terminal number is invalid
+        :raises Unsupported: if the specified terminal does not have analog
+            capability
+        :raises RemoteError: if the terminal isn't in analog mode
+        :raises ResponseTimeout,BadResponse: see class descriptions
+        """
+        self._check_analog_ok(n)
+        response = self._ask(f"ANB:{n}")
+        try:
+            dropped, hex_samples = response.split(",")
+            samples = array.array('H', bytes.fromhex(hex_samples))
+            # ^ Four hex digits per sample, most significant first
+            dropped = int(dropped)
+        except ValueError:
+            raise self.BadResponse(response)
+        if sys.byteorder == "little":
+            samples.byteswap()
+        return self.AnalogBlock(samples, dropped)
+
+    def disarm(self):
+        """
+        Cancels an armed update that hasn't fired. Harmless if there is none.
+
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        self._tell("DSA")
+
+    def fire(self):
+        """
+        Applies the armed update right away; on a master board (see
+        :meth:`arm_outputs`) this also drives the trigger edge that fires the
+        other boards.
+
+        :raises RemoteError: if nothing is armed
+        :raises ResponseTimeout,BadResponse: see class descriptions
+        """
+        self._tell("FIR")
+        self._note_outputs(self._armed_outputs)
+
+    def get_arm_status(self) -> 'types.ArmStatus':
+        """
+        Reads out the most recently armed update and whether it has fired.
+
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        response = self._ask("ARM")
+        try:
+            state, mask, values, trigger_no, rising = (
+                int(x) for x in response.split(","))
+            state = dict(self._arm_state_codes)[state]
+        except (ValueError, KeyError):
+            raise self.BadResponse(response)
+        outputs = {
+            n: bool(values & (1 << (n - 1)))
+            for n in self._mask_to_terminals(mask)
+            }
+        if state is self.ArmState.FIRED:
+            self._note_outputs(outputs)
+            # ^ Fired by an edge from another board
+        return self.ArmStatus(
+            state=state,
+            outputs=outputs,
+            trigger_no=trigger_no,
+            rising=bool(rising),
+            )
+
+    @classmethod
+    def fire_synchronized(
+            cls,
+            master: 'UxibxxIoBoard',
+            master_trigger_no: int,
+            updates: Dict['UxibxxIoBoard', Dict[int, bool]],
+            slave_trigger_no: int = 14,
+            rising: bool = True,
+            ):
+        """
+        Applies output updates on several boards at the same instant. The
+        master board's ``master_trigger_no`` terminal must be wired to the
+        ``slave_trigger_no`` terminal of every other board in ``updates``,
+        with the master's trigger terminal in output mode and the others in
+        input mode.
+
+        Every other board is armed first, then the master, which then fires.
+        Afterwards each board is checked to have fired.
+
+        :param master: Board that drives the trigger line
+        :param master_trigger_no: Trigger terminal number on the master
+        :param updates: Mapping of board to the outputs to set on it (as for
+            :meth:`set_outputs`); may include the master
+        :param slave_trigger_no: Trigger terminal number on the other boards
+        :param rising: Fire on a rising (``True``) or falling edge
+        :raises RemoteError: if a board didn't fire, e.g. because its trigger
+            input isn't connected
+        :raises ResponseTimeout,BadResponse: see class descriptions
+        """
+        slaves = [board for board in updates if board is not master]
+        for board in slaves:
+            board.arm_outputs(updates[board], slave_trigger_no, rising)
+        master.arm_outputs(
+            updates.get(master, {}), master_trigger_no, rising)
+        master.fire()
+        for board in slaves:
+            if board.get_arm_status().state != cls.ArmState.FIRED:
+                board.disarm()
+                raise cls.RemoteError(
+                    f"Board {board.board_id} did not see the trigger edge")
+
+    def set_inrush_limit(self, spacing_ms: int, max_concurrent: int = 1):
+        """
+        Limits how many outputs the board switches on at once, to keep the
+        combined inrush current of inductive loads within what the supply can
+        deliver. Turn-ons are grouped into slots ``spacing_ms`` long holding
+        up to ``max_concurrent`` outputs each. A slot opens with the first
+        turn-on after the previous one ended, and later turn-ons join it
+        straight away while it has room; the rest wait for the next slot, in
+        terminal number order. Switching outputs off is never delayed, and
+        switching off an output that is still waiting cancels its turn-on.
+
+        This applies to :meth:`set_output`, :meth:`set_outputs` and
+        :meth:`recall_preset`. Rule actions and armed updates (see
+        :meth:`arm_outputs`) always switch immediately. The setting is not
+        saved and reverts to disabled at reset.
+
+        :param spacing_ms: Time between groups, from 0 (disabled) to 255
+        :param max_concurrent: Number of outputs per group, from 1 to 255
+        :raises ValueError: if either value is out of range
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        if not 0 <= spacing_ms <= 255:
+            raise ValueError("spacing_ms must be between 0 and 255")
+        if not 1 <= max_concurrent <= 255:
+            raise ValueError("max_concurrent must be between 1 and 255")
+        self._tell(f"INR={spacing_ms},{max_concurrent}")
+
+    def get_inrush_status(self) -> 'types.InrushStatus':
+        """
+        Reads out the turn-on staggering settings along with the outputs
+        still waiting to be switched on and how long that will take.
+
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        response = self._ask("INR")
+        try:
+            spacing_ms, max_concurrent, pending, settle_ms = (
+                int(x) for x in response.split(","))
+        except ValueError:
+            raise self.BadResponse(response)
+        return self.InrushStatus(
+            spacing_ms=spacing_ms,
+            max_concurrent=max_concurrent,
+            pending_outputs=self._mask_to_terminals(pending),
+            settle_ms=settle_ms,
+            )
+
+    def get_power_on_state(self) -> 'types.PowerOnState':
+        """
+        Reads out the output states and I/O directions that the board applies
+        at power-on and after reset. Note this reflects any unsaved changes
+        made with :meth:`set_power_on_state`.
+
+        :returns: The current power-on settings
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        response = self._ask("PON")
+        try:
+            outputs_mask, dirs_mask = (int(x) for x in response.split(","))
+        except ValueError:
+            raise self.BadResponse(response)
+        return self.PowerOnState(
+            active_outputs=self._mask_to_terminals(outputs_mask),
+            output_terminals=self._mask_to_terminals(dirs_mask),
+            )
+
+    def set_power_on_state(
+            self,
+            active_outputs: Iterable[int],
+            output_terminals: Optional[Iterable[int]] = None,
+            save: bool = True
+            ):
+        """
+        Sets the output states and I/O directions that the board applies at
+        power-on and after reset. These take effect before the board
+        enumerates on USB, so loads are in a known state as early as possible.
+
+        :param active_outputs: Terminal numbers of the outputs to activate at
+            power-on; all other outputs are inactive
+        :param output_terminals: Terminal numbers of the terminals to put in
+            output mode at power-on. If ``None``, the current power-on
+            directions are left unchanged.
+        :param save: If ``True``, save the new settings (along with the rest
+            of the board's settings) to nonvolatile memory; otherwise they are
+            lost at the next reset unless :meth:`save_settings` is called.
+        :raises InvalidTerminalNo: if a specified terminal number is invalid
+        :raises Unsupported: if a specified terminal does not have output
+            capability
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        active_outputs = list(active_outputs)
+        if output_terminals is None:
+            output_terminals = self.get_power_on_state().output_terminals
+        output_terminals = list(output_terminals)
+        for n in active_outputs + output_terminals:
+            self._check_output_ok(n)
+        outputs_mask = self._terminals_to_mask(active_outputs)
+        dirs_mask = self._terminals_to_mask(output_terminals)
+        self._tell(f"PON={outputs_mask},{dirs_mask}")
+        if save:
+            self.save_settings()
+
+    def save_settings(self):
+        """
+        Saves the board's settings (board ID, power-on state, etc.) to
+        nonvolatile memory.
+
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        self._tell("NVS")
+
+    def define_preset(self, preset_no: int, outputs: Dict[int, bool]):
+        """
+        Defines (or redefines) an output preset on the board. A preset sets
+        any number of outputs at once when recalled with
+        :meth:`recall_preset`; outputs not included in the preset are left
+        alone. Presets are stored in nonvolatile memory straight away.
+
+        :param preset_no: Preset number, starting from 1
+        :param outputs: Mapping of terminal number to the output state to
+            apply on recall. An empty mapping deletes the preset.
+        :raises InvalidTerminalNo: if a specified terminal number is invalid
+        :raises Unsupported: if a specified terminal does not have output
+            capability
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        for n in outputs:
+            self._check_output_ok(n)
+        mask = self._terminals_to_mask(outputs)
+        values = self._terminals_to_mask(n for n, on in outputs.items() if on)
+        self._tell(f"PST:{preset_no}={mask},{values}")
+
+    def delete_preset(self, preset_no: int):
+        """
+        Deletes an output preset. Deleting an undefined preset is harmless.
+
+        :param preset_no: Preset number
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        self._tell(f"PST:{preset_no}=0,0")
+
+    def get_preset(self, preset_no: int) -> Dict[int, bool]:
+        """
+        Reads out the definition of an output preset.
+
+        :param preset_no: Preset number
+        :returns: Mapping of terminal number to the output state applied on
+            recall
+        :raises RemoteError: if the preset is not defined
+        :raises ResponseTimeout,BadResponse: see class descriptions
+        """
+        response = self._ask(f"PST:{preset_no}")
+        try:
+            mask, values = (int(x) for x in response.split(","))
+        except ValueError:
+            raise self.BadResponse(response)
+        return {
+            n: bool(values & (1 << (n - 1)))
+            for n in self._mask_to_terminals(mask)
+            }
+
+    def list_presets(self) -> List[int]:
+        """
+        Gets the numbers of all presets currently defined on the board.
+
+        :returns: List of preset numbers
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        response = self._ask("PSL")
+        try:
+            return [int(x) for x in response.split(",") if x]
+        except ValueError:
+            raise self.BadResponse(response)
+
+    def recall_preset(self, preset_no: int):
+        """
+        Applies an output preset. All outputs in the preset switch together
+        (within a few CPU cycles of each other), with no intermediate states.
+
+        :param preset_no: Preset number
+        :raises RemoteError: if the preset is not defined
+        :raises ResponseTimeout,BadResponse: see class descriptions
+        """
+        if self._known_outputs is not None:
+            self._note_outputs(self.get_preset(preset_no))
+            # ^ Costs a round trip, but only with auto-reconnect
+        if self._vendor is not None:
+            self._vendor_request(_vendor.VendorOp.RECALL_PRESET, preset_no)
+            return
+        self._tell(f"RCL:{preset_no}")
+
+    def define_rule(
+            self,
+            rule_no: int,
+            input_no: int,
+            trigger: Union['types.RuleTrigger', str],
+            action: Union['types.RuleAction', str],
+            outputs: Iterable[int],
+            pulse_ms: int = 0,
+            enable: bool = True
+            ):
+        """
+        Defines (or redefines) an input-to-output rule that the board
+        evaluates on its own, with no host involvement. Rules react within
+        microseconds to inputs that have pin change interrupts (terminal 14 on
+        UXIB-DN12) and within 1 ms to other inputs.
+
+        Rules are kept in RAM; use :meth:`save_settings` to have them survive
+        a reset.
+
+        :param rule_no: Rule number, starting from 1
+        :param input_no: Terminal number of the input that triggers the rule
+        :param trigger: Input condition that fires the rule, either a
+            :class:`RuleTrigger` member or the corresponding string literal
+        :param action: What to do to the outputs, either a :class:`RuleAction`
+            member or the corresponding string literal
+        :param outputs: Terminal numbers of the outputs to act on
+        :param pulse_ms: Pulse duration for :attr:`RuleAction.PULSE`
+        :param enable: If ``True``, enable the rule straight away; otherwise
+            it stays disabled until :meth:`enable_rule` is called
+        :raises InvalidTerminalNo: if a specified terminal number is invalid
+        :raises Unsupported: if the specified terminals lack the required
+            input or output capability
+        :raises ValueError: if a pulse action is combined with a level
+            (low or high) trigger
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        self._check_input_ok(input_no)
+        outputs = list(outputs)
+        for n in outputs:
+            self._check_output_ok(n)
+        trigger = self.RuleTrigger(trigger)
+        action = self.RuleAction(action)
+        if action is self.RuleAction.PULSE and trigger in (
+                self.RuleTrigger.LOW, self.RuleTrigger.HIGH):
+            raise ValueError("Pulse rules need an edge trigger")
+        trigger_code = dict(
+            (y, x) for (x, y) in self._rule_trigger_codes
+            )[trigger]
+        action_code = dict(
+            (y, x) for (x, y) in self._rule_action_codes
+            )[action]
+        mask = self._terminals_to_mask(outputs)
+        self._tell(
+            f"RUL:{rule_no}={input_no},{trigger_code},{action_code},"
+            f"{mask},{int(pulse_ms)}"
+            )
+        if enable:
+            self.enable_rule(rule_no)
+
+    def delete_rule(self, rule_no: int):
+        """
+        Deletes an on-board rule. Deleting an undefined rule is harmless.
+
+        :param rule_no: Rule number
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        self._tell(f"RUL:{rule_no}=0,0,0,0,0")
+
+    def enable_rule(self, rule_no: int):
+        """
+        Starts evaluating a previously defined rule.
+
+        :param rule_no: Rule number
+        :raises RemoteError: if the rule is not defined
+        :raises ResponseTimeout,BadResponse: see class descriptions
+        """
+        self._tell(f"REN:{rule_no}=1")
+
+    def disable_rule(self, rule_no: int):
+        """
+        Stops evaluating a rule without deleting it.
+
+        :param rule_no: Rule number
+        :raises RemoteError: if the rule is not defined
+        :raises ResponseTimeout,BadResponse: see class descriptions
+        """
+        self._tell(f"REN:{rule_no}=0")
+
+    def get_rule(self, rule_no: int) -> 'types.Rule':
+        """
+        Reads out the definition of an on-board rule.
+
+        :param rule_no: Rule number
+        :returns: The rule definition
+        :raises RemoteError: if the rule is not defined
+        :raises ResponseTimeout,BadResponse: see class descriptions
+        """
+        response = self._ask(f"RUL:{rule_no}")
+        try:
+            input_no, trigger, action, mask, pulse_ms, enabled = (
+                int(x) for x in response.split(","))
+            return self.Rule(
+                input_no=input_no,
+                trigger=dict(self._rule_trigger_codes)[trigger],
+                action=dict(self._rule_action_codes)[action],
+                outputs=self._mask_to_terminals(mask),
+                pulse_ms=pulse_ms,
+                enabled=bool(enabled),
+                )
+        except (ValueError, KeyError):
+            raise self.BadResponse(response)
+
+    def list_rules(self) -> Dict[int, 'types.Rule']:
+        """
+        Reads out all rules currently defined on the board.
+
+        :returns: Mapping of rule number to rule definition
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        response = self._ask("RLS")
+        try:
+            rule_nos = [int(x) for x in response.split(",") if x]
+        except ValueError:
+            raise self.BadResponse(response)
+        return {rule_no: self.get_rule(rule_no) for rule_no in rule_nos}
+
+    def get_max_observed_rule_eval_us(self) -> int:
+        """
+        Reads out the longest time the board has been seen to take to
+        evaluate its rule table since reset, timed to 4 us. This is an
+        observed maximum, not a bound: a longer evaluation may still come,
+        and the time the pin change interrupt waits behind other interrupts
+        (such as USB control requests) isn't included. A rule's outputs lag
+        its trigger by that wait, its sampling delay and the evaluation time.
+
+        :returns: Longest observed rule evaluation time in microseconds
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        response = self._ask("RLT")
+        try:
+            return int(response)
+        except ValueError:
+            raise self.BadResponse(response)
+
+    def get_timer_load(self) -> 'types.TimerLoad':
+        """
+        Reads out how often the board's timer interrupt ran and how much time
+        it took since the previous call (or since reset). The timer only
+        wakes up for scheduled work, so this shows the background load that
+        heartbeat, pulse and polling activity put on the board.
+
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        response = self._ask("TML")
+        try:
+            return self.TimerLoad(*(int(x) for x in response.split(",")))
+        except (ValueError, TypeError):
+            raise self.BadResponse(response)
+
+    def get_firmware_version(self) -> str:
+        """
+        Reads out the board's firmware version string.
+
+        :raises RemoteError: if the firmware is too old to report it
+        :raises ResponseTimeout,BadResponse: see class descriptions
+        """
+        return self._ask("FWV")
+
+    def get_idle_stats(self) -> 'types.IdleStats':
+        """
+        Reads out how much of the time since the previous call (or since
+        reset) the board spent in idle sleep, along with the longest delay
+        seen so far before it starts handling a command. The board sleeps
+        whenever it has nothing to do and wakes on USB, timer and input
+        activity.
+
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        response = self._ask("IDL")
+        try:
+            return self.IdleStats(*(int(x) for x in response.split(",")))
+        except (ValueError, TypeError):
+            raise self.BadResponse(response)
+
+    def get_memory_usage(self) -> 'types.MemoryUsage':
+        """
+        Reads out how much of the board's RAM is in use, including the
+        deepest the stack has reached since reset.
+
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        response = self._ask("MEM")
+        try:
+            return self.MemoryUsage(*(int(x) for x in response.split(",")))
+        except (ValueError, TypeError):
+            raise self.BadResponse(response)
+
+    def get_startup_timing(self) -> 'types.StartupTiming':
+        """
+        Reads out how long the board took to get through its startup sequence
+        after the most recent reset. Useful for measuring how quickly loads
+        reach their power-on state and how long USB enumeration takes.
+
+        :returns: Startup milestone timestamps
+        :raises ResponseTimeout,RemoteError,BadResponse: see class descriptions
+        """
+        response = self._ask("TTR")
+        try:
+            return self.StartupTiming(
+                *(int(x) for x in response.split(",")))
+        except (ValueError, TypeError):
+            raise self.BadResponse(response)
+
+    def run_commands(self, lines: Iterable[str]) -> List[str]:
+        """
+        Sends raw command lines in the board's own syntax, e.g.
+        ``"OUT:1,2=1"`` or ``"INP:13?"``, and returns the reply to each.
+        With firmware that supports request tags, up to
+        :attr:`MAX_PIPELINED` lines go out before the first reply is read, so
+        a batch costs about one round trip. Error replies are returned like
+        any other rather than raised, and don't stop the lines after them.
+        Nothing is checked on the host side, so this bypasses the state
+        tracked for ``auto_reconnect``.
+
+        :param lines: Command lines, without tags or line endings
+        :returns: The reply to each line, in order
+        :raises ValueError: if a line is not printable ASCII or is too long
+        :raises ResponseTimeout: see class description
+        """
+        lines = list(lines)
+        for line in lines:
+            if (not all(" " <= ch <= "~" for ch in line)
+                    or len(line) > self.MAX_LINE_LEN - self.TAG_LEN):
+                raise ValueError(f"Invalid command line: {line!r}")
+        return self._commands(lines, lambda response: True, False)
+
     def close(self):
         """
-        Immediately releases the serial port handle. Calling multiple times is
-        harmless.
+        Immediately releases the serial port handle (and the vendor USB
+        interface, if in use). Calling multiple times is harmless.
         """
+        self._auto_reconnect = False
+        if self._vendor is not None:
+            self._vendor.close()
+            self._vendor = None
         if self._ser_port is not None:
             self._ser_port.close()
             self._ser_port = None
@@ -344,13 +1911,45 @@ class UxibxxIoBoard:
         """
         return self._board_id
 
+    @property
+    def metrics(self) -> Optional[_metrics.DriverMetrics]:
+        """
+        The :class:`DriverMetrics` instance recording this board's traffic,
+        or ``None`` if metrics are disabled
+        """
+        return self._metrics
+
+    @property
+    def edges_lost(self) -> int:
+        """
+        Total number of captured edges the board has dropped because its
+        buffer was full when they arrived (see :meth:`read_edges`)
+        """
+        return self._edges_lost
+
+    @property
+    def reconnects(self) -> int:
+        """
+        Number of times the board has been reconnected after dropping off
+        the bus (see the ``auto_reconnect`` argument of :meth:`__init__`)
+        """
+        return self._reconnects
+
+    @property
+    def uses_vendor_interface(self) -> bool:
+        """
+        ``True`` if I/O states are being read and written over the board's
+        vendor-specific USB interface rather than the serial port
+        """
+        return self._vendor is not None
+
     @property
     def terminal_nos(self) -> List[int]:
         """
         A list of valid terminal numbers. Terminals are normally (but not
         strictly necessarily) numbered consecutively starting from 1.
         """
-        return list(self._terminal_capabilities.keys())
+        return list(self._terminal_nos)
 
     @property
     def input_nos(self) -> List[int]:
@@ -358,10 +1957,7 @@ class UxibxxIoBoard:
         A list of the terminal numbers for terminals that are inputs or support
         being set to input mode.
         """
-        return [
-            term_no for (term_no, caps) in self._terminal_capabilities.items()
-            if "I" in caps
-            ]
+        return list(self._input_nos)
 
     @property
     def output_nos(self) -> List[int]:
@@ -369,7 +1965,24 @@ class UxibxxIoBoard:
         A list of the terminal numbers for terminals that are outputs or
         support being set to output mode.
         """
-        return [
-            term_no for (term_no, caps) in self._terminal_capabilities.items()
-            if "O" in caps
-            ]
+        return list(self._output_nos)
+
+    @property
+    def analog_nos(self) -> List[int]:
+        """
+        A list of the terminal numbers for terminals that support being set
+        to analog mode.
+        """
+        return list(self._analog_nos)
+
+
+def _is_ok(response: str) -> bool:
+    return response == "OK"
+
+
+def _has_value(response: str) -> bool:
+    return "=" in response
+
+
+def _body_command_type(body: bytes) -> str:
+    return _metrics.command_type(body.decode('ascii').rstrip("\r"))
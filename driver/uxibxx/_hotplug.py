@@ -0,0 +1,109 @@
+"""
+Waiting for device nodes to appear, for reconnecting to a board after it has
+dropped off the USB bus.
+
+On Linux, :class:`DeviceWatch` is woken by inotify as soon as udev creates a
+node in ``/dev`` or a link in ``/dev/serial/by-id``. Elsewhere (or if inotify
+is unavailable) it just sleeps for the poll interval, so callers always
+re-check for their device in a loop rather than relying on the events.
+"""
+import ctypes
+import ctypes.util
+import errno
+import os
+import select
+import struct
+import sys
+import time
+from typing import Dict, Optional
+
+
+IN_ATTRIB = 0x00000004
+IN_MOVED_TO = 0x00000080
+IN_CREATE = 0x00000100
+IN_IGNORED = 0x00008000
+IN_NONBLOCK = os.O_NONBLOCK
+IN_CLOEXEC = getattr(os, "O_CLOEXEC", 0o2000000)
+
+WATCH_MASK = IN_CREATE | IN_MOVED_TO | IN_ATTRIB
+# ^ udev creates the node, then fixes its permissions, then renames the
+# by-id link into place; the board may be openable only after the last step
+WATCH_DIRS = ("/dev", "/dev/serial", "/dev/serial/by-id")
+
+_EVENT_HEADER = struct.Struct("iIII")
+
+
+def _load_libc():
+    if not sys.platform.startswith("linux"):
+        return None
+    try:
+        libc = ctypes.CDLL(ctypes.util.find_library("c"), use_errno=True)
+        libc.inotify_init1
+        libc.inotify_add_watch
+    except (OSError, AttributeError):
+        return None
+    return libc
+
+
+class DeviceWatch:
+    """
+    Wakes up a waiting thread when device nodes are created.
+    """
+    def __init__(self):
+        self._libc = _load_libc()
+        self._fd: Optional[int] = None
+        self._watches: Dict[int, str] = {}
+        if self._libc is not None:
+            fd = self._libc.inotify_init1(IN_NONBLOCK | IN_CLOEXEC)
+            if fd >= 0:
+                self._fd = fd
+                self._add_watches()
+
+    @property
+    def uses_events(self) -> bool:
+        return self._fd is not None
+
+    def _add_watches(self):
+        # /dev/serial/by-id comes and goes with the first and last USB serial
+        # device, so missing directories are retried after every wakeup
+        watched = set(self._watches.values())
+        for path in WATCH_DIRS:
+            if path in watched:
+                continue
+            wd = self._libc.inotify_add_watch(
+                self._fd, os.fsencode(path), WATCH_MASK)
+            if wd >= 0:
+                self._watches[wd] = path
+
+    def _drain(self):
+        while True:
+            try:
+                data = os.read(self._fd, 4096)
+            except OSError as exc:
+                if exc.errno in (errno.EAGAIN, errno.EWOULDBLOCK):
+                    return
+                raise
+            offset = 0
+            while offset + _EVENT_HEADER.size <= len(data):
+                wd, mask, _, name_len = _EVENT_HEADER.unpack_from(data, offset)
+                if mask & IN_IGNORED:
+                    self._watches.pop(wd, None)
+                    # ^ The directory was removed
+                offset += _EVENT_HEADER.size + name_len
+
+    def wait(self, timeout_s: float):
+        """
+        Returns after a device node is created or ``timeout_s`` seconds have
+        passed, whichever comes first.
+        """
+        if self._fd is None:
+            time.sleep(timeout_s)
+            return
+        if select.select([self._fd], [], [], max(0., timeout_s))[0]:
+            self._drain()
+        self._add_watches()
+
+    def close(self):
+        if self._fd is not None:
+            os.close(self._fd)
+            self._fd = None
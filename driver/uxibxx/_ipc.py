@@ -0,0 +1,131 @@
+"""
+Wire format shared by the board daemon and its clients.
+
+Messages are JSON objects, one per line, over a Unix domain socket::
+
+    Request:  {"id": 7, "board": "4D8502", "method": "set_output",
+               "args": [3, true], "kwargs": {}}
+    Reply:    {"id": 7, "result": null}
+              {"id": 7, "error": {"type": "InvalidTerminalNo",
+                                  "message": "..."}}
+    Push:     {"event": "inputs", "board": "4D8502", "inputs": ...}
+
+Values that JSON can't represent directly (enum members, named tuples,
+dicts with integer keys and arrays) are wrapped in tagged objects by
+:func:`encode` and unwrapped by :func:`decode`. Only types from
+:mod:`uxibxx.types` are ever reconstructed.
+"""
+import array
+import inspect
+import json
+import os
+import tempfile
+from enum import Enum
+from typing import Any, List, Optional
+
+from . import types
+from ._driver import UxibxxIoBoard
+
+
+UNSHARED_METHODS = {"enable_input_events", "read_input_event", "close"}
+# ^ Input events go to whoever reads them first, so daemon clients get input
+# snapshots from RemoteIoBoard.subscribe_inputs() instead
+
+
+def forwarded_methods() -> List[str]:
+    """
+    Names of the :class:`UxibxxIoBoard` methods a client may call through
+    the daemon.
+    """
+    return [
+        name for name, member in vars(UxibxxIoBoard).items()
+        if not name.startswith("_")
+        and inspect.isfunction(member)
+        and name not in UNSHARED_METHODS
+        ]
+
+
+def default_socket_path() -> str:
+    runtime_dir = os.environ.get("XDG_RUNTIME_DIR")
+    if runtime_dir:
+        return os.path.join(runtime_dir, "uxibxx.sock")
+    return os.path.join(tempfile.gettempdir(), f"uxibxx-{os.getuid()}.sock")
+
+
+def _wire_type(name: str) -> Optional[type]:
+    cls = getattr(types, name, None)
+    if not isinstance(cls, type):
+        return None
+    if issubclass(cls, Enum) or hasattr(cls, "_fields"):
+        return cls
+    return None
+
+
+def encode(obj: Any) -> Any:
+    if isinstance(obj, Enum):
+        return {"__enum__": type(obj).__name__, "value": obj.value}
+    if isinstance(obj, tuple) and hasattr(obj, "_fields"):
+        return {
+            "__tuple__": type(obj).__name__,
+            "fields": {k: encode(v) for k, v in obj._asdict().items()},
+            }
+    if isinstance(obj, array.array):
+        return {"__array__": obj.typecode, "values": obj.tolist()}
+    if isinstance(obj, dict):
+        return {"__dict__": [[encode(k), encode(v)] for k, v in obj.items()]}
+    if isinstance(obj, (list, tuple)):
+        return [encode(x) for x in obj]
+    return obj
+
+
+def decode(obj: Any) -> Any:
+    if isinstance(obj, list):
+        return [decode(x) for x in obj]
+    if not isinstance(obj, dict):
+        return obj
+    if "__dict__" in obj:
+        return {decode(k): decode(v) for k, v in obj["__dict__"]}
+    if "__array__" in obj:
+        return array.array(obj["__array__"], obj["values"])
+    if "__enum__" in obj:
+        cls = _wire_type(obj["__enum__"])
+        if cls is None:
+            raise ValueError(f"Unknown type {obj['__enum__']!r}")
+        return cls(obj["value"])
+    if "__tuple__" in obj:
+        cls = _wire_type(obj["__tuple__"])
+        if cls is None:
+            raise ValueError(f"Unknown type {obj['__tuple__']!r}")
+        return cls(**{k: decode(v) for k, v in obj["fields"].items()})
+    return {k: decode(v) for k, v in obj.items()}
+
+
+def encode_error(exc: Exception) -> dict:
+    if isinstance(exc, types.UxibxxIoBoardError):
+        type_name = type(exc).__name__
+    elif isinstance(exc, (ValueError, TypeError)):
+        type_name = type(exc).__name__
+    else:
+        type_name = "UxibxxIoBoardError"
+    return {"type": type_name, "message": str(exc)}
+
+
+def decode_error(error: dict) -> Exception:
+    type_name = error.get("type")
+    message = error.get("message", "")
+    if type_name in ("ValueError", "TypeError"):
+        return {"ValueError": ValueError, "TypeError": TypeError}[type_name](
+            message)
+    cls = getattr(types, type_name or "", None)
+    if not (isinstance(cls, type)
+            and issubclass(cls, types.UxibxxIoBoardError)):
+        cls = types.UxibxxIoBoardError
+    return cls(message)
+
+
+def pack(message: dict) -> bytes:
+    return (json.dumps(message, separators=(",", ":")) + "\n").encode()
+
+
+def unpack(line: bytes) -> dict:
+    return json.loads(line.decode())
@@ -0,0 +1,244 @@
+"""
+Optional latency and traffic instrumentation for :class:`UxibxxIoBoard`.
+
+Nothing here runs unless a :class:`DriverMetrics` instance is passed to the
+board; with metrics disabled the only cost is one ``is None`` check per
+command.
+"""
+import os
+import tempfile
+import threading
+import time
+from typing import Callable, Dict, List, NamedTuple, Optional
+
+
+LATENCY_BUCKETS_S = (
+    0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1., 2.
+    )
+# ^ Upper bounds; full-speed USB round trips land in the 1-2 ms buckets
+
+
+class CommandSample(NamedTuple):
+    """
+    One completed (or failed) command, as passed to the ``on_sample``
+    callback of :class:`DriverMetrics`
+    """
+    #: Mnemonic plus operator, e.g. ``"OUT="`` or ``"INP?"``; vendor
+    #: interface requests are named like ``"vendor:READ"``
+    command: str
+    #: Time from sending the command to receiving the reply (or giving up)
+    latency_s: float
+    #: ``"ok"``, ``"timeout"``, ``"remote_error"``, ``"bad_response"`` or
+    #: ``"disconnected"`` (the port or USB device went away)
+    outcome: str
+
+
+class CommandStats:
+    """
+    Accumulated statistics for one command type
+    """
+    def __init__(self):
+        #: Number of replies received, including error replies
+        self.count = 0
+        #: Total latency of those replies, in seconds
+        self.latency_sum_s = 0.
+        #: Reply counts per bucket of :data:`LATENCY_BUCKETS_S`, plus one for
+        #: anything slower (not cumulative)
+        self.bucket_counts = [0] * (len(LATENCY_BUCKETS_S) + 1)
+        self.timeouts = 0
+        self.remote_errors = 0
+        self.bad_responses = 0
+        self.disconnects = 0
+
+    def quantile(self, q: float) -> Optional[float]:
+        """
+        Estimates a latency quantile (``q`` from 0 to 1) as the upper bound of
+        the bucket it falls into. Returns ``None`` if there are no samples,
+        or ``inf`` if it falls beyond the last bucket.
+        """
+        if not self.count:
+            return None
+        target = q * self.count
+        seen = 0
+        for bound, n in zip(LATENCY_BUCKETS_S, self.bucket_counts):
+            seen += n
+            if seen >= target:
+                return bound
+        return float("inf")
+
+
+class DriverMetrics:
+    """
+    Collects per-command latency histograms, error counts and byte counts
+    for a board. Pass an instance as the ``metrics`` argument of
+    :class:`UxibxxIoBoard`; one instance may be shared by several boards.
+
+    :param on_sample: Optional callback invoked with a :class:`CommandSample`
+        after every command. It runs on the calling thread, so it should be
+        quick.
+    """
+    CommandSample = CommandSample
+    CommandStats = CommandStats
+
+    def __init__(
+            self,
+            on_sample: Optional[Callable[[CommandSample], None]] = None):
+        self.on_sample = on_sample
+        self._lock = threading.Lock()
+        self._commands: Dict[str, CommandStats] = {}
+        self.bytes_written = 0
+        self.bytes_read = 0
+        #: Commands sent but not yet answered
+        self.in_flight = 0
+        #: Highest value :attr:`in_flight` has reached
+        self.in_flight_max = 0
+
+    def command_stats(self) -> Dict[str, CommandStats]:
+        """
+        Returns the statistics gathered so far, keyed by command type (see
+        :attr:`CommandSample.command`). The returned objects are live.
+        """
+        with self._lock:
+            return dict(self._commands)
+
+    def reset(self):
+        with self._lock:
+            self._commands.clear()
+            self.bytes_written = 0
+            self.bytes_read = 0
+            self.in_flight_max = self.in_flight
+
+    def start(self, n_bytes: int) -> float:
+        with self._lock:
+            self.bytes_written += n_bytes
+            self.in_flight += 1
+            if self.in_flight > self.in_flight_max:
+                self.in_flight_max = self.in_flight
+        return time.perf_counter()
+
+    def finish(self, command: str, start: float, outcome: str):
+        latency_s = time.perf_counter() - start
+        with self._lock:
+            self.in_flight -= 1
+            stats = self._commands.get(command)
+            if stats is None:
+                stats = self._commands[command] = CommandStats()
+            if outcome == "timeout":
+                stats.timeouts += 1
+            elif outcome == "disconnected":
+                stats.disconnects += 1
+            else:
+                if outcome == "remote_error":
+                    stats.remote_errors += 1
+                elif outcome == "bad_response":
+                    stats.bad_responses += 1
+                stats.count += 1
+                stats.latency_sum_s += latency_s
+                bucket = 0
+                while (bucket < len(LATENCY_BUCKETS_S)
+                        and latency_s > LATENCY_BUCKETS_S[bucket]):
+                    bucket += 1
+                stats.bucket_counts[bucket] += 1
+        if self.on_sample is not None:
+            self.on_sample(CommandSample(command, latency_s, outcome))
+
+    def add_bytes_read(self, n_bytes: int):
+        with self._lock:
+            self.bytes_read += n_bytes
+
+    def to_prometheus_text(
+            self, labels: Optional[Dict[str, str]] = None) -> str:
+        """
+        Renders the metrics in the Prometheus text exposition format.
+
+        :param labels: Extra labels to put on every sample, e.g.
+            ``{"board": board.board_id}``
+        """
+        base = dict(labels or {})
+
+        def fmt(name: str, value, **extra) -> str:
+            all_labels = dict(base, **extra)
+            label_str = ",".join(
+                '{}="{}"'.format(
+                    k, str(v).replace("\\", "\\\\").replace('"', '\\"'))
+                for k, v in all_labels.items()
+                )
+            return (f"{name}{{{label_str}}} {value}" if label_str
+                    else f"{name} {value}")
+
+        lines: List[str] = []
+        commands = self.command_stats()
+        with self._lock:
+            lines += [
+                "# TYPE uxibxx_command_latency_seconds histogram",
+                ]
+            for command, stats in sorted(commands.items()):
+                cumulative = 0
+                for bound, n in zip(LATENCY_BUCKETS_S, stats.bucket_counts):
+                    cumulative += n
+                    lines.append(fmt(
+                        "uxibxx_command_latency_seconds_bucket", cumulative,
+                        command=command, le=repr(bound)))
+                lines += [
+                    fmt("uxibxx_command_latency_seconds_bucket", stats.count,
+                        command=command, le="+Inf"),
+                    fmt("uxibxx_command_latency_seconds_sum",
+                        repr(stats.latency_sum_s), command=command),
+                    fmt("uxibxx_command_latency_seconds_count", stats.count,
+                        command=command),
+                    ]
+            for metric, attr in [
+                    ("uxibxx_command_timeouts_total", "timeouts"),
+                    ("uxibxx_command_remote_errors_total", "remote_errors"),
+                    ("uxibxx_command_bad_responses_total", "bad_responses"),
+                    ("uxibxx_command_disconnects_total", "disconnects"),
+                    ]:
+                lines.append(f"# TYPE {metric} counter")
+                for command, stats in sorted(commands.items()):
+                    lines.append(fmt(
+                        metric, getattr(stats, attr), command=command))
+            lines += [
+                "# TYPE uxibxx_bytes_written_total counter",
+                fmt("uxibxx_bytes_written_total", self.bytes_written),
+                "# TYPE uxibxx_bytes_read_total counter",
+                fmt("uxibxx_bytes_read_total", self.bytes_read),
+                "# TYPE uxibxx_commands_in_flight gauge",
+                fmt("uxibxx_commands_in_flight", self.in_flight),
+                "# TYPE uxibxx_commands_in_flight_max gauge",
+                fmt("uxibxx_commands_in_flight_max", self.in_flight_max),
+                ]
+        return "\n".join(lines) + "\n"
+
+    def write_prometheus_textfile(
+            self, path: str, labels: Optional[Dict[str, str]] = None):
+        """
+        Writes :meth:`to_prometheus_text` output to ``path`` for the node
+        exporter's textfile collector. The file is replaced atomically so the
+        collector never sees a partial write.
+        """
+        directory = os.path.dirname(os.path.abspath(path))
+        fd, tmp_path = tempfile.mkstemp(dir=directory, suffix=".tmp")
+        try:
+            with os.fdopen(fd, "w") as f:
+                f.write(self.to_prometheus_text(labels))
+            os.chmod(tmp_path, 0o644)
+            os.replace(tmp_path, path)
+        except BaseException:
+            os.unlink(tmp_path)
+            raise
+
+
+def command_type(line: str) -> str:
+    """
+    Reduces a command line such as ``"OUT:3=1"`` to its type, ``"OUT="``
+    """
+    end = len(line)
+    for i, ch in enumerate(line):
+        if ch in ":?=":
+            end = i
+            break
+    if line.endswith("?"):
+        return line[:end] + "?"
+    if "=" in line:
+        return line[:end] + "="
+    return line[:end]
@@ -0,0 +1,323 @@
+"""
+Recording and replay of the serial traffic between the driver and a board.
+
+A trace file starts with a header::
+
+    magic "UXTR" (4 bytes), version (1), start time as a Unix timestamp
+    (8, little-endian double)
+
+followed by one record per write or read::
+
+    kind (1: 0 = TX, 1 = RX), microseconds since the previous record
+    (varint), data length (varint), data
+
+Varints are unsigned LEB128. RX records hold whatever one ``readline()``
+returned, so a timed-out read shows up as an RX record without a line
+ending.
+"""
+import argparse
+import io
+import statistics
+import struct
+import sys
+import threading
+import time
+from typing import BinaryIO, Dict, Iterator, List, NamedTuple
+
+from . import _metrics
+
+
+MAGIC = b"UXTR"
+VERSION = 1
+KIND_TX = 0
+KIND_RX = 1
+
+_HEADER_STRUCT = struct.Struct("<4sBd")
+
+
+class TraceRecord(NamedTuple):
+    kind: int
+    #: Seconds since the start of the trace
+    t_s: float
+    data: bytes
+
+
+def _write_varint(f: BinaryIO, value: int):
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            f.write(bytes([byte | 0x80]))
+        else:
+            f.write(bytes([byte]))
+            return
+
+
+def _read_varint(f: BinaryIO) -> int:
+    value = 0
+    shift = 0
+    while True:
+        b = f.read(1)
+        if not b:
+            raise EOFError()
+        value |= (b[0] & 0x7F) << shift
+        if not b[0] & 0x80:
+            return value
+        shift += 7
+
+
+class TraceWriter:
+    def __init__(self, f: BinaryIO):
+        self._f = f
+        self._lock = threading.Lock()
+        self._start = time.perf_counter()
+        self._last_us = 0
+        f.write(_HEADER_STRUCT.pack(MAGIC, VERSION, time.time()))
+
+    def record(self, kind: int, data: bytes):
+        with self._lock:
+            now_us = int((time.perf_counter() - self._start) * 1e6)
+            self._f.write(bytes([kind]))
+            _write_varint(self._f, now_us - self._last_us)
+            _write_varint(self._f, len(data))
+            self._f.write(data)
+            self._last_us = now_us
+
+    def close(self):
+        with self._lock:
+            self._f.close()
+
+
+def read_trace(f: BinaryIO) -> Iterator[TraceRecord]:
+    header = f.read(_HEADER_STRUCT.size)
+    if len(header) != _HEADER_STRUCT.size:
+        raise ValueError("Not a trace file (too short)")
+    magic, version, _ = _HEADER_STRUCT.unpack(header)
+    if magic != MAGIC:
+        raise ValueError("Not a trace file (bad magic)")
+    if version != VERSION:
+        raise ValueError(f"Unsupported trace version {version}")
+    t_us = 0
+    while True:
+        kind = f.read(1)
+        if not kind:
+            return
+        try:
+            t_us += _read_varint(f)
+            length = _read_varint(f)
+        except EOFError:
+            return
+            # Truncated final record, e.g. the recording process was killed
+        data = f.read(length)
+        if len(data) != length:
+            return
+        yield TraceRecord(kind[0], t_us / 1e6, data)
+
+
+class RecordingPort:
+    """
+    Wraps a ``serial.Serial`` (or anything with the same ``write()`` and
+    ``readline()`` methods) and logs the traffic through it to a trace file.
+    Other attributes are passed through to the wrapped port.
+    """
+    def __init__(self, port, trace_path: str):
+        self._port = port
+        self._writer = TraceWriter(open(trace_path, "wb"))
+
+    def write(self, data: bytes) -> int:
+        self._writer.record(KIND_TX, bytes(data))
+        return self._port.write(data)
+
+    def readline(self) -> bytes:
+        line = self._port.readline()
+        self._writer.record(KIND_RX, line)
+        return line
+
+    @property
+    def wrapped_port(self):
+        return self._port
+
+    def replace_port(self, port):
+        """
+        Carries on recording to the same trace through ``port``, e.g. after
+        reopening a board that was disconnected
+        """
+        self._port = port
+
+    def close(self):
+        self._port.close()
+        self._writer.close()
+
+    def __getattr__(self, name):
+        return getattr(self._port, name)
+
+    def __setattr__(self, name, value):
+        if name.startswith("_"):
+            super().__setattr__(name, value)
+        else:
+            setattr(self._port, name, value)
+
+
+class Exchange(NamedTuple):
+    """A command from a trace along with the replies recorded for it"""
+    t_s: float
+    command: bytes
+    replies: List[TraceRecord]
+
+
+def exchanges(records: Iterator[TraceRecord]) -> List[Exchange]:
+    result: List[Exchange] = []
+    for record in records:
+        if record.kind == KIND_TX:
+            result.append(Exchange(record.t_s, record.data, []))
+        elif result:
+            result[-1].replies.append(record)
+    return result
+
+
+class MockPort:
+    """
+    Stand-in serial port that answers each command with the replies recorded
+    for it in a trace, immediately and regardless of what was actually sent.
+    Useful for measuring the host side of a workload in isolation.
+    """
+    def __init__(self, trace: List[Exchange]):
+        self.port = "trace-mock"
+        self.timeout = None
+        self._pending = [
+            [reply.data for reply in exchange.replies] for exchange in trace
+            ]
+        self._pending.reverse()
+        self._replies: List[bytes] = []
+
+    def write(self, data: bytes) -> int:
+        if self._pending:
+            self._replies.extend(self._pending.pop())
+        return len(data)
+
+    def readline(self) -> bytes:
+        return self._replies.pop(0) if self._replies else b""
+
+    def close(self):
+        pass
+
+
+class ReplayResult(NamedTuple):
+    command_type: str
+    recorded_latency_s: float
+    replayed_latency_s: float
+    matched: bool
+
+
+def replay(trace: List[Exchange], port,
+           speed: float = 1.) -> List[ReplayResult]:
+    """
+    Sends the commands in ``trace`` to ``port``, keeping the recorded
+    spacing between them divided by ``speed`` (0 sends them back to back),
+    and times each reply.
+    """
+    results = []
+    start = time.perf_counter()
+    for exchange in trace:
+        if speed > 0:
+            delay = start + exchange.t_s / speed - time.perf_counter()
+            if delay > 0:
+                time.sleep(delay)
+        sent_at = time.perf_counter()
+        port.write(exchange.command)
+        line = exchange.command.decode("ascii", "replace").strip()
+        for reply in exchange.replies:
+            data = port.readline()
+            results.append(ReplayResult(
+                _metrics.command_type(line),
+                reply.t_s - exchange.t_s,
+                time.perf_counter() - sent_at,
+                data == reply.data,
+                ))
+    return results
+
+
+def _percentile(values: List[float], q: float) -> float:
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(q * len(ordered)))]
+
+
+def format_report(results: List[ReplayResult]) -> str:
+    by_type: Dict[str, List[ReplayResult]] = {}
+    for result in results:
+        by_type.setdefault(result.command_type, []).append(result)
+    out = io.StringIO()
+    out.write(
+        f"{'command':<12}{'n':>6}{'mismatch':>9}"
+        f"{'rec p50':>10}{'rep p50':>10}{'dev p50':>10}{'dev p95':>10}"
+        f"{'dev max':>10}  (ms)\n"
+        )
+    for command_type, rows in sorted(by_type.items()) + [("ALL", results)]:
+        if not rows:
+            continue
+        recorded = [r.recorded_latency_s * 1e3 for r in rows]
+        replayed = [r.replayed_latency_s * 1e3 for r in rows]
+        deviations = [y - x for x, y in zip(recorded, replayed)]
+        out.write(
+            f"{command_type:<12}{len(rows):>6}"
+            f"{sum(not r.matched for r in rows):>9}"
+            f"{statistics.median(recorded):>10.3f}"
+            f"{statistics.median(replayed):>10.3f}"
+            f"{statistics.median(deviations):>10.3f}"
+            f"{_percentile(deviations, 0.95):>10.3f}"
+            f"{max(deviations, key=abs):>10.3f}\n"
+            )
+    return out.getvalue()
+
+
+def _dump(path: str):
+    with open(path, "rb") as f:
+        for record in read_trace(f):
+            kind = "TX" if record.kind == KIND_TX else "RX"
+            print(f"{record.t_s:12.6f} {kind} {record.data!r}")
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Inspect or replay UXIBxx serial traffic traces")
+    subparsers = parser.add_subparsers(dest="action")
+    subparsers.required = True
+    dump_parser = subparsers.add_parser("dump", help="Print a trace")
+    dump_parser.add_argument("trace")
+    replay_parser = subparsers.add_parser(
+        "replay", help="Replay a trace and compare reply latencies")
+    replay_parser.add_argument("trace")
+    target = replay_parser.add_mutually_exclusive_group(required=True)
+    target.add_argument(
+        "-p", "--port",
+        help="Serial port name or pySerial URL of a board or simulator")
+    target.add_argument(
+        "--mock", action="store_true",
+        help="Answer from the trace itself instead of a device")
+    replay_parser.add_argument(
+        "-s", "--speed", type=float, default=1.,
+        help="Playback speed factor; 0 sends commands back to back")
+    args = parser.parse_args()
+
+    if args.action == "dump":
+        _dump(args.trace)
+        return
+    with open(args.trace, "rb") as f:
+        trace = exchanges(read_trace(f))
+    if args.mock:
+        port = MockPort(trace)
+    else:
+        import serial
+        port = serial.serial_for_url(args.port, timeout=1.)
+    try:
+        results = replay(trace, port, args.speed)
+    finally:
+        port.close()
+    if not results:
+        print("Trace has no replies to compare", file=sys.stderr)
+        sys.exit(1)
+    sys.stdout.write(format_report(results))
+
+
+if __name__ == "__main__":
+    main()
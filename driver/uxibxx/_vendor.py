@@ -0,0 +1,205 @@
+"""
+Transport for the vendor-specific USB interface of UXIBxx boards.
+
+The vendor interface exchanges fixed-size 8-byte reports over 1 ms interrupt
+endpoints, bypassing the host's tty layer. Boards with more than 16 terminals
+use 16-byte reports instead, with 32-bit terminal masks. It is only used when pyusb is
+installed and the OS lets us claim the interface; everything else goes
+through the CDC serial port.
+
+Report layout (multi-byte fields little-endian)::
+
+    Request:  [0] op  [1] tag  [2:4] arg0  [4:6] arg1  [6:8] reserved
+    Reply:    [0] op | 0x80  [1] tag  [2] status  [3] 0
+              [4:6] output levels  [6:8] input levels
+    Event:    [0] 0xC0  [1] flags  [2:4] ms timestamp
+              [4:6] input levels  [6:8] inputs that changed
+
+Terminal levels are bitmasks with bit n-1 standing for terminal n. In 16-byte
+reports the args and levels are 4 bytes each, in the same order, and the rest
+of the report is zero::
+
+    Request:  [0] op  [1] tag  [2:6] arg0  [6:10] arg1  [10:16] reserved
+    Reply:    [0] op | 0x80  [1] tag  [2] status  [3] 0
+              [4:8] output levels  [8:12] input levels  [12:16] 0
+    Event:    [0] 0xC0  [1] flags  [2:4] ms timestamp
+              [4:8] input levels  [8:12] inputs that changed  [12:16] 0
+"""
+import collections
+import struct
+from enum import IntEnum
+from typing import Deque, Iterable, NamedTuple, Optional, Tuple
+
+try:
+    import usb.core
+    import usb.util
+except ImportError:
+    usb = None
+
+
+REPORT_LEN = 8
+WIDE_REPORT_LEN = 16
+# ^ Boards with 32-bit terminal masks
+REPLY_FLAG = 0x80
+TYPE_EVENT = 0xC0
+EVENTFLAG_OVERRUN = 0x01
+
+_REQUEST_STRUCTS = {
+    REPORT_LEN: struct.Struct("<BBHH2x"),
+    WIDE_REPORT_LEN: struct.Struct("<BBII6x"),
+    }
+_REPLY_STRUCTS = {
+    REPORT_LEN: struct.Struct("<BBBxHH"),
+    WIDE_REPORT_LEN: struct.Struct("<BBBxII4x"),
+    }
+_EVENT_STRUCTS = {
+    REPORT_LEN: struct.Struct("<BBHHH"),
+    WIDE_REPORT_LEN: struct.Struct("<BBHII4x"),
+    }
+
+
+class VendorOp(IntEnum):
+    READ = 0x01
+    WRITE_OUTPUTS = 0x02
+    RECALL_PRESET = 0x03
+    SET_EVENT_MASK = 0x04
+
+
+class VendorStatus(IntEnum):
+    OK = 0
+    BAD_OP = 1
+    BAD_VAL = 2
+
+
+class Reply(NamedTuple):
+    op: int
+    tag: int
+    status: int
+    outputs: int
+    inputs: int
+
+
+class Event(NamedTuple):
+    flags: int
+    timestamp_ms: int
+    inputs: int
+    changed: int
+
+
+def encode_request(op: int, tag: int, arg0: int = 0, arg1: int = 0,
+                   report_len: int = REPORT_LEN) -> bytes:
+    return _REQUEST_STRUCTS[report_len].pack(op, tag & 0xFF, arg0, arg1)
+
+
+def decode_report(data: bytes):
+    """
+    Returns a :class:`Reply` or :class:`Event`, or ``None`` if ``data`` is not
+    a recognizable report. The mask width is worked out from the length.
+    """
+    if len(data) not in _REPLY_STRUCTS:
+        return None
+    if data[0] == TYPE_EVENT:
+        _, flags, timestamp, inputs, changed = (
+            _EVENT_STRUCTS[len(data)].unpack(data))
+        return Event(flags, timestamp, inputs, changed)
+    if data[0] & REPLY_FLAG:
+        op, tag, status, outputs, inputs = (
+            _REPLY_STRUCTS[len(data)].unpack(data))
+        return Reply(op & ~REPLY_FLAG, tag, status, outputs, inputs)
+    return None
+
+
+class VendorTransport:
+    INTERFACE_NUMBER = 2
+    EP_IN_ADDR = 0x84
+    EP_OUT_ADDR = 0x05
+    TIMEOUT_MS = 1000
+
+    def __init__(self, device, report_len: int = REPORT_LEN):
+        self._device = device
+        self.report_len = report_len
+        self._tag = 0
+        self._events: Deque[Event] = collections.deque(maxlen=256)
+        usb.util.claim_interface(device, self.INTERFACE_NUMBER)
+
+    @classmethod
+    def find(
+            cls, usb_vidpids: Iterable[Tuple[int, int]],
+            board_id: Optional[str] = None
+            ) -> Optional['VendorTransport']:
+        """
+        Opens the vendor interface of the board with the given USB serial
+        number. Returns ``None`` rather than raising if pyusb isn't installed,
+        no such board is found, its firmware has no vendor interface or the
+        interface can't be claimed.
+        """
+        if usb is None:
+            return None
+        try:
+            for vid, pid in usb_vidpids:
+                for device in usb.core.find(
+                        find_all=True, idVendor=vid, idProduct=pid):
+                    if (board_id is not None
+                            and device.serial_number != board_id):
+                        continue
+                    interface = usb.util.find_descriptor(
+                        device.get_active_configuration(),
+                        bInterfaceNumber=cls.INTERFACE_NUMBER
+                        )
+                    if interface is None:
+                        return None
+                    endpoint = usb.util.find_descriptor(
+                        interface, bEndpointAddress=cls.EP_IN_ADDR)
+                    if (endpoint is None or endpoint.wMaxPacketSize
+                            not in (REPORT_LEN, WIDE_REPORT_LEN)):
+                        return None
+                    return cls(device, endpoint.wMaxPacketSize)
+                    # ^ The reports fill the endpoint
+        except (usb.core.USBError, ValueError, NotImplementedError):
+            # ValueError and NotImplementedError are what pyusb raises when
+            # it can't read the serial number or has no usable backend
+            pass
+        return None
+
+    def _next_tag(self) -> int:
+        self._tag = (self._tag + 1) & 0xFF
+        return self._tag
+
+    def request(self, op: VendorOp, arg0: int = 0, arg1: int = 0) -> Reply:
+        """
+        Sends a request and waits for its reply. Events arriving in the
+        meantime are kept for :meth:`read_event`.
+
+        :raises usb.core.USBError: on transfer errors or timeout
+        """
+        tag = self._next_tag()
+        self._device.write(
+            self.EP_OUT_ADDR,
+            encode_request(op, tag, arg0, arg1, self.report_len),
+            self.TIMEOUT_MS
+            )
+        while True:
+            report = decode_report(bytes(self._device.read(
+                self.EP_IN_ADDR, self.report_len, self.TIMEOUT_MS)))
+            if isinstance(report, Event):
+                self._events.append(report)
+            elif (isinstance(report, Reply)
+                    and report.op == op and report.tag == tag):
+                return report
+
+    def read_event(self, timeout_ms: int) -> Optional[Event]:
+        if self._events:
+            return self._events.popleft()
+        try:
+            data = bytes(self._device.read(
+                self.EP_IN_ADDR, self.report_len, timeout_ms))
+        except usb.core.USBTimeoutError:
+            return None
+        report = decode_report(data)
+        return report if isinstance(report, Event) else None
+
+    def close(self):
+        if self._device is not None:
+            usb.util.release_interface(self._device, self.INTERFACE_NUMBER)
+            usb.util.dispose_resources(self._device)
+            self._device = None
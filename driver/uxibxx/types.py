@@ -1,5 +1,6 @@
+import array
 from enum import Enum
-from typing import Literal, Union
+from typing import Dict, List, Literal, NamedTuple, Optional, Union
 
 
 class UxibxxIoBoardError(Exception):
@@ -41,6 +42,11 @@ class InvalidTerminalNo(UxibxxIoBoardError, ValueError):
 class ResponseTimeout(UxibxxIoBoardError):
     """
     A reponse line was not received within the prescribed time limit.
+
+    With firmware that supports request tags, the board stays usable after
+    a timeout: a late reply is recognized by its tag and discarded. With
+    older firmware a late reply can be mistaken for the answer to the next
+    command, so the port should be reopened.
     """
     pass
 
@@ -64,6 +70,14 @@ class Unsupported(UxibxxIoBoardError):
     pass
 
 
+class DeviceDisconnected(UxibxxIoBoardError):
+    """
+    The board dropped off the USB bus and, with auto-reconnect enabled, did
+    not come back in time (see :class:`ReconnectPolicy`).
+    """
+    pass
+
+
 class IoDirection(Enum):
     """
     Identifies whether a given terminal logically acts as an "input" or
@@ -73,7 +87,8 @@ class IoDirection(Enum):
     For UXIB-DN12, terminals 13 and 14 (broken out on the extra headers on the
     bottoom of the board) are set to high-impedance in input mode and
     push-pull in output mode. Terminals 1-12 are open-collector outputs and
-    only support output mode.
+    only support output mode. Terminals 13 and 14 can also be set to analog
+    mode.
     """
 
     #: Terminal acts as an input
@@ -82,5 +97,351 @@ class IoDirection(Enum):
     #: Terminal acts as an output
     OUTPUT = "out"
 
+    #: Terminal is sampled by the board's ADC (see
+    #: :meth:`UxibxxIoBoard.get_analog_values`). It's high-impedance, with
+    #: its digital input switched off, and comes out of analog mode with its
+    #: output off.
+    ANALOG = "analog"
+
+
+_IoDirectionOrLiteral = Union[
+    IoDirection, Literal["in", "out", "analog"]]
+
+
+class ReconnectPolicy(Enum):
+    """
+    What a call does when an auto-reconnecting :class:`UxibxxIoBoard` finds
+    the board has gone (see the ``auto_reconnect`` argument).
+    """
+
+    #: Wait up to :attr:`UxibxxIoBoard.RECONNECT_TIMEOUT_S` for the board to
+    #: come back, restore its state and send the command again
+    RETRY = "retry"
+
+    #: Reconnect only if the board is already back; otherwise raise
+    #: :exc:`DeviceDisconnected` straight away. Later calls try again, and
+    #: output and direction changes from calls that failed this way are
+    #: still applied once the board is back.
+    FAIL_FAST = "fail_fast"
+
+
+class RuleTrigger(Enum):
+    """
+    Input condition that fires an on-board rule. See
+    :meth:`UxibxxIoBoard.define_rule`.
+    """
+
+    #: Fires repeatedly (every millisecond) while the input is inactive
+    LOW = "low"
+
+    #: Fires repeatedly (every millisecond) while the input is active
+    HIGH = "high"
+
+    #: Fires once when the input becomes active
+    RISING = "rising"
+
+    #: Fires once when the input becomes inactive
+    FALLING = "falling"
+
+    #: Fires once whenever the input changes state
+    EDGE = "edge"
+
+
+class RuleAction(Enum):
+    """
+    What an on-board rule does to its outputs when it fires.
+    """
+
+    #: Activate the outputs
+    SET = "set"
+
+    #: Deactivate the outputs
+    CLEAR = "clear"
+
+    #: Activate the outputs, then deactivate them after the pulse duration.
+    #: Needs an edge trigger, since a level trigger would restart the pulse
+    #: every millisecond
+    PULSE = "pulse"
+
+
+class ArmState(Enum):
+    """
+    Progress of an armed output update (see
+    :meth:`UxibxxIoBoard.arm_outputs`).
+    """
+
+    #: Nothing armed
+    IDLE = "idle"
+
+    #: Waiting for the trigger edge
+    ARMED = "armed"
+
+    #: The armed update has been applied
+    FIRED = "fired"
+
+
+class Rule(NamedTuple):
+    """
+    Definition of an on-board input-to-output rule.
+    """
+
+    #: Terminal number of the input that triggers the rule
+    input_no: int
+
+    #: Input condition that fires the rule
+    trigger: RuleTrigger
+
+    #: What the rule does to its outputs
+    action: RuleAction
+
+    #: Terminal numbers of the outputs the rule acts on
+    outputs: List[int]
+
+    #: Pulse duration in milliseconds (only used with
+    #: :attr:`RuleAction.PULSE`)
+    pulse_ms: int
+
+    #: Whether the rule is currently being evaluated
+    enabled: bool
+
+
+class PowerOnState(NamedTuple):
+    """
+    Output states and I/O directions applied by the board immediately after
+    power-on or reset, before USB enumeration.
+    """
+
+    #: Terminal numbers of the outputs that are active at power-on
+    active_outputs: List[int]
+
+    #: Terminal numbers of the terminals that are set to output mode at
+    #: power-on. Terminals that only support one direction always use it.
+    output_terminals: List[int]
+
+
+class InrushStatus(NamedTuple):
+    """
+    Turn-on staggering settings and progress (see
+    :meth:`UxibxxIoBoard.set_inrush_limit`).
+    """
+
+    #: Minimum time between groups of turn-ons, in milliseconds; 0 if
+    #: staggering is disabled
+    spacing_ms: int
+
+    #: Maximum number of outputs switched on per group
+    max_concurrent: int
+
+    #: Terminal numbers of the outputs still waiting to be switched on
+    pending_outputs: List[int]
+
+    #: Time until the last pending output will have been switched on, in
+    #: milliseconds
+    settle_ms: int
+
+
+class StartupTiming(NamedTuple):
+    """
+    Timestamps of the board's startup milestones, in microseconds. These are
+    measured from early in the firmware's reset handling, so they don't
+    include the oscillator start-up delay.
+    """
+
+    #: When the power-on output states and directions had been applied
+    outputs_applied_us: int
+
+    #: When initialization was complete and command handling began
+    main_loop_us: int
+
+    #: When the host first configured the USB device (0 if not yet)
+    usb_configured_us: int
+
+class TimerLoad(NamedTuple):
+    """
+    Time the board spent in its timer interrupts over a measurement period
+    (see :meth:`UxibxxIoBoard.get_timer_load`).
+    """
+
+    #: Number of timer interrupts
+    wakeups: int
+
+    #: Total time spent handling them, in microseconds (4 us resolution;
+    #: interrupt entry and exit aren't included)
+    busy_us: int
+
+    #: Length of the measurement period, in microseconds
+    elapsed_us: int
+
+
+class DeviceRecord(NamedTuple):
+    """
+    A board found and identified by :meth:`UxibxxIoBoard.discover_devices`
+    """
+
+    #: Port name to pass to :meth:`UxibxxIoBoard.from_serial_portname`
+    portname: str
+
+    board_model: str
+
+    board_id: str
+
+    #: ``None`` if the firmware is too old to report its version
+    firmware_version: Optional[str]
+
+
+class SetSampleResult(NamedTuple):
+    """
+    Outcome of :meth:`UxibxxIoBoard.set_and_sample`
+    """
+
+    #: Mapping of input terminal number to its state when sampled
+    inputs: Dict[int, bool]
+
+    #: Time from applying the outputs to sampling the inputs, in
+    #: microseconds (4 us resolution)
+    elapsed_us: int
+
+
+class IdleStats(NamedTuple):
+    """
+    How much the board's CPU slept over a measurement period and how
+    quickly it gets to commands (see :meth:`UxibxxIoBoard.get_idle_stats`)
+    """
+
+    #: Number of times the CPU woke up from idle sleep
+    wakeups: int
+
+    #: Total time spent asleep, in microseconds
+    asleep_us: int
+
+    #: Length of the measurement period, in microseconds
+    elapsed_us: int
+
+    #: Longest pass through the firmware's main loop seen since reset, in
+    #: microseconds. Passes that haven't happened yet, such as one that
+    #: writes settings to EEPROM, may take longer.
+    max_pass_us: int
+
+    #: Longest time from a command reaching the board to the board starting
+    #: to handle it, going by the passes seen so far. Received bytes wake the
+    #: board straight away, so this is ``max_pass_us`` (older firmware added
+    #: one 1 ms USB frame, the wait for the start-of-frame interrupt that
+    #: collected them). It's an observed maximum, not a guarantee.
+    max_observed_latency_us: int
+
+
+class AnalogReading(NamedTuple):
+    """
+    Readings of one terminal in analog mode (see
+    :meth:`UxibxxIoBoard.get_analog_values`), as 10-bit ADC counts: 0 is
+    ground and 1023 the board's supply voltage. Both are 0 until the first
+    sample is in.
+    """
+
+    #: Most recent sample
+    latest: int
+
+    #: Mean of the most recent samples; see
+    #: :meth:`UxibxxIoBoard.configure_analog`
+    average: int
+
+
+class AnalogConfig(NamedTuple):
+    """
+    ADC sampling settings (see :meth:`UxibxxIoBoard.get_analog_config`)
+    """
+
+    #: Conversions averaged into each sample
+    oversample: int
+
+    #: Samples averaged into :attr:`AnalogReading.average`
+    average_count: int
+
+    #: Time between samples of each analog terminal, in microseconds; it
+    #: grows with the number of terminals in analog mode, which share the
+    #: ADC. 0 if there are none.
+    sample_period_us: int
+
+
+class AnalogBlock(NamedTuple):
+    """
+    Buffered samples of one analog terminal (see
+    :meth:`UxibxxIoBoard.read_analog_samples`)
+    """
+
+    #: Samples taken since the previous read, oldest first, as 10-bit ADC
+    #: counts in an ``array.array`` of type ``'H'``
+    samples: array.array
+
+    #: Number of samples that were overwritten before they could be read
+    dropped: int
+
+
+class MemoryUsage(NamedTuple):
+    """
+    RAM usage of the board's firmware (see
+    :meth:`UxibxxIoBoard.get_memory_usage`). Everything not taken by static
+    data is available to the stack.
+    """
+
+    #: Bytes of statically allocated data
+    static_bytes: int
+
+    #: Bytes between static data and the stack at the time of the query
+    free_bytes: int
+
+    #: Fewest free bytes there have been since reset (stack high-water mark)
+    min_free_bytes: int
+
+
+class InputEvent(NamedTuple):
+    """
+    A change in input state reported by the board over its vendor USB
+    interface (see :meth:`UxibxxIoBoard.enable_input_events`).
+    """
+
+    #: Board timestamp of the change, in milliseconds; wraps at 65536
+    timestamp_ms: int
+
+    #: Input state of every input terminal at the time of the change
+    inputs: Dict[int, bool]
+
+    #: Terminal numbers of the inputs that changed
+    changed: List[int]
+
+    #: ``True`` if earlier events were lost because the host wasn't reading
+    #: them fast enough
+    overrun: bool
+
+
+class ArmStatus(NamedTuple):
+    """
+    The most recently armed output update and whether it has fired yet.
+    """
+
+    state: ArmState
+
+    #: Mapping of terminal number to the output state to apply
+    outputs: Dict[int, bool]
+
+    #: Terminal number of the trigger terminal
+    trigger_no: int
+
+    #: ``True`` if the update fires on a rising edge, ``False`` for falling
+    rising: bool
+
+
+class EdgeRecord(NamedTuple):
+    """
+    One input edge timestamped by the board (see
+    :meth:`UxibxxIoBoard.read_edges`).
+    """
+
+    terminal_no: int
+
+    #: Input state after the edge
+    level: bool
 
-_IoDirectionOrLiteral = Union[IoDirection, Literal["in", "out"]]
\ No newline at end of file
+    #: Board time of the edge in microseconds, from the same clock as
+    #: :class:`StartupTiming`; wraps at 2**32
+    device_time_us: int
@@ -0,0 +1,209 @@
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/power.h>
+#include <util/atomic.h>
+
+#include "analog.h"
+#include "gpio.h"
+
+
+// Samples the terminals in analog mode with the ADC free-running at
+// F_CPU / 128, which is as slow as it goes (one conversion every
+// ANALOG_CONVERSION_US). Conversions take turns between the channels, and
+// every `oversample` conversions of a channel are averaged into one sample
+// for its ring. Readings are 10-bit against AVcc.
+//
+// In free-running mode the next conversion has already started, on
+// whatever channel was selected, by the time the interrupt for the previous
+// one comes in. So the interrupt selects the channel for the conversion
+// after next, and its result belongs to the channel selected two
+// interrupts ago.
+//
+// Each ring keeps the latest ANALOG_RING_SIZE samples for the value query,
+// and separately tracks which of them analog__readBlock() hasn't returned
+// yet. When unread samples are overwritten they're counted as dropped.
+
+typedef struct {
+	uint8_t terminalNo;
+	uint8_t adcChannel;
+	uint16_t accum;
+	uint8_t nAccum;
+	uint8_t count;
+	// ^ Samples in the ring, saturating at ANALOG_RING_SIZE
+	uint8_t head;
+	uint8_t tail;
+	// ^ Free-running; head - tail samples are unread
+	uint16_t dropped;
+	uint16_t ring[ANALOG_RING_SIZE];
+	} channel_t;
+
+static channel_t channels[BOARD_N_ANALOG];
+static uint8_t nChannels;
+static uint8_t resultIdx;
+// ^ Channel of the conversion that completes next
+static uint8_t selectedIdx;
+// ^ Channel of the one after that, already in ADMUX
+static uint8_t oversampleLog2;
+static uint8_t nAverage;
+
+
+static void selectChannel(uint8_t adcChannel) {
+	// ADC8-13 are MUX5 plus the low three MUX bits; ADTS stays 0 (free
+	// running)
+	ADMUX = _BV(REFS0) | (adcChannel & 7);
+	ADCSRB = (adcChannel & 8) ? _BV(MUX5) : 0;
+	}
+
+static void stop(void) {
+	ADCSRA = _BV(ADIF);
+	power_adc_disable();
+	}
+
+static void start(void) {
+	for(int i = 0; i < nChannels; ++i) {
+		channels[i].accum = 0;
+		channels[i].nAccum = 0;
+		}
+	resultIdx = selectedIdx = 0;
+	power_adc_enable();
+	selectChannel(channels[0].adcChannel);
+	ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIF) | _BV(ADIE)
+		| _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+	}
+
+static int findChannel(int terminalNo) {
+	for(int i = 0; i < nChannels; ++i) {
+		if(channels[i].terminalNo == terminalNo)
+			return i;
+		}
+	return -1;
+	}
+
+void analog__init(void) {
+	nChannels = 0;
+	oversampleLog2 = 2;
+	nAverage = 8;
+	stop();
+	}
+
+int analog__setTerminals(board_mask_t terminalMask) {
+	// Restarts sampling and empties every channel's ring
+	if(terminalMask & ~gpio__getAnalogCapMask())
+		return -1;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		stop();
+		nChannels = 0;
+		for(uint8_t terminalNo = 1; terminalMask;
+				++terminalNo, terminalMask >>= 1) {
+			channel_t *ch;
+			if(!(terminalMask & 1))
+				continue;
+			ch = &channels[nChannels++];
+			ch->terminalNo = terminalNo;
+			ch->adcChannel = gpio__getAdcChannel(terminalNo);
+			ch->count = ch->head = ch->tail = 0;
+			ch->dropped = 0;
+			}
+		if(nChannels)
+			start();
+		}
+	return 0;
+	}
+
+int analog__configure(uint8_t oversample, uint8_t nAverageNew) {
+	uint8_t log2 = 0;
+	if(!oversample || oversample > ANALOG_OVERSAMPLE_MAX
+			|| (oversample & (oversample - 1)))
+		return -1;
+	if(!nAverageNew || nAverageNew > ANALOG_RING_SIZE)
+		return -1;
+	while(oversample >>= 1)
+		++log2;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		oversampleLog2 = log2;
+		nAverage = nAverageNew;
+		for(int i = 0; i < nChannels; ++i) {
+			channels[i].accum = 0;
+			channels[i].nAccum = 0;
+			}
+		}
+	return 0;
+	}
+
+uint8_t analog__getOversample(void) {
+	return 1 << oversampleLog2;
+	}
+
+uint8_t analog__getAverageCount(void) {
+	return nAverage;
+	}
+
+uint32_t analog__getSamplePeriodUs(void) {
+	// Per channel; 0 with no terminals in analog mode
+	return (uint32_t)ANALOG_CONVERSION_US * nChannels << oversampleLog2;
+	}
+
+int analog__getValues(int terminalNo, analog_values_t *dest) {
+	int idx = findChannel(terminalNo);
+	uint32_t sum = 0;
+	uint8_t n;
+	if(idx < 0)
+		return -1;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		const channel_t *ch = &channels[idx];
+		uint8_t pos = ch->head;
+		dest->nSamples = ch->count;
+		dest->latest = ch->ring[(uint8_t)(pos - 1) & (ANALOG_RING_SIZE - 1)];
+		n = (ch->count < nAverage) ? ch->count : nAverage;
+		for(uint8_t i = 0; i < n; ++i)
+			sum += ch->ring[--pos & (ANALOG_RING_SIZE - 1)];
+		}
+	if(!n)
+		dest->latest = 0;
+	dest->average = n ? (sum + n / 2) / n : 0;
+	return 0;
+	}
+
+int analog__readBlock(
+		int terminalNo, uint16_t *dest, uint8_t maxSamples, uint16_t *dropped) {
+	// Takes up to maxSamples unread samples, oldest first, and the number
+	// dropped since the previous call; returns how many were taken
+	int idx = findChannel(terminalNo);
+	uint8_t n;
+	if(idx < 0)
+		return -1;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		channel_t *ch = &channels[idx];
+		n = ch->head - ch->tail;
+		if(n > maxSamples)
+			n = maxSamples;
+		for(uint8_t i = 0; i < n; ++i, ++ch->tail)
+			dest[i] = ch->ring[ch->tail & (ANALOG_RING_SIZE - 1)];
+		*dropped = ch->dropped;
+		ch->dropped = 0;
+		}
+	return n;
+	}
+
+ISR(ADC_vect) {
+	channel_t *ch = &channels[resultIdx];
+	ch->accum += ADC;
+	if(++ch->nAccum >> oversampleLog2) {
+		ch->ring[ch->head++ & (ANALOG_RING_SIZE - 1)] =
+			ch->accum >> oversampleLog2;
+		if((uint8_t)(ch->head - ch->tail) > ANALOG_RING_SIZE) {
+			++ch->tail;
+			if(ch->dropped != UINT16_MAX)
+				++ch->dropped;
+			}
+		if(ch->count < ANALOG_RING_SIZE)
+			++ch->count;
+		ch->accum = 0;
+		ch->nAccum = 0;
+		}
+	resultIdx = selectedIdx;
+	if(++selectedIdx >= nChannels)
+		selectedIdx = 0;
+	selectChannel(channels[selectedIdx].adcChannel);
+	}
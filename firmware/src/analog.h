@@ -0,0 +1,35 @@
+#pragma once
+
+
+#include <stdint.h>
+
+#include "board.h"
+
+
+#define ANALOG_RING_SIZE 32
+// ^ Samples kept per channel; must be a power of two no bigger than 128
+#define ANALOG_OVERSAMPLE_MAX 64
+// ^ 64 10-bit conversions still fit the 16-bit accumulator
+#define ANALOG_CONVERSION_US 104
+// ^ 13 ADC clocks at F_CPU / 128
+
+
+typedef struct {
+	uint16_t latest;
+	uint16_t average;
+	// ^ Of the last analog__getAverageCount() samples, or as many as there
+	// are so far
+	uint8_t nSamples;
+	// ^ Samples in the ring; 0 until the first one is in
+	} analog_values_t;
+
+
+void analog__init(void);
+int analog__setTerminals(board_mask_t terminalMask);
+int analog__configure(uint8_t oversample, uint8_t nAverage);
+uint8_t analog__getOversample(void);
+uint8_t analog__getAverageCount(void);
+uint32_t analog__getSamplePeriodUs(void);
+int analog__getValues(int terminalNo, analog_values_t *dest);
+int analog__readBlock(
+	int terminalNo, uint16_t *dest, uint8_t maxSamples, uint16_t *dropped);
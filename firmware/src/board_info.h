@@ -1,5 +1,6 @@
 #pragma once
 
 
-#define BOARD_MODEL_STR "UXIB-DN12"
-#define DEFAULT_SERIALNO_STR "INITME"
\ No newline at end of file
+// Board model, USB identity and power-on defaults are generated from the
+// board description (boards/<board>.json) by tools/gen_board.py
+#include "board.h"
@@ -10,10 +10,10 @@
 #define LEFTARGS_START_CH ':'
 #define SET_OP_CH '='
 #define QUERY_OP_CH '?'
+#define TAG_START_CH '#'
 #define IGNORE_CHARS "\n\t "
 
-#define INPUT_BUF_SIZE 33
-#define ARG_BUF_SIZE 17
+#define INPUT_BUF_SIZE (CMDPROC_LINE_MAX_LEN + 1)
 
 
 static uint8_t inputNBytes;
@@ -47,33 +47,70 @@ int cmdproc__hasCommandWaiting(void) {
 	return flags.commandReady;
 	}
 
-int parseArgVal(
-		cmdproc_argval_t *dest, const char *buf, cmdproc_argtype_t argType) {
+static uint8_t argSize(const cmdproc_command_t *command, uint8_t argIdx) {
+	switch(command->argTypes[argIdx]) {
+		case ARGTYPE_UINT8:
+			return 1;
+		case ARGTYPE_UINT16:
+			return 2;
+		case ARGTYPE_UINT32:
+			return 4;
+		case ARGTYPE_STRING:
+			return strlen((char *)&command->argData[command->argOffs[argIdx]])
+				+ 1;
+		default:
+			return 0;
+		}
+	}
+
+static int storeArgVal(
+		cmdproc_command_t *dest, const char *buf, cmdproc_argtype_t argType) {
+	// Appends the value after the args already stored in dest
+	uint8_t argIdx = dest->nLeftArgs + dest->nRightArgs;
+	uint8_t offs = argIdx
+		? dest->argOffs[argIdx - 1] + argSize(dest, argIdx - 1) : 0;
 	int scanfResult;
-	unsigned int uintVal;
+	unsigned long uintVal;
+	uint8_t len;
+	if(argIdx >= CMDPROC_MAX_N_ARGS)
+		return -1;
+	dest->argTypes[argIdx] = argType;
+	dest->argOffs[argIdx] = offs;
 	switch(argType) {
 		case ARGTYPE_UINT8:
 		case ARGTYPE_UINT16:
-			scanfResult = sscanf((char *)buf, "%u", &uintVal);
+		case ARGTYPE_UINT32:
+			scanfResult = sscanf((char *)buf, "%lu", &uintVal);
 			if(scanfResult != 1)
 				return -1;
 				// TODO maybe have distinct error values for different problems	
 			break;
 		case ARGTYPE_STRING:
-			strncpy(dest->stringVal, buf, CMDPROC_ARG_MAX_LEN);
-			dest->stringVal[CMDPROC_ARG_MAX_LEN] = 0;
+			len = strlen(buf);
+			if(offs + len + 1 > CMDPROC_ARG_DATA_LEN)
+				return -1;
+			memcpy(&dest->argData[offs], buf, len + 1);
 			return 0;
 		default:
 			return -1;		
 		}
 	switch(argType) {
 		case ARGTYPE_UINT8:
-			if(uintVal > 255)
+			if(uintVal > 255 || offs + 1 > CMDPROC_ARG_DATA_LEN)
 				return -1;
-			dest->uint8Val = (uint8_t) uintVal;
+			dest->argData[offs] = (uint8_t) uintVal;
 			return 0;
 		case ARGTYPE_UINT16:
-			dest->uint16Val = (uint16_t) uintVal;
+			if(uintVal > 0xFFFF || offs + 2 > CMDPROC_ARG_DATA_LEN)
+				return -1;
+			dest->argData[offs] = uintVal & 0xFF;
+			dest->argData[offs + 1] = uintVal >> 8;
+			return 0;
+		case ARGTYPE_UINT32:
+			if(offs + 4 > CMDPROC_ARG_DATA_LEN)
+				return -1;
+			for(int i = 0; i < 4; ++i)
+				dest->argData[offs + i] = uintVal >> (8 * i);
 			return 0;
 		default:
 			break;
@@ -99,77 +136,104 @@ int getCommandSpec(
 	return -1;
 	}
 
-cmdproc_error_t parseArgs(char *str, cmdproc_argval_t *destArgs,
-	                      const cmdproc_argtype_t *argTypes, int nArgs) {
-	char argBuf[CMDPROC_ARG_MAX_LEN + 1] = {[CMDPROC_ARG_MAX_LEN] = 0};
-	int argIdx = 0;
+cmdproc_error_t parseArgs(
+		char *str, cmdproc_command_t *dest, uint8_t *nArgsParsed,
+		const cmdproc_argtype_t *argTypes, uint8_t nArgTypes, int variadic) {
+	// Splits str in place. With variadic set, the last type in argTypes
+	// repeats for any further args.
+	uint8_t argIdx = 0;
 	char *argStart = str;
-	char *nextArgStart = str;
 	char *argEnd;
 	while(*argStart) {
-		if(argIdx >= nArgs)
+		if(argIdx >= nArgTypes && !variadic)
+			return ERROR_N_ARGS;
+		if(dest->nLeftArgs + dest->nRightArgs >= CMDPROC_MAX_N_ARGS)
 			return ERROR_N_ARGS;
-		if((argEnd = strchr(argStart, ARG_DELIMITER))) {
+		if((argEnd = strchr(argStart, ARG_DELIMITER)))
 			*argEnd = 0;
-			nextArgStart = argEnd + 1;
-			}
-		else {
-			nextArgStart = NULL;
-			}
 		if(strlen(argStart) > CMDPROC_ARG_MAX_LEN)
 			return ERROR_ARG_FMT;
-		strncpy(argBuf, argStart, CMDPROC_ARG_MAX_LEN);
-		// TODO we don't actually need to do that copy,
-		// could enforce length in parseArgVal()
-		if(parseArgVal(&destArgs[argIdx], argBuf, argTypes[argIdx]))
+		if(storeArgVal(
+				dest,
+				argStart,
+				argTypes[(argIdx < nArgTypes) ? argIdx : nArgTypes - 1]
+				))
 			return ERROR_ARG_FMT;
 		argIdx++;
-		if(!nextArgStart)
+		*nArgsParsed += 1;
+		if(!argEnd)
 			break;
-		argStart = nextArgStart;
+		argStart = argEnd + 1;
 		}
-	if(argIdx != nArgs)
+	if(variadic ? (argIdx < nArgTypes) : (argIdx != nArgTypes))
 		return ERROR_N_ARGS;
 	return 0;
 	}
 
+static int16_t parseTag(char **line) {
+	// Consumes a leading #nn tag, returning its value, CMDPROC_NO_TAG if
+	// there isn't one or -2 if it's malformed
+	int16_t tag = 0;
+	uint8_t nDigits = 0;
+	if(**line != TAG_START_CH)
+		return CMDPROC_NO_TAG;
+	for(++*line; **line >= '0' && **line <= '9'; ++*line) {
+		tag = tag * 10 + (**line - '0');
+		if(++nDigits > 3)
+			return -2;
+		}
+	if(!nDigits || tag > 255)
+		return -2;
+	return tag;
+	}
+
 cmdproc_error_t cmdproc__getCommand(cmdproc_command_t *dest) {
+	// The line is split up in place; inputBuffer is free again afterwards
 	int error = 0;
-	char leftBuf[INPUT_BUF_SIZE] = {0};
-	char rightBuf[INPUT_BUF_SIZE] = {0};
+	char *line = (char *)inputBuffer;
+	char *lineEnd = line + inputNBytes;
 	char *leftEnd;
 	char *mnemEnd;
+	char *rightStr = "";
 	cmdproc_cmd_spec_t cmdSpec;
 	int haveLeftArgs = 0;
 
-
-	if((leftEnd = strchr((char *)inputBuffer, QUERY_OP_CH))) {
+	dest->nLeftArgs = 0;
+	dest->nRightArgs = 0;
+	dest->tag = parseTag(&line);
+	if(dest->tag < CMDPROC_NO_TAG) {
+		dest->tag = CMDPROC_NO_TAG;
+		dest->parseError = ERROR_CMD;
+		inputNBytes = 0;
+		flags.commandReady = 0;
+		return ERROR_CMD;
+		}
+	if((leftEnd = strchr(line, QUERY_OP_CH))) {
 		dest->cmdType = CMDTYPE_QUERY;
 		}
-	else if((leftEnd = strchr((char *)inputBuffer, SET_OP_CH))) {
+	else if((leftEnd = strchr(line, SET_OP_CH))) {
 		dest->cmdType = CMDTYPE_SET;
 		}
 	else {
 		dest->cmdType = CMDTYPE_DO;
-		leftEnd = (char *)&inputBuffer[inputNBytes];
+		leftEnd = lineEnd;
 		}
+	if(leftEnd < lineEnd)
+		rightStr = leftEnd + 1;
 	*leftEnd = 0;
 
-	strcpy(leftBuf, (char *)inputBuffer);
-	if(leftEnd < (char *)&inputBuffer[inputNBytes]) {
-		strcpy(rightBuf, leftEnd + 1);
-		}
-	if((mnemEnd = strchr(leftBuf, LEFTARGS_START_CH))) {
+	if((mnemEnd = strchr(line, LEFTARGS_START_CH))) {
 		haveLeftArgs = 1;
 		}
 	else {
-		mnemEnd = &leftBuf[strlen(leftBuf)];
+		mnemEnd = &line[strlen(line)];
 		}
 	*mnemEnd = 0;
-	if(strlen(leftBuf) > CMDPROC_MNEM_MAX_LEN)
+	if(strlen(line) > CMDPROC_MNEM_MAX_LEN)
 		error = ERROR_CMD;
 	else {
-		strncpy(dest->mnem, leftBuf, CMDPROC_MNEM_MAX_LEN);
+		strncpy(dest->mnem, line, CMDPROC_MNEM_MAX_LEN);
+		dest->mnem[CMDPROC_MNEM_MAX_LEN] = 0;
 		if(getCommandSpec(&cmdSpec, dest->mnem, dest->cmdType) < 0)
 			error = ERROR_CMD;
 		}
@@ -178,9 +242,11 @@ cmdproc_error_t cmdproc__getCommand(cmdproc_command_t *dest) {
 		if(haveLeftArgs) {
 			error = parseArgs(
 				mnemEnd + 1,
-				dest->leftArgs,
+				dest,
+				&dest->nLeftArgs,
 				cmdSpec.leftArgTypes,
-				cmdSpec.nLeftArgs
+				cmdSpec.nLeftArgs,
+				cmdSpec.flags & CMDFLAG_LEFT_VARIADIC
 				);
 			}
 		else if(cmdSpec.nLeftArgs)
@@ -188,12 +254,14 @@ cmdproc_error_t cmdproc__getCommand(cmdproc_command_t *dest) {
 		}
 
 	if(!error) {
-		if(strlen(rightBuf)){
+		if(strlen(rightStr)){
 			error = parseArgs(
-				rightBuf,
-				dest->rightArgs,
+				rightStr,
+				dest,
+				&dest->nRightArgs,
 				cmdSpec.rightArgTypes,
-				cmdSpec.nRightArgs
+				cmdSpec.nRightArgs,
+				cmdSpec.flags & CMDFLAG_RIGHT_VARIADIC
 				);
 			}
 		else if(cmdSpec.nRightArgs)
@@ -205,3 +273,35 @@ cmdproc_error_t cmdproc__getCommand(cmdproc_command_t *dest) {
 	flags.commandReady = 0;
 	return error;
 	}
+
+static uint32_t getUint(const cmdproc_command_t *command, uint8_t argIdx) {
+	const uint8_t *val = &command->argData[command->argOffs[argIdx]];
+	switch(command->argTypes[argIdx]) {
+		case ARGTYPE_UINT8:
+			return val[0];
+		case ARGTYPE_UINT16:
+			return val[0] | ((uint16_t)val[1] << 8);
+		case ARGTYPE_UINT32:
+			return val[0] | ((uint32_t)val[1] << 8)
+				| ((uint32_t)val[2] << 16) | ((uint32_t)val[3] << 24);
+		default:
+			return 0;
+		}
+	}
+
+uint16_t cmdproc__leftUint(const cmdproc_command_t *command, uint8_t argIdx) {
+	return getUint(command, argIdx);
+	}
+
+uint32_t cmdproc__rightUint(
+		const cmdproc_command_t *command, uint8_t argIdx) {
+	return getUint(command, command->nLeftArgs + argIdx);
+	}
+
+const char *cmdproc__rightString(
+		const cmdproc_command_t *command, uint8_t argIdx) {
+	argIdx += command->nLeftArgs;
+	if(command->argTypes[argIdx] != ARGTYPE_STRING)
+		return "";
+	return (char *)&command->argData[command->argOffs[argIdx]];
+	}
@@ -6,10 +6,16 @@
 #include <avr/pgmspace.h>
 
 
-#define CMDPROC_MNEM_MAX_LEN 16
+#define CMDPROC_LINE_MAX_LEN 64
+#define CMDPROC_MNEM_MAX_LEN 3
 #define CMDPROC_ARG_MAX_LEN 16
+#define CMDPROC_MAX_N_ARGS 24
+// ^ Left and right combined
+#define CMDPROC_ARG_DATA_LEN CMDPROC_LINE_MAX_LEN
+// Lengths of the arg type lists in a command spec
 #define CMDPROC_MAX_N_LEFTARGS 1
-#define CMDPROC_MAX_N_RIGHTARGS 1
+#define CMDPROC_MAX_N_RIGHTARGS 5
+#define CMDPROC_NO_TAG -1
 
 typedef enum {
 	ERROR_CMD = 1,
@@ -28,33 +34,40 @@ typedef enum {
 	ARGTYPE_STRING,
 	ARGTYPE_UINT8,
 	ARGTYPE_UINT16,
+	ARGTYPE_UINT32,
 	ARGTYPE_INT8,
 	ARGTYPE_INT16,
 	} cmdproc_argtype_t;
 
-typedef union {
-	uint8_t uint8Val;
-	uint16_t uint16Val;
-	int8_t int8Val;
-	int16_t int16Val;
-	uint8_t stringVal[CMDPROC_ARG_MAX_LEN + 1];
-	} cmdproc_argval_t;
+typedef enum {
+	CMDFLAG_LEFT_VARIADIC = 1,
+	CMDFLAG_RIGHT_VARIADIC = 2,
+	// ^ The last listed arg type repeats, as many times as fit on a line
+	} cmdproc_cmdflags_t;
 
 typedef struct {
 	cmdproc_cmdtype_t cmdType;
 	char mnem[CMDPROC_MNEM_MAX_LEN + 1];
-	int nLeftArgs;
-	int nRightArgs;
-	cmdproc_argval_t leftArgs[CMDPROC_MAX_N_LEFTARGS];
-	cmdproc_argval_t rightArgs[CMDPROC_MAX_N_RIGHTARGS];
+	uint8_t nLeftArgs;
+	uint8_t nRightArgs;
+	// Arg values are packed back to back in argData, left args first, each
+	// taking only as many bytes as its type needs (strings are
+	// NUL-terminated). Use the accessor functions below to get at them.
+	cmdproc_argtype_t argTypes[CMDPROC_MAX_N_ARGS];
+	uint8_t argOffs[CMDPROC_MAX_N_ARGS];
+	uint8_t argData[CMDPROC_ARG_DATA_LEN];
 	cmdproc_error_t parseError;
+	int16_t tag;
+	// ^ From an optional #nn prefix (0-255) to be echoed in the reply, or
+	// CMDPROC_NO_TAG
 	} cmdproc_command_t;
 
 typedef struct {
 	cmdproc_cmdtype_t cmdType;
 	char mnem[CMDPROC_MNEM_MAX_LEN + 1];
-	int nLeftArgs;
-	int nRightArgs;
+	uint8_t flags;
+	uint8_t nLeftArgs;
+	uint8_t nRightArgs;
 	cmdproc_argtype_t leftArgTypes[CMDPROC_MAX_N_LEFTARGS];
 	cmdproc_argtype_t rightArgTypes[CMDPROC_MAX_N_RIGHTARGS];
 	} cmdproc_cmd_spec_t;
@@ -68,3 +81,8 @@ void cmdproc__init(void);
 void cmdproc__processIncomingChar(uint8_t ch);
 int cmdproc__hasCommandWaiting(void);
 cmdproc_error_t cmdproc__getCommand(cmdproc_command_t *dest);
+uint16_t cmdproc__leftUint(const cmdproc_command_t *command, uint8_t argIdx);
+uint32_t cmdproc__rightUint(const cmdproc_command_t *command, uint8_t argIdx);
+// ^ Wide enough for terminal bitmasks, which are 32 bits on some boards
+const char *cmdproc__rightString(
+	const cmdproc_command_t *command, uint8_t argIdx);
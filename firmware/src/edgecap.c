@@ -0,0 +1,100 @@
+#include <stdint.h>
+#include <util/atomic.h>
+
+#include "edgecap.h"
+#include "gpio.h"
+#include "mstick.h"
+
+
+// Records every edge on the selected inputs with a mstick__getMicros()
+// timestamp (4 us resolution, wraps after about 71 minutes). Inputs with a
+// pin change interrupt are timestamped on entry to the interrupt; the rest
+// are polled every ms, so their timestamps are only good to 1 ms and
+// pulses shorter than that can be missed.
+//
+// Records are produced in interrupt context (the pin change and timer
+// interrupts don't nest) and consumed from the main loop. When the ring is
+// full new edges are dropped and counted.
+
+static edgecap_record_t ring[EDGECAP_RING_SIZE];
+static volatile uint8_t ringHead, ringTail;
+static volatile uint16_t overflowCount;
+static board_mask_t captureMask;
+static board_mask_t irqMask;
+static board_mask_t prevLevels;
+
+
+static void record(board_mask_t levels, board_mask_t mask, uint32_t timeUs) {
+	board_mask_t changed = (levels ^ prevLevels) & mask;
+	prevLevels = (prevLevels & ~mask) | (levels & mask);
+	for(uint8_t terminalNo = 1; changed; ++terminalNo, changed >>= 1) {
+		uint8_t next;
+		if(!(changed & 1))
+			continue;
+		next = (ringHead + 1) % EDGECAP_RING_SIZE;
+		if(next == ringTail) {
+			++overflowCount;
+			continue;
+			}
+		ring[ringHead].timeUs = timeUs;
+		ring[ringHead].terminalNo = terminalNo;
+		ring[ringHead].level = !!(levels & GPIO_TERMINAL_BM(terminalNo));
+		ringHead = next;
+		}
+	}
+
+void edgecap__init(void) {
+	ringHead = ringTail = 0;
+	overflowCount = 0;
+	captureMask = irqMask = 0;
+	}
+
+int edgecap__setMask(board_mask_t terminalMask) {
+	board_mask_t covered;
+	if(terminalMask & ~gpio__getInputCapMask())
+		return -1;
+	covered = gpio__setChangeIrqMask(GPIO_IRQ_EDGECAP, terminalMask);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		captureMask = terminalMask;
+		irqMask = covered;
+		prevLevels = gpio__readInputs();
+		}
+	mstick__setPolling(MSTICK_POLL_EDGECAP, !!(terminalMask & ~covered));
+	return 0;
+	}
+
+board_mask_t edgecap__getMask(void) {
+	return captureMask;
+	}
+
+int edgecap__pop(edgecap_record_t *dest) {
+	if(ringTail == ringHead)
+		return -1;
+	*dest = ring[ringTail];
+	ringTail = (ringTail + 1) % EDGECAP_RING_SIZE;
+	return 0;
+	}
+
+uint16_t edgecap__takeOverflowCount(void) {
+	uint16_t count;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		count = overflowCount;
+		overflowCount = 0;
+		}
+	return count;
+	}
+
+void edgecap__onInputChange(void) {
+	uint32_t timeUs;
+	if(!irqMask)
+		return;
+	timeUs = mstick__getMicros();
+	record(gpio__readInputs(), irqMask, timeUs);
+	}
+
+void edgecap__onPoll(void) {
+	board_mask_t polledMask = captureMask & ~irqMask;
+	if(!polledMask)
+		return;
+	record(gpio__readInputs(), polledMask, mstick__getMicros());
+	}
@@ -0,0 +1,25 @@
+#pragma once
+
+
+#include <stdint.h>
+
+#include "board.h"
+
+
+#define EDGECAP_RING_SIZE 32
+
+
+typedef struct {
+	uint32_t timeUs;
+	uint8_t terminalNo;
+	uint8_t level;
+	} edgecap_record_t;
+
+
+void edgecap__init(void);
+int edgecap__setMask(board_mask_t terminalMask);
+board_mask_t edgecap__getMask(void);
+int edgecap__pop(edgecap_record_t *dest);
+uint16_t edgecap__takeOverflowCount(void);
+void edgecap__onInputChange(void);
+void edgecap__onPoll(void);
@@ -1,5 +1,8 @@
 #include <stddef.h>
+#include <string.h>
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <util/atomic.h>
 
 #include "gpio.h"
@@ -10,38 +13,34 @@ typedef struct {
 	volatile uint8_t *dirReg;
 	volatile uint8_t *inputReg;
 	volatile uint8_t *outputReg;
-	int ioBit;
-	int initialDir;
-	int initialOutput;
+	uint8_t ioBit;
+	uint8_t adcChannel;
 	} gpio_terminal_def_t;
 
-static const gpio_terminal_def_t gpioTerminalDefs[] = {
-	{1,  &DDRB, NULL,  &PORTB, PB6, DIR_OUT, 0},
-	{2,  &DDRB, NULL,  &PORTB, PB2, DIR_OUT, 0},
-	{3,  &DDRB, NULL,  &PORTB, PB3, DIR_OUT, 0},
-	{4,  &DDRB, NULL,  &PORTB, PB1, DIR_OUT, 0},
-	{5,  &DDRF, NULL,  &PORTF, PF7, DIR_OUT, 0},
-	{6,  &DDRF, NULL,  &PORTF, PF6, DIR_OUT, 0},
-	{7,  &DDRB, NULL,  &PORTB, PB4, DIR_OUT, 0},
-	{8,  &DDRE, NULL,  &PORTE, PE6, DIR_OUT, 0},
-	{9,  &DDRC, NULL,  &PORTC, PC6, DIR_OUT, 0},
-	{10, &DDRD, NULL,  &PORTD, PD4, DIR_OUT, 0},
-	{11, &DDRF, NULL,  &PORTF, PF4, DIR_OUT, 0},
-	{12, &DDRF, NULL,  &PORTF, PF5, DIR_OUT, 0},
-	{13, &DDRD, &PIND, &PORTD, PD7, DIR_IN,  0},
-	{14, &DDRB, &PINB, &PORTB, PB5, DIR_IN,  0},
-	};
-
-const int gpio__nTerminals =
-	sizeof(gpioTerminalDefs) / sizeof(gpio_terminal_def_t);
-
-
-const gpio_terminal_def_t *getTerminal(int terminalNo) {
-	for(int i = 0; i < gpio__nTerminals; ++i) {
-		if(gpioTerminalDefs[i].terminalNo == terminalNo)
-			return &gpioTerminalDefs[i];
-		}
-	return NULL;
+// Terminal tables are generated from the board description; see
+// tools/gen_board.py
+#include "board_gpio.h"
+
+const int gpio__nTerminals = BOARD_N_TERMINALS;
+
+static board_mask_t changeIrqMasks[GPIO_N_IRQ_USERS];
+static board_mask_t analogMask;
+// ^ Terminals in DIR_ANALOG; the DDR bit alone can't tell them from inputs
+
+
+static void loadTerminal(gpio_terminal_def_t *dest, uint8_t terminalIdx) {
+	memcpy_P(dest, &gpioTerminalDefs[terminalIdx], sizeof(*dest));
+	}
+
+static int getTerminal(gpio_terminal_def_t *dest, int terminalNo) {
+	uint8_t idx;
+	if(terminalNo < 1 || terminalNo > BOARD_TERMINAL_NO_MAX)
+		return -1;
+	idx = pgm_read_byte(&gpioTerminalIdxs[terminalNo]);
+	if(idx == GPIO_NO_TERMINAL)
+		return -1;
+	loadTerminal(dest, idx);
+	return 0;
 	}
 
 inline int readIoRegBitIndirect(const volatile uint8_t *reg, int bitNo) {
@@ -74,66 +73,229 @@ inline int getInput(const gpio_terminal_def_t *terminal) {
 	return readIoRegBitIndirect(terminal->inputReg, terminal->ioBit);
 	}
 
-void gpio__init(void) {
-	for(int i = 0; i < gpio__nTerminals; ++i) {
-		const gpio_terminal_def_t *term = &gpioTerminalDefs[i];
-		if(term->dirReg)
+static void setDigitalInputDisabled(uint8_t adcChannel, int disabled) {
+	// DIDR0 covers ADC0-7 and DIDR2 ADC8-13
+	setIoRegBitIndirect(
+		(adcChannel < 8) ? &DIDR0 : &DIDR2, adcChannel & 7, disabled);
+	}
+
+void gpio__init(board_mask_t outputMask, board_mask_t dirMask) {
+	// Output latches are written before the direction so that a terminal
+	// never drives its previous (reset) level on the way to the new one
+	analogMask = 0;
+	for(int i = 0; i < BOARD_N_TERMINALS; ++i) {
+		gpio_terminal_def_t term;
+		loadTerminal(&term, i);
+		board_mask_t bm = GPIO_TERMINAL_BM(term.terminalNo);
+		int dirOut = (dirMask & bm) ? !!term.outputReg : !term.inputReg;
+		if(term.outputReg)
 			setIoRegBitIndirect(
-				term->dirReg, term->ioBit, term->initialDir == DIR_OUT);
-		if(term->outputReg)
-			setIoRegBitIndirect(term->outputReg, term->ioBit, term->initialOutput);
+				term.outputReg, term.ioBit, !!(outputMask & bm));
+		if(term.dirReg)
+			setIoRegBitIndirect(term.dirReg, term.ioBit, dirOut);
 		}
 	}
 
 int gpio__getInput(int terminalNo) {
-	const gpio_terminal_def_t *terminal = getTerminal(terminalNo);
-	if(!terminal)
+	gpio_terminal_def_t terminal;
+	if(getTerminal(&terminal, terminalNo))
 		return -1;
-	if(!terminal->inputReg)
+	if(!terminal.inputReg)
 		return -1;
-	return getInput(terminal);
+	return getInput(&terminal);
 	}
 
 int gpio__supportsOutput(int terminalNo) {
-	const gpio_terminal_def_t *terminal = getTerminal(terminalNo);
-	if(!terminal)
+	gpio_terminal_def_t terminal;
+	if(getTerminal(&terminal, terminalNo))
 		return -1;
-	return !!terminal->outputReg;
+	return !!terminal.outputReg;
 	}
 
 int gpio__supportsInput(int terminalNo) {
-	const gpio_terminal_def_t *terminal = getTerminal(terminalNo);
-	if(!terminal)
+	gpio_terminal_def_t terminal;
+	if(getTerminal(&terminal, terminalNo))
 		return -1;
-	return !!terminal->inputReg;
+	return !!terminal.inputReg;
+	}
+
+int gpio__supportsAnalog(int terminalNo) {
+	gpio_terminal_def_t terminal;
+	if(getTerminal(&terminal, terminalNo))
+		return -1;
+	return terminal.adcChannel != GPIO_NO_ADC_CHANNEL;
+	}
+
+int gpio__getAdcChannel(int terminalNo) {
+	gpio_terminal_def_t terminal;
+	if(getTerminal(&terminal, terminalNo))
+		return -1;
+	if(terminal.adcChannel == GPIO_NO_ADC_CHANNEL)
+		return -1;
+	return terminal.adcChannel;
 	}
 
 int gpio__getTerminalNo(int terminalIdx) {
-	if(terminalIdx >= gpio__nTerminals)
+	if(terminalIdx < 0 || terminalIdx >= BOARD_N_TERMINALS)
 		return -1;
-	return gpioTerminalDefs[terminalIdx].terminalNo;
+	return pgm_read_byte(&gpioTerminalDefs[terminalIdx].terminalNo);
 	}
 
 int gpio__getOutput(int terminalNo) {
-	const gpio_terminal_def_t *terminal = getTerminal(terminalNo);
-	if(!terminal)
+	gpio_terminal_def_t terminal;
+	if(getTerminal(&terminal, terminalNo))
 		return -1;
-	if(!terminal->outputReg)
+	if(!terminal.outputReg)
 		return -1;
-	return getOutput(terminal);
+	return getOutput(&terminal);
 	}
 
 int gpio__setOutput(int terminalNo, int on) {
 	//TODO: have different error codes for invalid terminal number, unsupported operation/mode, etc.
-	const gpio_terminal_def_t *terminal = getTerminal(terminalNo);
-	if(!terminal)
+	gpio_terminal_def_t terminal;
+	if(getTerminal(&terminal, terminalNo))
+		return -1;
+	if(!terminal.outputReg)
+		return -1;
+	setIoRegBitIndirect(terminal.outputReg, terminal.ioBit, on);
+	return 0;
+	}
+
+board_mask_t gpio__getOutputCapMask(void) {
+	return BOARD_OUTPUT_CAP_MASK;
+	}
+
+board_mask_t gpio__getInputCapMask(void) {
+	return BOARD_INPUT_CAP_MASK;
+	}
+
+board_mask_t gpio__getAnalogCapMask(void) {
+	return BOARD_ANALOG_CAP_MASK;
+	}
+
+board_mask_t gpio__getAnalogMask(void) {
+	return analogMask;
+	}
+
+int gpio__getPortMasks(gpio_port_masks_t *dest, board_mask_t terminalMask) {
+	memset(dest, 0, sizeof(gpio_port_masks_t));
+	if(terminalMask & ~(board_mask_t)BOARD_OUTPUT_CAP_MASK)
+		return -1;
+	for(int terminalNo = 1; terminalMask; ++terminalNo, terminalMask >>= 1) {
+		if(terminalMask & 1)
+			dest->bm[pgm_read_byte(&gpioOutputBits[terminalNo][0])] |=
+				pgm_read_byte(&gpioOutputBits[terminalNo][1]);
+		}
+	return 0;
+	}
+
+void gpio__writePortMasks(
+		const gpio_port_masks_t *mask, const gpio_port_masks_t *values) {
+	// One read-modify-write per port with interrupts off, so every affected
+	// terminal switches within a few cycles of the others
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		for(int i = 0; i < GPIO_N_PORTS; ++i) {
+			if(mask->bm[i])
+				*gpioOutputPorts[i] =
+					(*gpioOutputPorts[i] & ~mask->bm[i]) | values->bm[i];
+			}
+		}
+	}
+
+void gpio__setPortMasks(const gpio_port_masks_t *mask) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		for(int i = 0; i < GPIO_N_PORTS; ++i)
+			*gpioOutputPorts[i] |= mask->bm[i];
+		}
+	}
+
+void gpio__clearPortMasks(const gpio_port_masks_t *mask) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		for(int i = 0; i < GPIO_N_PORTS; ++i)
+			*gpioOutputPorts[i] &= ~mask->bm[i];
+		}
+	}
+
+int gpio__applyOutputs(board_mask_t mask, board_mask_t values) {
+	gpio_port_masks_t portMasks, portValues;
+	if(gpio__getPortMasks(&portMasks, mask))
 		return -1;
-	if(!terminal->outputReg)
+	gpio__getPortMasks(&portValues, values & mask);
+	gpio__writePortMasks(&portMasks, &portValues);
+	return 0;
+	}
+
+board_mask_t gpio__readInputs(void) {
+	board_mask_t levels = 0;
+	for(int i = 0; i < BOARD_N_INPUTS; ++i) {
+		gpio_terminal_def_t term;
+		loadTerminal(&term, pgm_read_byte(&gpioInputTerminalIdxs[i]));
+		if(getInput(&term))
+			levels |= GPIO_TERMINAL_BM(term.terminalNo);
+		}
+	return levels;
+	}
+
+board_mask_t gpio__readOutputs(void) {
+	board_mask_t levels = 0;
+	for(int i = 0; i < BOARD_N_TERMINALS; ++i) {
+		gpio_terminal_def_t term;
+		loadTerminal(&term, i);
+		if(term.outputReg && getOutput(&term))
+			levels |= GPIO_TERMINAL_BM(term.terminalNo);
+		}
+	return levels;
+	}
+
+int gpio__getInputRef(
+		int terminalNo, const volatile uint8_t **reg, uint8_t *bm) {
+	// For code that has to read one input from interrupt context as quickly
+	// as possible
+	gpio_terminal_def_t terminal;
+	if(getTerminal(&terminal, terminalNo))
+		return -1;
+	if(!terminal.inputReg)
 		return -1;
-	setIoRegBitIndirect(terminal->outputReg, terminal->ioBit, on);
+	*reg = terminal.inputReg;
+	*bm = _BV(terminal.ioBit);
 	return 0;
 	}
 
+board_mask_t gpio__setChangeIrqMask(
+		gpio_irq_user_t user, board_mask_t terminalMask) {
+	// Only port B has pin change interrupts on the 32u4; returns the subset of
+	// terminalMask that could be covered, the rest have to be polled. The
+	// interrupt covers the union of every user's mask.
+	uint8_t pcmsk = 0;
+	board_mask_t covered = 0;
+	board_mask_t allMask = 0;
+	changeIrqMasks[user] = terminalMask;
+	for(int i = 0; i < GPIO_N_IRQ_USERS; ++i)
+		allMask |= changeIrqMasks[i];
+	for(int i = 0; i < BOARD_N_TERMINALS; ++i) {
+		gpio_terminal_def_t term;
+		loadTerminal(&term, i);
+		board_mask_t bm = GPIO_TERMINAL_BM(term.terminalNo);
+		if((allMask & bm) && term.inputReg == &PINB) {
+			pcmsk |= _BV(term.ioBit);
+			if(terminalMask & bm)
+				covered |= bm;
+			}
+		}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		PCMSK0 = pcmsk;
+		if(pcmsk)
+			PCICR |= _BV(PCIE0);
+		else
+			PCICR &= ~_BV(PCIE0);
+		}
+	return covered;
+	}
+
+ISR(PCINT0_vect) {
+	gpio__inputChangeEvent();
+	}
+
 int gpio__toggleOutput(int terminalNo) {
 	int prev = gpio__getOutput(terminalNo);
 	if(prev < 0)
@@ -142,24 +304,42 @@ int gpio__toggleOutput(int terminalNo) {
 	}
 
 int gpio__setDirection(int terminalNo, enum gpio_terminal_dir dir) {
-	const gpio_terminal_def_t *terminal = getTerminal(terminalNo);
-	if(!terminal)
+	gpio_terminal_def_t terminal;
+	if(getTerminal(&terminal, terminalNo))
 		return -1;
-	if(!terminal->dirReg)
+	if(!terminal.dirReg)
 		return -1;
-	if((dir == DIR_OUT) && !terminal->outputReg)
+	if((dir == DIR_OUT) && !terminal.outputReg)
 		return -1;
-	if((dir == DIR_IN) && !terminal->inputReg)
+	if((dir == DIR_IN) && !terminal.inputReg)
 		return -1;
-	setIoRegBitIndirect(terminal->dirReg, terminal->ioBit, dir);
+	if((dir == DIR_ANALOG) && terminal.adcChannel == GPIO_NO_ADC_CHANNEL)
+		return -1;
+	if(dir == DIR_ANALOG) {
+		// The output latch doubles as the pull-up, which would skew the
+		// reading, so it's cleared; the terminal comes back from analog
+		// mode with its output off
+		setIoRegBitIndirect(terminal.dirReg, terminal.ioBit, 0);
+		if(terminal.outputReg)
+			setIoRegBitIndirect(terminal.outputReg, terminal.ioBit, 0);
+		setDigitalInputDisabled(terminal.adcChannel, 1);
+		analogMask |= GPIO_TERMINAL_BM(terminalNo);
+		return 0;
+		}
+	if(terminal.adcChannel != GPIO_NO_ADC_CHANNEL)
+		setDigitalInputDisabled(terminal.adcChannel, 0);
+	analogMask &= ~GPIO_TERMINAL_BM(terminalNo);
+	setIoRegBitIndirect(terminal.dirReg, terminal.ioBit, dir);
 	return 0;
 	}
 
 int gpio__getDirection(int terminalNo) {
-	const gpio_terminal_def_t *terminal = getTerminal(terminalNo);
-	if(!terminal)
+	gpio_terminal_def_t terminal;
+	if(getTerminal(&terminal, terminalNo))
 		return -1;
-	if(!terminal->dirReg)
+	if(!terminal.dirReg)
 		return -1;
-	return getDirection(terminal);
+	if(analogMask & GPIO_TERMINAL_BM(terminalNo))
+		return DIR_ANALOG;
+	return getDirection(&terminal);
 	}
@@ -1,16 +1,43 @@
 #pragma once
 
 
+#include <stdint.h>
+
+#include "board.h"
+
+
+// Terminal bitmasks (power-on state etc.) use bit n-1 for terminal n; the
+// generator makes board_mask_t as wide as the board's terminal numbers need
+#define GPIO_TERMINAL_BM(terminalNo) ((board_mask_t)1 << ((terminalNo) - 1))
+
+
 enum gpio_terminal_dir {
 	DIR_IN = 0,
 	DIR_OUT = 1,
+	DIR_ANALOG = 2,
+	// ^ Input with the digital buffer and pull-up off, read by analog.c
 	};
 
+// Modules sharing the pin change interrupt each get their own mask
+typedef enum {
+	GPIO_IRQ_RULES,
+	GPIO_IRQ_SYNCOUT,
+	GPIO_IRQ_EDGECAP,
+	GPIO_N_IRQ_USERS
+	} gpio_irq_user_t;
+
+
+// Output bits grouped by I/O port, so that a terminal bitmask can be worked
+// out once and then applied from interrupt context in constant time
+typedef struct {
+	uint8_t bm[GPIO_N_PORTS];
+	} gpio_port_masks_t;
+
 
 extern const int gpio__nTerminals;
 
 
-void gpio__init(void);
+void gpio__init(board_mask_t outputMask, board_mask_t dirMask);
 int gpio__getTerminalNo(int terminalIdx);
 int gpio__getInput(int terminalNo);
 int gpio__getOutput(int terminalNo);
@@ -19,3 +46,24 @@ int gpio__setDirection(int terminalNo, enum gpio_terminal_dir dir);
 int gpio__getDirection(int terminalNo);
 int gpio__supportsInput(int terminalNo);
 int gpio__supportsOutput(int terminalNo);
+int gpio__supportsAnalog(int terminalNo);
+int gpio__getAdcChannel(int terminalNo);
+board_mask_t gpio__getOutputCapMask(void);
+board_mask_t gpio__getInputCapMask(void);
+board_mask_t gpio__getAnalogCapMask(void);
+board_mask_t gpio__getAnalogMask(void);
+int gpio__getPortMasks(gpio_port_masks_t *dest, board_mask_t terminalMask);
+void gpio__writePortMasks(
+	const gpio_port_masks_t *mask, const gpio_port_masks_t *values);
+void gpio__setPortMasks(const gpio_port_masks_t *mask);
+void gpio__clearPortMasks(const gpio_port_masks_t *mask);
+int gpio__applyOutputs(board_mask_t mask, board_mask_t values);
+board_mask_t gpio__readInputs(void);
+board_mask_t gpio__readOutputs(void);
+int gpio__getInputRef(
+	int terminalNo, const volatile uint8_t **reg, uint8_t *bm);
+board_mask_t gpio__setChangeIrqMask(
+	gpio_irq_user_t user, board_mask_t terminalMask);
+
+void gpio__inputChangeEvent(void);
+// Application defines this; called from interrupt context
@@ -0,0 +1,123 @@
+#include <stdint.h>
+#include <util/atomic.h>
+
+#include "gpio.h"
+#include "inrush.h"
+#include "mstick.h"
+
+
+// Spreads out output turn-ons requested by the host so that no more than
+// maxConcurrent outputs switch on within each spacingMs slot, keeping the
+// combined inrush current of a bank of solenoids within what the supply can
+// deliver. A slot starts with the first turn-on after the previous one
+// ended, and turn-ons go out straight away while it has room. The rest are
+// queued and released in terminal number order when it ends; turn-offs
+// always happen immediately and cancel any queued turn-on of the same
+// output. A spacing of 0 disables staggering.
+//
+// Rule actions and armed updates bypass this, since they exist to switch
+// outputs at a precise moment.
+
+static uint8_t spacingMs;
+static uint8_t maxConcurrent;
+static board_mask_t pendingMask;
+static uint8_t slotUsed;
+// ^ Outputs switched on in the current slot; 0 if none is open
+static uint32_t slotEndUs;
+// ^ When the current slot ends, if slotUsed
+
+
+static uint8_t countBits(board_mask_t mask) {
+	uint8_t n = 0;
+	for(; mask; mask &= mask - 1)
+		++n;
+	return n;
+	}
+
+static void releaseSlot(void) {
+	// Switches on as many of the queued outputs as the current slot has room
+	// for, opening a new slot if none is open
+	board_mask_t slotMask = 0;
+	board_mask_t remaining = pendingMask;
+	uint8_t used = slotUsed;
+	if(!pendingMask || used >= maxConcurrent)
+		return;
+	for(; remaining && used < maxConcurrent; ++used) {
+		board_mask_t lowest = remaining & -remaining;
+		slotMask |= lowest;
+		remaining &= ~lowest;
+		}
+	gpio__applyOutputs(slotMask, slotMask);
+	pendingMask = remaining;
+	if(!slotUsed) {
+		slotEndUs = mstick__getMicros() + spacingMs * 1000UL;
+		mstick__scheduleAt(MSTICK_SLOT_INRUSH, slotEndUs);
+		}
+	slotUsed = used;
+	}
+
+void inrush__init(void) {
+	spacingMs = 0;
+	maxConcurrent = 1;
+	pendingMask = 0;
+	slotUsed = 0;
+	}
+
+int inrush__setLimit(uint8_t newSpacingMs, uint8_t newMaxConcurrent) {
+	if(!newMaxConcurrent)
+		return -1;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		uint32_t latestEndUs = mstick__getMicros() + newSpacingMs * 1000UL;
+		spacingMs = newSpacingMs;
+		maxConcurrent = newMaxConcurrent;
+		if(slotUsed && (int32_t)(slotEndUs - latestEndUs) > 0) {
+			slotEndUs = latestEndUs;
+			mstick__scheduleAt(MSTICK_SLOT_INRUSH, slotEndUs);
+			}
+		if(!spacingMs) {
+			gpio__applyOutputs(pendingMask, pendingMask);
+			pendingMask = 0;
+			}
+		else {
+			releaseSlot();
+			// ^ A higher maxConcurrent may leave room in the current slot
+			}
+		}
+	return 0;
+	}
+
+void inrush__getStatus(inrush_status_t *dest) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		uint8_t nSlots =
+			(countBits(pendingMask) + maxConcurrent - 1) / maxConcurrent;
+		dest->spacingMs = spacingMs;
+		dest->maxConcurrent = maxConcurrent;
+		dest->pendingMask = pendingMask;
+		int32_t waitUs = slotUsed ? slotEndUs - mstick__getMicros() : 0;
+		if(waitUs < 0)
+			waitUs = 0;
+		dest->settleMs = nSlots
+			? (waitUs + 999) / 1000 + (nSlots - 1) * spacingMs : 0;
+		}
+	}
+
+int inrush__applyOutputs(board_mask_t mask, board_mask_t values) {
+	board_mask_t onMask = mask & values;
+	if(mask & ~gpio__getOutputCapMask())
+		return -1;
+	if(!spacingMs)
+		return gpio__applyOutputs(mask, values);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		gpio__applyOutputs(mask & ~values, 0);
+		pendingMask &= ~mask;
+		pendingMask |= onMask & ~gpio__readOutputs();
+		// ^ Outputs that are already on draw no inrush
+		releaseSlot();
+		}
+	return 0;
+	}
+
+void inrush__onSlotDeadline(void) {
+	slotUsed = 0;
+	releaseSlot();
+	}
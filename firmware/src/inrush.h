@@ -0,0 +1,21 @@
+#pragma once
+
+
+#include <stdint.h>
+
+#include "board.h"
+
+
+typedef struct {
+	uint8_t spacingMs;
+	uint8_t maxConcurrent;
+	board_mask_t pendingMask;
+	uint16_t settleMs;
+	} inrush_status_t;
+
+
+void inrush__init(void);
+int inrush__setLimit(uint8_t spacingMs, uint8_t maxConcurrent);
+void inrush__getStatus(inrush_status_t *dest);
+int inrush__applyOutputs(board_mask_t mask, board_mask_t values);
+void inrush__onSlotDeadline(void);
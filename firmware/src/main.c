@@ -4,16 +4,27 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <avr/power.h>
 #include <avr/wdt.h>
 #include <util/delay.h>
 
+#include "analog.h"
 #include "cmdproc.h"
+#include "edgecap.h"
 #include "gpio.h"
+#include "inrush.h"
+#include "memstats.h"
 #include "mstick.h"
 #include "nvparams.h"
+#include "powersave.h"
+#include "presets.h"
+#include "rules.h"
+#include "setsample.h"
 #include "statusleds.h"
+#include "syncout.h"
 #include "usbcdc.h"
+#include "vendorctl.h"
 #include "board_info.h"
 
 
@@ -22,6 +33,11 @@
 
 static uint16_t blJumpTrigger __attribute__((section (".noinit")));
 static nvparams_t nvParams;
+static struct {
+	uint32_t outputsApplied;
+	uint32_t mainLoopEntered;
+	uint32_t usbConfigured;
+	} startupTimesUs;
 
 
 // Misc subroutines
@@ -60,198 +76,757 @@ void hwInit(void) {
 	clock_prescale_set(clock_div_1);
 	}
 
+void sendLeftArgsEcho(const cmdproc_command_t *command) {
+	// Start of a reply to a terminal list query, e.g. "INP:13,14="
+	char buf[8];
+	usbcdc__sendStringNoFlush(command->mnem);
+	for(int i = 0; i < command->nLeftArgs; ++i) {
+		snprintf_P(
+			buf,
+			sizeof(buf),
+			PSTR("%c%u"),
+			i ? ',' : ':',
+			cmdproc__leftUint(command, i)
+			);
+		usbcdc__sendStringNoFlush(buf);
+		}
+	usbcdc__sendStringNoFlush_P(PSTR("="));
+	}
+
+int setOutputList(const cmdproc_command_t *command) {
+	// All listed outputs switch together; a single value applies to all
+	board_mask_t mask = 0;
+	board_mask_t values = 0;
+	for(int i = 0; i < command->nLeftArgs; ++i) {
+		int terminalNo = cmdproc__leftUint(command, i);
+		int valIdx = (command->nRightArgs > 1) ? i : 0;
+		if(gpio__supportsOutput(terminalNo) <= 0)
+			return -1;
+		mask |= GPIO_TERMINAL_BM(terminalNo);
+		if(cmdproc__rightUint(command, valIdx))
+			values |= GPIO_TERMINAL_BM(terminalNo);
+		else
+			values &= ~GPIO_TERMINAL_BM(terminalNo);
+		}
+	return inrush__applyOutputs(mask, values);
+	}
+
+int setDirectionList(const cmdproc_command_t *command) {
+	// Everything is checked first so a bad entry leaves all terminals alone
+	board_mask_t analogMask = gpio__getAnalogMask();
+	for(int i = 0; i < command->nLeftArgs; ++i) {
+		int terminalNo = cmdproc__leftUint(command, i);
+		int valIdx = (command->nRightArgs > 1) ? i : 0;
+		int dir = cmdproc__rightUint(command, valIdx);
+		if(dir == DIR_ANALOG) {
+			if(gpio__supportsAnalog(terminalNo) <= 0)
+				return -1;
+			}
+		else if(dir != DIR_IN && dir != DIR_OUT)
+			return -1;
+		else if(gpio__supportsInput(terminalNo) <= 0
+				|| gpio__supportsOutput(terminalNo) <= 0)
+			return -1;
+		}
+	for(int i = 0; i < command->nLeftArgs; ++i) {
+		gpio__setDirection(
+			cmdproc__leftUint(command, i),
+			cmdproc__rightUint(command, (command->nRightArgs > 1) ? i : 0)
+			);
+		}
+	if(gpio__getAnalogMask() == analogMask)
+		return 0;
+		// Sampling restarts with empty rings, so leave it alone unless the
+		// set of analog terminals has changed
+	return analog__setTerminals(gpio__getAnalogMask());
+	}
+
 void handleCommand(void) {
 	cmdproc_command_t command;
-	char msgOutBuf[33];
+	char msgOutBuf[41];
 	int cmdResult;
 	int abort = 0;
 
 	if(cmdproc__hasCommandWaiting()) {
 		statusleds__winkUsbLed();
 		cmdproc__getCommand(&command);
+		if(command.tag != CMDPROC_NO_TAG) {
+			// Every reply is a single line, so tagging its start is enough
+			snprintf_P(msgOutBuf, sizeof(msgOutBuf), PSTR("#%d "), command.tag);
+			usbcdc__sendStringNoFlush(msgOutBuf);
+			}
 		if(command.parseError) {
 			switch(command.parseError){
 				case ERROR_CMD:
-					usbcdc__sendString("ERROR:CMD\r\n");
+					usbcdc__sendString_P(PSTR("ERROR:CMD\r\n"));
 					break;
 				case ERROR_N_ARGS:
-					usbcdc__sendString("ERROR:ARGN\r\n");
+					usbcdc__sendString_P(PSTR("ERROR:ARGN\r\n"));
 					break;
 				case ERROR_ARG_FMT:
-					usbcdc__sendString("ERROR:ARGFMT\r\n");
+					usbcdc__sendString_P(PSTR("ERROR:ARGFMT\r\n"));
 					break;
 				case ERROR_ARG_VAL:
-					usbcdc__sendString("ERROR:ARGVAL\r\n");
+					usbcdc__sendString_P(PSTR("ERROR:ARGVAL\r\n"));
 					break;
 				default:
-					usbcdc__sendString("ERROR:UNK\r\n");
+					usbcdc__sendString_P(PSTR("ERROR:UNK\r\n"));
 				}
 			}
-		else if(!strcmp(command.mnem, "DFU")) {
-			usbcdc__sendString("OK\r\n");
+		else if(!strcmp_P(command.mnem, PSTR("DFU"))) {
+			usbcdc__sendString_P(PSTR("OK\r\n"));
 			triggerResetToBootloader();
 			}
-		else if(!strcmp(command.mnem, "RST")) {
-			usbcdc__sendString("OK\r\n");
+		else if(!strcmp_P(command.mnem, PSTR("RST"))) {
+			usbcdc__sendString_P(PSTR("OK\r\n"));
 			triggerResetToApp();
 			}
-		else if(!strcmp(command.mnem, "TLS")) {
-			usbcdc__sendStringNoFlush("TLS=");
+		else if(!strcmp_P(command.mnem, PSTR("TLS"))) {
+			usbcdc__sendStringNoFlush_P(PSTR("TLS="));
 			for(int i = 0; i < gpio__nTerminals; ++i) {
-				snprintf(
+				snprintf_P(
 					msgOutBuf,
 					sizeof(msgOutBuf) - 1,
-					"%d",
+					PSTR("%d"),
 					gpio__getTerminalNo(i)
 					);
 				usbcdc__sendStringNoFlush(msgOutBuf);
 				if(i < gpio__nTerminals - 1)
-					usbcdc__sendStringNoFlush(",");
+					usbcdc__sendStringNoFlush_P(PSTR(","));
 				}
-			usbcdc__sendString("\r\n");
+			usbcdc__sendString_P(PSTR("\r\n"));
 			}
-		else if(!strcmp(command.mnem, "TCP")) {
-			int terminalNo = command.leftArgs[0].uint8Val;
-			int supportsOutput = gpio__supportsOutput(terminalNo);
-			int supportsInput = gpio__supportsInput(terminalNo);
-			if (supportsOutput < 0 || supportsInput < 0) {
-				usbcdc__sendString("ERROR:VAL\r\n");
+		else if(!strcmp_P(command.mnem, PSTR("TCP"))) {
+			int valid = 1;
+			for(int i = 0; i < command.nLeftArgs; ++i) {
+				if(gpio__supportsOutput(cmdproc__leftUint(&command, i)) < 0)
+					valid = 0;
+				}
+			if(!valid) {
+				usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
 				}
 			else {
-				snprintf(
-					msgOutBuf,
-					sizeof(msgOutBuf),
-					"TCP:%d=",
-					command.leftArgs[0].uint8Val
-					);
-				usbcdc__sendStringNoFlush(msgOutBuf);
-				if(supportsInput)
-					usbcdc__sendStringNoFlush("I");
-				if(supportsOutput)
-					usbcdc__sendStringNoFlush("O");
-				usbcdc__sendString("\r\n");
+				sendLeftArgsEcho(&command);
+				for(int i = 0; i < command.nLeftArgs; ++i) {
+					int terminalNo = cmdproc__leftUint(&command, i);
+					if(i)
+						usbcdc__sendStringNoFlush_P(PSTR(","));
+					if(gpio__supportsInput(terminalNo))
+						usbcdc__sendStringNoFlush_P(PSTR("I"));
+					if(gpio__supportsOutput(terminalNo))
+						usbcdc__sendStringNoFlush_P(PSTR("O"));
+					if(gpio__supportsAnalog(terminalNo))
+						usbcdc__sendStringNoFlush_P(PSTR("A"));
+					}
+				usbcdc__sendString_P(PSTR("\r\n"));
 				}
 			}
-		else if(!strcmp(command.mnem, "IDN")) {
-			snprintf(
+		else if(!strcmp_P(command.mnem, PSTR("IDN"))) {
+			snprintf_P(
 				msgOutBuf,
 				sizeof(msgOutBuf),
-				"IDN=%s,%s\r\n",
+				PSTR("IDN=%s,%s\r\n"),
 				BOARD_MODEL_STR,
 				nvParams.boardId
 				);
 			usbcdc__sendString(msgOutBuf);
 			}
-		else if(!strcmp(command.mnem, "SER")) {
+		else if(!strcmp_P(command.mnem, PSTR("FWV"))) {
+			usbcdc__sendString_P(PSTR("FWV=" FW_VERSION_STR "\r\n"));
+			}
+		else if(!strcmp_P(command.mnem, PSTR("SER"))) {
 			strncpy(
 				nvParams.boardId,
-				command.rightArgs[0].stringVal,
+				cmdproc__rightString(&command, 0),
 				BOARDID_LEN_MAX
 				);
-			usbcdc__sendString("OK\r\n");
+			usbcdc__sendString_P(PSTR("OK\r\n"));
 			}
-		else if(!strcmp(command.mnem, "NVS")) {
-			nvparams__save(&nvParams);
-			usbcdc__sendString("OK\r\n");
+		else if(!strcmp_P(command.mnem, PSTR("NVS"))) {
+			if(nvparams__save(&nvParams) || rules__save())
+				usbcdc__sendString_P(PSTR("ERROR:NVM\r\n"));
+			else
+				usbcdc__sendString_P(PSTR("OK\r\n"));
 			}
-		else if(!strcmp(command.mnem, "NVL")) {
+		else if(!strcmp_P(command.mnem, PSTR("NVL"))) {
 			nvparams__load(&nvParams);
-			usbcdc__sendString("OK\r\n");
+			rules__loadSaved();
+			usbcdc__sendString_P(PSTR("OK\r\n"));
 			}
-		else if(!strcmp(command.mnem, "DEF")) {
+		else if(!strcmp_P(command.mnem, PSTR("DEF"))) {
 			nvparams__loadDefaults(&nvParams);
-			usbcdc__sendString("OK\r\n");
+			rules__clearAll();
+			usbcdc__sendString_P(PSTR("OK\r\n"));
 			}
-		else if(command.cmdType == CMDTYPE_QUERY) {
-			if(!strcmp(command.mnem, "OUT")) {
-				cmdResult = gpio__getOutput(command.leftArgs[0].uint8Val);
+		else if(!strcmp_P(command.mnem, PSTR("PON"))) {
+			if(command.cmdType == CMDTYPE_SET) {
+				nvParams.powerOnOutputs = cmdproc__rightUint(&command, 0);
+				nvParams.powerOnDirs = cmdproc__rightUint(&command, 1);
+				usbcdc__sendString_P(PSTR("OK\r\n"));
+				}
+			else {
+				snprintf_P(
+					msgOutBuf,
+					sizeof(msgOutBuf),
+					PSTR("PON=%" BOARD_MASK_PRI ",%" BOARD_MASK_PRI "\r\n"),
+					nvParams.powerOnOutputs,
+					nvParams.powerOnDirs
+					);
+				usbcdc__sendString(msgOutBuf);
+				}
+			}
+		else if(!strcmp_P(command.mnem, PSTR("PST"))) {
+			uint8_t presetNo = cmdproc__leftUint(&command, 0);
+			board_mask_t mask, values;
+			if(command.cmdType == CMDTYPE_SET) {
+				if(presets__define(
+						presetNo,
+						cmdproc__rightUint(&command, 0),
+						cmdproc__rightUint(&command, 1)
+						))
+					usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
+				else
+					usbcdc__sendString_P(PSTR("OK\r\n"));
+				}
+			else if(presets__get(presetNo, &mask, &values)) {
+				usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
+				}
+			else {
+				snprintf_P(
+					msgOutBuf,
+					sizeof(msgOutBuf),
+					PSTR("PST:%d=%" BOARD_MASK_PRI ",%" BOARD_MASK_PRI "\r\n"),
+					presetNo,
+					mask,
+					values
+					);
+				usbcdc__sendString(msgOutBuf);
+				}
+			}
+		else if(!strcmp_P(command.mnem, PSTR("PSL"))) {
+			int first = 1;
+			usbcdc__sendStringNoFlush_P(PSTR("PSL="));
+			for(int i = 1; i <= PRESETS_N; ++i) {
+				if(!presets__isDefined(i))
+					continue;
+				snprintf_P(
+					msgOutBuf,
+					sizeof(msgOutBuf),
+					first ? PSTR("%d") : PSTR(",%d"),
+					i
+					);
+				usbcdc__sendStringNoFlush(msgOutBuf);
+				first = 0;
+				}
+			usbcdc__sendString_P(PSTR("\r\n"));
+			}
+		else if(!strcmp_P(command.mnem, PSTR("RCL"))) {
+			if(presets__recall(cmdproc__leftUint(&command, 0)))
+				usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
+			else
+				usbcdc__sendString_P(PSTR("OK\r\n"));
+			}
+		else if(!strcmp_P(command.mnem, PSTR("RUL"))) {
+			uint8_t ruleNo = cmdproc__leftUint(&command, 0);
+			rules_rule_t rule;
+			if(command.cmdType == CMDTYPE_SET) {
+				rule.inputTerminalNo = cmdproc__rightUint(&command, 0);
+				rule.trigger = cmdproc__rightUint(&command, 1);
+				rule.action = cmdproc__rightUint(&command, 2);
+				rule.outputMask = cmdproc__rightUint(&command, 3);
+				rule.pulseMs = cmdproc__rightUint(&command, 4);
+				rule.enabled = 0;
+				if(rules__define(ruleNo, &rule))
+					usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
+				else
+					usbcdc__sendString_P(PSTR("OK\r\n"));
 				}
-			else if(!strcmp(command.mnem, "INP")) {
-				cmdResult = gpio__getInput(command.leftArgs[0].uint8Val);
+			else if(rules__get(ruleNo, &rule)) {
+				usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
 				}
-			else if(!strcmp(command.mnem, "DIR")) {
-				cmdResult = gpio__getDirection(command.leftArgs[0].uint8Val);
+			else {
+				snprintf_P(
+					msgOutBuf,
+					sizeof(msgOutBuf),
+					PSTR("RUL:%d=%d,%d,%d,%" BOARD_MASK_PRI ",%u,%d\r\n"),
+					ruleNo,
+					rule.inputTerminalNo,
+					rule.trigger,
+					rule.action,
+					rule.outputMask,
+					rule.pulseMs,
+					rule.enabled
+					);
+				usbcdc__sendString(msgOutBuf);
+				}
+			}
+		else if(!strcmp_P(command.mnem, PSTR("REN"))) {
+			if(rules__setEnabled(
+					cmdproc__leftUint(&command, 0),
+					cmdproc__rightUint(&command, 0)
+					))
+				usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
+			else
+				usbcdc__sendString_P(PSTR("OK\r\n"));
+			}
+		else if(!strcmp_P(command.mnem, PSTR("RLS"))) {
+			int first = 1;
+			usbcdc__sendStringNoFlush_P(PSTR("RLS="));
+			for(int i = 1; i <= RULES_N; ++i) {
+				if(!rules__isDefined(i))
+					continue;
+				snprintf_P(
+					msgOutBuf,
+					sizeof(msgOutBuf),
+					first ? PSTR("%d") : PSTR(",%d"),
+					i
+					);
+				usbcdc__sendStringNoFlush(msgOutBuf);
+				first = 0;
+				}
+			usbcdc__sendString_P(PSTR("\r\n"));
+			}
+		else if(!strcmp_P(command.mnem, PSTR("RLT"))) {
+			snprintf_P(
+				msgOutBuf,
+				sizeof(msgOutBuf),
+				PSTR("RLT=%u\r\n"),
+				rules__getMaxObservedEvalUs()
+				);
+			usbcdc__sendString(msgOutBuf);
+			}
+		else if(!strcmp_P(command.mnem, PSTR("ARM"))) {
+			syncout_status_t status;
+			if(command.cmdType == CMDTYPE_SET) {
+				if(syncout__arm(
+						cmdproc__rightUint(&command, 0),
+						cmdproc__rightUint(&command, 1),
+						cmdproc__rightUint(&command, 2),
+						cmdproc__rightUint(&command, 3)
+						))
+					usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
+				else
+					usbcdc__sendString_P(PSTR("OK\r\n"));
 				}
 			else {
-				usbcdc__sendString("ERROR:IMP\r\n");
+				syncout__getStatus(&status);
+				snprintf_P(
+					msgOutBuf,
+					sizeof(msgOutBuf),
+					PSTR("ARM=%d,%" BOARD_MASK_PRI ",%" BOARD_MASK_PRI
+						",%d,%d\r\n"),
+					status.state,
+					status.mask,
+					status.values,
+					status.triggerTerminalNo,
+					status.edge
+					);
+				usbcdc__sendString(msgOutBuf);
+				}
+			}
+		else if(!strcmp_P(command.mnem, PSTR("DSA"))) {
+			syncout__disarm();
+			usbcdc__sendString_P(PSTR("OK\r\n"));
+			}
+		else if(!strcmp_P(command.mnem, PSTR("FIR"))) {
+			if(syncout__fire())
+				usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
+			else
+				usbcdc__sendString_P(PSTR("OK\r\n"));
+			}
+		else if(!strcmp_P(command.mnem, PSTR("INR"))) {
+			if(command.cmdType == CMDTYPE_SET) {
+				if(inrush__setLimit(
+						cmdproc__rightUint(&command, 0),
+						cmdproc__rightUint(&command, 1)
+						))
+					usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
+				else
+					usbcdc__sendString_P(PSTR("OK\r\n"));
+				}
+			else {
+				inrush_status_t status;
+				inrush__getStatus(&status);
+				snprintf_P(
+					msgOutBuf,
+					sizeof(msgOutBuf),
+					PSTR("INR=%d,%d,%" BOARD_MASK_PRI ",%u\r\n"),
+					status.spacingMs,
+					status.maxConcurrent,
+					status.pendingMask,
+					status.settleMs
+					);
+				usbcdc__sendString(msgOutBuf);
+				}
+			}
+		else if(!strcmp_P(command.mnem, PSTR("EDC"))) {
+			if(command.cmdType == CMDTYPE_SET) {
+				if(edgecap__setMask(cmdproc__rightUint(&command, 0)))
+					usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
+				else
+					usbcdc__sendString_P(PSTR("OK\r\n"));
+				}
+			else {
+				snprintf_P(
+					msgOutBuf,
+					sizeof(msgOutBuf),
+					PSTR("EDC=%" BOARD_MASK_PRI "\r\n"),
+					edgecap__getMask()
+					);
+				usbcdc__sendString(msgOutBuf);
+				}
+			}
+		else if(!strcmp_P(command.mnem, PSTR("EDG"))) {
+			// Drains at most one ring's worth so that a busy input can't
+			// keep the reply going forever
+			edgecap_record_t edge;
+			snprintf_P(
+				msgOutBuf,
+				sizeof(msgOutBuf),
+				PSTR("EDG=%u"),
+				edgecap__takeOverflowCount()
+				);
+			usbcdc__sendStringNoFlush(msgOutBuf);
+			for(int i = 0; i < EDGECAP_RING_SIZE && !edgecap__pop(&edge); ++i) {
+				snprintf_P(
+					msgOutBuf,
+					sizeof(msgOutBuf),
+					PSTR(",%d,%d,%lu"),
+					edge.terminalNo,
+					edge.level,
+					edge.timeUs
+					);
+				usbcdc__sendStringNoFlush(msgOutBuf);
+				}
+			usbcdc__sendString_P(PSTR("\r\n"));
+			}
+		else if(!strcmp_P(command.mnem, PSTR("ANC"))) {
+			if(command.cmdType == CMDTYPE_SET) {
+				if(analog__configure(
+						cmdproc__rightUint(&command, 0),
+						cmdproc__rightUint(&command, 1)
+						))
+					usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
+				else
+					usbcdc__sendString_P(PSTR("OK\r\n"));
+				}
+			else {
+				snprintf_P(
+					msgOutBuf,
+					sizeof(msgOutBuf),
+					PSTR("ANC=%u,%u,%lu\r\n"),
+					analog__getOversample(),
+					analog__getAverageCount(),
+					analog__getSamplePeriodUs()
+					);
+				usbcdc__sendString(msgOutBuf);
+				}
+			}
+		else if(!strcmp_P(command.mnem, PSTR("ANV"))) {
+			// Latest and averaged reading of each terminal, in pairs
+			analog_values_t values;
+			int valid = 1;
+			for(int i = 0; i < command.nLeftArgs; ++i) {
+				if(analog__getValues(cmdproc__leftUint(&command, i), &values))
+					valid = 0;
+				}
+			if(!valid) {
+				usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
+				}
+			else {
+				sendLeftArgsEcho(&command);
+				for(int i = 0; i < command.nLeftArgs; ++i) {
+					analog__getValues(cmdproc__leftUint(&command, i), &values);
+					snprintf_P(
+						msgOutBuf,
+						sizeof(msgOutBuf),
+						i ? PSTR(",%u,%u") : PSTR("%u,%u"),
+						values.latest,
+						values.average
+						);
+					usbcdc__sendStringNoFlush(msgOutBuf);
+					}
+				usbcdc__sendString_P(PSTR("\r\n"));
+				}
+			}
+		else if(!strcmp_P(command.mnem, PSTR("ANB"))) {
+			// Number of samples dropped since the last read, then the unread
+			// ones, oldest first, as four hex digits each
+			uint16_t samples[ANALOG_RING_SIZE];
+			uint16_t dropped;
+			int nSamples = analog__readBlock(
+				cmdproc__leftUint(&command, 0),
+				samples,
+				ANALOG_RING_SIZE,
+				&dropped
+				);
+			if(nSamples < 0) {
+				usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
+				}
+			else {
+				sendLeftArgsEcho(&command);
+				snprintf_P(msgOutBuf, sizeof(msgOutBuf), PSTR("%u,"), dropped);
+				usbcdc__sendStringNoFlush(msgOutBuf);
+				for(int i = 0; i < nSamples; ++i) {
+					snprintf_P(
+						msgOutBuf, sizeof(msgOutBuf), PSTR("%04X"), samples[i]);
+					usbcdc__sendStringNoFlush(msgOutBuf);
+					}
+				usbcdc__sendString_P(PSTR("\r\n"));
+				}
+			}
+		else if(!strcmp_P(command.mnem, PSTR("TML"))) {
+			mstick_load_t load;
+			mstick__takeLoad(&load);
+			snprintf_P(
+				msgOutBuf,
+				sizeof(msgOutBuf),
+				PSTR("TML=%lu,%lu,%lu\r\n"),
+				load.wakeups,
+				load.busyUs,
+				load.elapsedUs
+				);
+			usbcdc__sendString(msgOutBuf);
+			}
+		else if(!strcmp_P(command.mnem, PSTR("SAS"))) {
+			// Replied to by finishSetSample() once the sample is in
+			uint32_t delayUs = cmdproc__rightUint(&command, 2) * 1000UL
+				+ cmdproc__rightUint(&command, 3);
+			if(setsample__start(
+					cmdproc__rightUint(&command, 0),
+					cmdproc__rightUint(&command, 1),
+					delayUs
+					))
+				usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
+			}
+		else if(!strcmp_P(command.mnem, PSTR("MEM"))) {
+			memstats_t mem;
+			memstats__get(&mem);
+			snprintf_P(
+				msgOutBuf,
+				sizeof(msgOutBuf),
+				PSTR("MEM=%u,%u,%u\r\n"),
+				mem.staticBytes,
+				mem.freeBytes,
+				mem.minFreeBytes
+				);
+			usbcdc__sendString(msgOutBuf);
+			}
+		else if(!strcmp_P(command.mnem, PSTR("IDL"))) {
+			powersave_stats_t stats;
+			powersave__takeStats(&stats);
+			snprintf_P(
+				msgOutBuf,
+				sizeof(msgOutBuf),
+				PSTR("IDL=%lu,%lu,%lu"),
+				stats.wakeups,
+				stats.asleepUs,
+				stats.elapsedUs
+				);
+			usbcdc__sendStringNoFlush(msgOutBuf);
+			snprintf_P(
+				msgOutBuf,
+				sizeof(msgOutBuf),
+				PSTR(",%lu,%lu\r\n"),
+				stats.maxPassUs,
+				powersave__getMaxObservedLatencyUs()
+				);
+			usbcdc__sendString(msgOutBuf);
+			}
+		else if(!strcmp_P(command.mnem, PSTR("TTR"))) {
+			snprintf_P(
+				msgOutBuf,
+				sizeof(msgOutBuf),
+				PSTR("TTR=%lu,%lu,%lu\r\n"),
+				startupTimesUs.outputsApplied,
+				startupTimesUs.mainLoopEntered,
+				startupTimesUs.usbConfigured
+				);
+			usbcdc__sendString(msgOutBuf);
+			}
+		else if(command.cmdType == CMDTYPE_QUERY) {
+			// Terminal list queries; every terminal is read before replying
+			// so that an invalid one doesn't leave a half-sent line
+			uint8_t results[CMDPROC_MAX_N_ARGS];
+			if(strcmp_P(command.mnem, PSTR("OUT"))
+					&& strcmp_P(command.mnem, PSTR("INP"))
+					&& strcmp_P(command.mnem, PSTR("DIR"))) {
+				usbcdc__sendString_P(PSTR("ERROR:IMP\r\n"));
 				abort = 1;
 				}
-			if(!abort) {
-				if(cmdResult < 0) {
-					usbcdc__sendString("ERROR:VAL\r\n");
+			for(int i = 0; !abort && i < command.nLeftArgs; ++i) {
+				int terminalNo = cmdproc__leftUint(&command, i);
+				if(!strcmp_P(command.mnem, PSTR("OUT"))) {
+					cmdResult = gpio__getOutput(terminalNo);
+					}
+				else if(!strcmp_P(command.mnem, PSTR("INP"))) {
+					cmdResult = gpio__getInput(terminalNo);
 					}
 				else {
-					snprintf(
+					cmdResult = gpio__getDirection(terminalNo);
+					}
+				if(cmdResult < 0) {
+					usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
+					abort = 1;
+					}
+				results[i] = cmdResult;
+				}
+			if(!abort) {
+				sendLeftArgsEcho(&command);
+				for(int i = 0; i < command.nLeftArgs; ++i) {
+					snprintf_P(
 						msgOutBuf,
 						sizeof(msgOutBuf),
-						"%s:%d=%d\r\n",
-						command.mnem,
-						command.leftArgs[0].uint8Val,
-						cmdResult
+						i ? PSTR(",%d") : PSTR("%d"),
+						results[i]
 						);
-					usbcdc__sendString(msgOutBuf);
+					usbcdc__sendStringNoFlush(msgOutBuf);
 					}
+				usbcdc__sendString_P(PSTR("\r\n"));
 				}
 			}
 		else if(command.cmdType == CMDTYPE_SET) {
-			if(!strcmp(command.mnem, "OUT")) {
-				cmdResult = gpio__setOutput(
-					command.leftArgs[0].uint8Val,
-					command.rightArgs[0].uint8Val
-					);
+			// Terminal lists take one value per terminal, or one for all
+			if(command.nRightArgs != 1
+					&& command.nRightArgs != command.nLeftArgs) {
+				usbcdc__sendString_P(PSTR("ERROR:ARGN\r\n"));
+				abort = 1;
 				}
-			else if(!strcmp(command.mnem, "DIR")) {
-				cmdResult = gpio__setDirection(
-					command.leftArgs[0].uint8Val,
-					command.rightArgs[0].uint8Val
-					);
+			else if(!strcmp_P(command.mnem, PSTR("OUT"))) {
+				cmdResult = setOutputList(&command);
+				}
+			else if(!strcmp_P(command.mnem, PSTR("DIR"))) {
+				cmdResult = setDirectionList(&command);
 				}
 			else {
-				usbcdc__sendString("ERROR:IMP\r\n");
+				usbcdc__sendString_P(PSTR("ERROR:IMP\r\n"));
 				abort = 1;
 				}
 			if(!abort) {
 				if(cmdResult) {
-					usbcdc__sendString("ERROR:VAL\r\n");
+					usbcdc__sendString_P(PSTR("ERROR:VAL\r\n"));
 					}
 				else {
-					usbcdc__sendString("OK\r\n");
+					usbcdc__sendString_P(PSTR("OK\r\n"));
 					}
 				}
 			}
 		else {
-			usbcdc__sendString("ERROR:IMP\r\n");
+			usbcdc__sendString_P(PSTR("ERROR:IMP\r\n"));
 			}
 		}
-	while(usbcdc__hasInputWaiting()) {
+	while(!cmdproc__hasCommandWaiting() && usbcdc__hasInputWaiting()) {
+		// Stop at the end of a line so any commands queued behind it stay
+		// in the USB receive ring until this one has been handled
 		int16_t ch = usbcdc__getNextInputChar();
 		if(ch >= 0)
 			cmdproc__processIncomingChar((uint8_t)ch);
 		}
 	}
 
-void mstick__tickEvent(volatile uint16_t *tickCounter) {
-	statusleds__onMsTick(tickCounter);
+void finishSetSample(void) {
+	// Sends the rest of an SAS reply (any tag went out with the command).
+	// Commands arriving in the meantime wait in the receive buffer.
+	setsample_result_t result;
+	char msgOutBuf[32];
+	if(setsample__takeResult(&result))
+		return;
+	snprintf_P(
+		msgOutBuf,
+		sizeof(msgOutBuf),
+		PSTR("SAS=%" BOARD_MASK_PRI ",%lu\r\n"),
+		result.inputs,
+		result.elapsedUs
+		);
+	usbcdc__sendString(msgOutBuf);
+	}
+
+int hasPendingWork(void) {
+	// Called with interrupts disabled before the main loop goes to sleep
+	if(statusleds__hasWork())
+		return 1;
+	if(setsample__isBusy())
+		return setsample__isDone();
+		// ^ Received commands wait until the SAS reply is out
+	return cmdproc__hasCommandWaiting() || usbcdc__hasInputWaiting();
+	}
+
+void mstick__deadlineEvent(mstick_slot_t slot) {
+	switch(slot) {
+		case MSTICK_SLOT_HEARTBEAT:
+			statusleds__onHeartbeatDeadline();
+			break;
+		case MSTICK_SLOT_WINK:
+			statusleds__onWinkDeadline();
+			break;
+		case MSTICK_SLOT_POLL:
+			rules__onPoll();
+			edgecap__onPoll();
+			vendorctl__onPoll();
+			break;
+		case MSTICK_SLOT_RULES:
+			rules__onPulseDeadline();
+			break;
+		case MSTICK_SLOT_INRUSH:
+			inrush__onSlotDeadline();
+			break;
+		case MSTICK_SLOT_SAMPLE:
+			setsample__onDeadline();
+			break;
+		default:
+			break;
+		}
+	}
+
+void gpio__inputChangeEvent(void) {
+	syncout__onInputChange();
+	edgecap__onInputChange();
+	rules__onInputChange();
+	}
+
+void usbcdc__vendorReportEvent(const uint8_t *report) {
+	vendorctl__onReport(report);
 	}
 
+void usbcdc__configuredEvent(void) {
+	if(!startupTimesUs.usbConfigured)
+		startupTimesUs.usbConfigured = mstick__getMicros();
 	}
 
 
 // Main routine (unnecessary section title)
 	
 int main(void) {
+	// Timestamps in startupTimesUs count from mstick__init(), so they don't
+	// include the oscillator start-up delay set by the fuses
 	hwInit();
+	mstick__init();
 	statusleds__init();
-	gpio__init();
+	sei();
 	nvparams__init(&nvParams);
+	gpio__init(nvParams.powerOnOutputs, nvParams.powerOnDirs);
+	startupTimesUs.outputsApplied = mstick__getMicros();
+	presets__init();
+	rules__init();
+	syncout__init();
+	edgecap__init();
+	inrush__init();
+	setsample__init();
+	analog__init();
+	vendorctl__init();
 	cmdproc__init();
-	mstick__init();
-	usbcdc__init(nvParams.boardId);
-	sei();
+	usbcdc__init((char *)nvParams.boardId);
+	powersave__init();
+	startupTimesUs.mainLoopEntered = mstick__getMicros();
 
 	while(1) {
 		usbcdc__task();
 		statusleds__task();
-		handleCommand();
+		if(setsample__isBusy())
+			finishSetSample();
+		else
+			handleCommand();
+		cli();
+		powersave__endPass(!hasPendingWork());
 		}
 	}
@@ -0,0 +1,35 @@
+#include <stdint.h>
+#include <avr/io.h>
+
+#include "memstats.h"
+
+
+// Everything from the end of static data up to RAMEND is painted with a
+// known byte before main() runs. Nothing here uses malloc(), so that whole
+// region belongs to the stack, and the painted bytes left above static data
+// show how close the stack has come to running into it.
+
+#define PAINT_BYTE 0xC5
+
+extern uint8_t __data_start;
+extern uint8_t __heap_start;
+// ^ Linker symbols: start of .data, end of .noinit
+
+
+void memstats__paint(void) __attribute__((naked, used, section(".init3")));
+void memstats__paint(void) {
+	// Runs after the stack pointer and zero register are set up and before
+	// anything has been pushed, so the whole region can be painted
+	for(uint8_t *p = &__heap_start; p <= (uint8_t *)RAMEND; ++p)
+		*p = PAINT_BYTE;
+	}
+
+void memstats__get(memstats_t *dest) {
+	const uint8_t *p = &__heap_start;
+	uint16_t untouched = 0;
+	while(p + untouched < (uint8_t *)SP && p[untouched] == PAINT_BYTE)
+		++untouched;
+	dest->staticBytes = &__heap_start - &__data_start;
+	dest->freeBytes = SP - (uint16_t)&__heap_start;
+	dest->minFreeBytes = untouched;
+	}
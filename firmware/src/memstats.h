@@ -0,0 +1,17 @@
+#pragma once
+
+
+#include <stdint.h>
+
+
+typedef struct {
+	uint16_t staticBytes;
+	// ^ .data, .bss and .noinit
+	uint16_t freeBytes;
+	// ^ Between the end of static data and the stack pointer, right now
+	uint16_t minFreeBytes;
+	// ^ Lowest freeBytes since reset, going by the stack paint
+	} memstats_t;
+
+
+void memstats__get(memstats_t *dest);
@@ -1,21 +1,213 @@
 #include <stdint.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 
 #include "mstick.h"
 
 
-static volatile uint16_t tickCounter;
+// Timekeeping and deadline scheduling on Timer1, which free-runs at F_CPU/64
+// (4 us per count at 16 MHz). Its overflow interrupt extends the count to 32
+// bits every 262 ms; apart from that, the timer only interrupts when a
+// deadline is due. Each slot holds at most one deadline, and the compare
+// register is set for the earliest one that falls within the current
+// overflow period (later ones get picked up by the overflow interrupt).
+//
+// Deadline handlers run in interrupt context through mstick__deadlineEvent()
+// and may schedule further deadlines. The poll slot is managed here: it
+// recurs every MSTICK_POLL_INTERVAL_US for as long as any module has asked
+// for polling, and costs nothing otherwise.
 
+#define US_PER_COUNT (64 * 1000000UL / F_CPU)
+#define COUNTS_PER_MS ((F_CPU / 64) / 1000)
+#define POLL_INTERVAL_COUNTS (MSTICK_POLL_INTERVAL_US / US_PER_COUNT)
+#define MIN_LEAD_COUNTS 2
+// ^ Compare values closer than this to the count might be passed before
+// they're written
+
+
+static volatile uint16_t overflowCount;
+static volatile uint16_t msBase;
+static volatile uint16_t msCarryCounts;
+// ^ Milliseconds and leftover counts at the last overflow. The leftover
+// can reach COUNTS_PER_MS + 35 before it's carried, so it needs 16 bits.
+static uint32_t deadlines[MSTICK_N_SLOTS];
+static volatile uint8_t activeSlots;
+static volatile uint8_t pollUsers;
+static volatile uint32_t loadWakeups;
+static volatile uint32_t loadBusyCounts;
+static uint32_t loadStartCounts;
+
+
+static uint32_t nowCounts(void) {
+	// Call with interrupts disabled
+	uint16_t ovf = overflowCount;
+	uint16_t count = TCNT1;
+	if((TIFR1 & _BV(TOV1)) && count < 0x8000) {
+		// Counter wrapped but the overflow hasn't been serviced yet
+		++ovf;
+		}
+	return ((uint32_t)ovf << 16) | count;
+	}
+
+static void armCompare(void) {
+	// Call with interrupts disabled
+	uint32_t now = nowCounts();
+	int32_t soonest = 0x10000;
+	uint16_t count, elapsed;
+	for(uint8_t i = 0; i < MSTICK_N_SLOTS; ++i) {
+		int32_t diff = deadlines[i] - now;
+		if((activeSlots & _BV(i)) && diff < soonest)
+			soonest = diff;
+		}
+	if(soonest >= 0x10000) {
+		TIMSK1 &= ~_BV(OCIE1A);
+		return;
+		}
+	count = TCNT1;
+	elapsed = count - (uint16_t)now;
+	if(soonest < (int32_t)elapsed + MIN_LEAD_COUNTS)
+		OCR1A = count + MIN_LEAD_COUNTS;
+	else
+		OCR1A = (uint16_t)now + soonest;
+	TIFR1 = _BV(OCF1A);
+	TIMSK1 |= _BV(OCIE1A);
+	}
+
+static void dispatchDue(void) {
+	uint32_t now = nowCounts();
+	for(uint8_t i = 0; i < MSTICK_N_SLOTS; ++i) {
+		if(!(activeSlots & _BV(i)) || (int32_t)(deadlines[i] - now) > 0)
+			continue;
+		activeSlots &= ~_BV(i);
+		if(i == MSTICK_SLOT_POLL && pollUsers) {
+			deadlines[i] += POLL_INTERVAL_COUNTS;
+			if((int32_t)(deadlines[i] - now) <= 0)
+				deadlines[i] = now + POLL_INTERVAL_COUNTS;
+				// ^ Fell behind; skip the missed polls
+			activeSlots |= _BV(i);
+			}
+		mstick__deadlineEvent(i);
+		}
+	}
+
+static void accountLoad(uint16_t startCount) {
+	++loadWakeups;
+	loadBusyCounts += (uint16_t)(TCNT1 - startCount);
+	}
 
 void mstick__init(void) {
-	tickCounter = 0;
-	OCR0A = (F_CPU / 64) / 1000;
-	TCCR0A = _BV(WGM01); //count up to OCR0A
-	TIMSK0 = _BV(OCIE0A); //enable interrupt on OCR0A match
-	TCCR0B = _BV(CS01) | _BV(CS00); //start Timer0 at 1/64
+	overflowCount = 0;
+	msBase = 0;
+	msCarryCounts = 0;
+	activeSlots = 0;
+	pollUsers = 0;
+	loadWakeups = 0;
+	loadBusyCounts = 0;
+	loadStartCounts = 0;
+	TCCR1A = 0; // normal mode, counts up to 0xFFFF
+	TCNT1 = 0;
+	TIFR1 = _BV(TOV1) | _BV(OCF1A);
+	TIMSK1 = _BV(TOIE1);
+	TCCR1B = _BV(CS11) | _BV(CS10); // start Timer1 at 1/64
+	}
+
+uint16_t mstick__getTicks(void) {
+	uint16_t ticks;
+	uint32_t counts;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		uint16_t count = TCNT1;
+		ticks = msBase;
+		counts = (uint32_t)msCarryCounts + count;
+		if((TIFR1 & _BV(TOV1)) && count < 0x8000) {
+			ticks += 0x10000UL / COUNTS_PER_MS;
+			counts += 0x10000UL % COUNTS_PER_MS;
+			}
+		}
+	return ticks + counts / COUNTS_PER_MS;
+	}
+
+uint32_t mstick__getMicros(void) {
+	uint32_t counts;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		counts = nowCounts();
+		}
+	return counts * US_PER_COUNT;
+	}
+
+void mstick__scheduleAt(mstick_slot_t slot, uint32_t atUs) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		uint32_t now = nowCounts();
+		int32_t delayUs = atUs - now * US_PER_COUNT;
+		if(delayUs < 0)
+			delayUs = 0;
+		deadlines[slot] =
+			now + (delayUs + US_PER_COUNT - 1) / US_PER_COUNT;
+		activeSlots |= _BV(slot);
+		armCompare();
+		}
+	}
+
+void mstick__scheduleIn(mstick_slot_t slot, uint32_t delayUs) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		deadlines[slot] =
+			nowCounts() + (delayUs + US_PER_COUNT - 1) / US_PER_COUNT;
+		activeSlots |= _BV(slot);
+		armCompare();
+		}
+	}
+
+void mstick__cancel(mstick_slot_t slot) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		activeSlots &= ~_BV(slot);
+		armCompare();
+		}
+	}
+
+void mstick__setPolling(mstick_poll_user_t user, int enabled) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		uint8_t wasPolling = pollUsers;
+		if(enabled)
+			pollUsers |= _BV(user);
+		else
+			pollUsers &= ~_BV(user);
+		if(pollUsers && !wasPolling)
+			mstick__scheduleIn(MSTICK_SLOT_POLL, MSTICK_POLL_INTERVAL_US);
+		else if(!pollUsers)
+			mstick__cancel(MSTICK_SLOT_POLL);
+		}
+	}
+
+void mstick__takeLoad(mstick_load_t *dest) {
+	// Time spent in this module's interrupts (including the deadline
+	// handlers) since the previous call
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		uint32_t now = nowCounts();
+		dest->wakeups = loadWakeups;
+		dest->busyUs = loadBusyCounts * US_PER_COUNT;
+		dest->elapsedUs = (now - loadStartCounts) * US_PER_COUNT;
+		loadWakeups = 0;
+		loadBusyCounts = 0;
+		loadStartCounts = now;
+		}
+	}
+
+ISR(TIMER1_COMPA_vect) {
+	uint16_t startCount = TCNT1;
+	dispatchDue();
+	armCompare();
+	accountLoad(startCount);
 	}
 
-ISR(TIMER0_COMPA_vect) {
-	++tickCounter;
-	mstick__tickEvent(&tickCounter);
+ISR(TIMER1_OVF_vect) {
+	uint16_t startCount = TCNT1;
+	++overflowCount;
+	msBase += 0x10000UL / COUNTS_PER_MS;
+	msCarryCounts += 0x10000UL % COUNTS_PER_MS;
+	if(msCarryCounts >= COUNTS_PER_MS) {
+		msCarryCounts -= COUNTS_PER_MS;
+		++msBase;
+		}
+	dispatchDue();
+	armCompare();
+	accountLoad(startCount);
 	}
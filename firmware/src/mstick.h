@@ -1,7 +1,45 @@
 #pragma once
 
 
+#include <stdint.h>
+
+
+// Deadlines that can be pending at the same time, one per timed activity
+typedef enum {
+	MSTICK_SLOT_HEARTBEAT,
+	MSTICK_SLOT_WINK,
+	MSTICK_SLOT_POLL,
+	MSTICK_SLOT_RULES,
+	MSTICK_SLOT_INRUSH,
+	MSTICK_SLOT_SAMPLE,
+	MSTICK_N_SLOTS,
+	} mstick_slot_t;
+
+// Modules that need their inputs sampled every MSTICK_POLL_INTERVAL_US
+typedef enum {
+	MSTICK_POLL_RULES,
+	MSTICK_POLL_EDGECAP,
+	MSTICK_POLL_VENDORCTL,
+	MSTICK_N_POLL_USERS,
+	} mstick_poll_user_t;
+
+#define MSTICK_POLL_INTERVAL_US 1000
+
+typedef struct {
+	uint32_t wakeups;
+	uint32_t busyUs;
+	uint32_t elapsedUs;
+	} mstick_load_t;
+
+
 void mstick__init(void);
+uint16_t mstick__getTicks(void);
+uint32_t mstick__getMicros(void);
+void mstick__scheduleAt(mstick_slot_t slot, uint32_t atUs);
+void mstick__scheduleIn(mstick_slot_t slot, uint32_t delayUs);
+void mstick__cancel(mstick_slot_t slot);
+void mstick__setPolling(mstick_poll_user_t user, int enabled);
+void mstick__takeLoad(mstick_load_t *dest);
 
-void mstick__tickEvent(volatile uint16_t *tickCounter);
+void mstick__deadlineEvent(mstick_slot_t slot);
 // Application defines this
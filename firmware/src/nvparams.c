@@ -8,8 +8,46 @@
 #include "nvparams.h"
 
 
-#define EEPROM_START_OFFS 0
+// Parameters are stored as an append-only log of tagged records. The EEPROM
+// is split into two banks; records are appended to the active bank until it
+// fills up, at which point the live records are compacted into the other bank
+// and that one becomes active. Each bank starts with a header holding a
+// sequence number that identifies the most recently compacted bank. Headers
+// are written last, so an interrupted compaction leaves the previous bank in
+// charge.
+//
+// Record layout: key (1 byte), data length (1), data (n), CRC-16 over the
+// preceding bytes (2). An erased key byte marks the end of the log and a
+// zero-length record marks a key as deleted. Records are written key byte
+// last so a partially written record is never mistaken for a valid one.
 
+#define EEPROM_SIZE (E2END + 1)
+#define BANK_SIZE (EEPROM_SIZE / 2)
+#define BANK_HEADER_SIZE 4
+#define BANK_CAPACITY (BANK_SIZE - BANK_HEADER_SIZE)
+#define BANK_MAGIC 0xB5
+#define RECORD_OVERHEAD 4
+#define KEY_ERASED 0xFF
+
+// Pre-log firmware stored a bare nvparams_t (board ID + CRC) at offset 0
+#define LEGACY_OFFS 0
+#define LEGACY_DATA_LEN (BOARDID_LEN_MAX + 1)
+
+
+static uint16_t bankStart;
+static uint8_t bankSeq;
+static uint16_t logEnd;
+static uint16_t recordOffs[NVPARAMS_N_KEYS];
+// ^ 0 means no record; no record can live at offset 0 since a header does
+
+
+static inline uint8_t eeRead(uint16_t addr) {
+	return eeprom_read_byte((const uint8_t *)addr);
+	}
+
+static inline void eeWrite(uint16_t addr, uint8_t val) {
+	eeprom_update_byte((uint8_t *)addr, val);
+	}
 
 uint16_t calculateCrc(void *start, int nBytes) {
 	uint16_t crc = 0xFFFF;
@@ -18,27 +56,257 @@ uint16_t calculateCrc(void *start, int nBytes) {
 	return crc;
 	}
 
+static uint16_t calculateEepromCrc(uint16_t addr, int nBytes) {
+	uint16_t crc = 0xFFFF;
+	for(int i = 0; i < nBytes; ++i)
+		crc = _crc16_update(crc, eeRead(addr + i));
+	return crc;
+	}
+
+static inline uint8_t getRecordLen(uint16_t offs) {
+	return eeRead(offs + 1);
+	}
+
+static int readBankHeader(uint16_t start, uint8_t *seq) {
+	uint8_t header[BANK_HEADER_SIZE];
+	for(int i = 0; i < BANK_HEADER_SIZE; ++i)
+		header[i] = eeRead(start + i);
+	if(header[0] != BANK_MAGIC)
+		return -1;
+	if(calculateCrc(header, 2) != (header[2] | (header[3] << 8)))
+		return -1;
+	*seq = header[1];
+	return 0;
+	}
+
+static void writeBankHeader(uint16_t start, uint8_t seq) {
+	uint8_t header[BANK_HEADER_SIZE] = {BANK_MAGIC, seq};
+	uint16_t crc = calculateCrc(header, 2);
+	header[2] = crc & 0xFF;
+	header[3] = crc >> 8;
+	for(int i = 0; i < BANK_HEADER_SIZE; ++i)
+		eeWrite(start + i, header[i]);
+	}
+
+static void scanBank(void) {
+	uint16_t bankEnd = bankStart + BANK_SIZE;
+	uint16_t pos = bankStart + BANK_HEADER_SIZE;
+	memset(recordOffs, 0, sizeof(recordOffs));
+	while(pos + RECORD_OVERHEAD <= bankEnd) {
+		uint8_t key = eeRead(pos);
+		if(key == KEY_ERASED)
+			break;
+		uint8_t len = getRecordLen(pos);
+		if(pos + RECORD_OVERHEAD + len > bankEnd)
+			break;
+		uint16_t storedCrc =
+			eeRead(pos + 2 + len) | (eeRead(pos + 3 + len) << 8);
+		if(calculateEepromCrc(pos, 2 + len) != storedCrc)
+			break;
+			// Anything after a bad record is unreachable; it'll be
+			// overwritten by the next append
+		if(key < NVPARAMS_N_KEYS)
+			recordOffs[key] = len ? pos : 0;
+		pos += RECORD_OVERHEAD + len;
+		}
+	logEnd = pos;
+	}
+
+static uint16_t getLiveBytes(uint8_t exceptKey) {
+	uint16_t total = 0;
+	for(int key = 0; key < NVPARAMS_N_KEYS; ++key) {
+		if(recordOffs[key] && key != exceptKey)
+			total += RECORD_OVERHEAD + getRecordLen(recordOffs[key]);
+		}
+	return total;
+	}
+
+static int appendRecord(uint8_t key, const uint8_t *data, uint8_t len) {
+	uint16_t bankEnd = bankStart + BANK_SIZE;
+	uint16_t recEnd = logEnd + RECORD_OVERHEAD + len;
+	uint16_t crc = 0xFFFF;
+	if(recEnd > bankEnd)
+		return -1;
+	crc = _crc16_update(crc, key);
+	crc = _crc16_update(crc, len);
+	for(int i = 0; i < len; ++i)
+		crc = _crc16_update(crc, data[i]);
+	eeWrite(logEnd, KEY_ERASED);
+	if(recEnd < bankEnd)
+		eeWrite(recEnd, KEY_ERASED);
+	eeWrite(logEnd + 1, len);
+	for(int i = 0; i < len; ++i)
+		eeWrite(logEnd + 2 + i, data[i]);
+	eeWrite(logEnd + 2 + len, crc & 0xFF);
+	eeWrite(logEnd + 3 + len, crc >> 8);
+	eeWrite(logEnd, key);
+	recordOffs[key] = len ? logEnd : 0;
+	logEnd = recEnd;
+	return 0;
+	}
+
+static void compactLog(uint8_t dropKey) {
+	uint16_t newStart = bankStart ? 0 : BANK_SIZE;
+	uint16_t pos = newStart + BANK_HEADER_SIZE;
+	for(int key = 0; key < NVPARAMS_N_KEYS; ++key) {
+		uint16_t offs = recordOffs[key];
+		if(!offs)
+			continue;
+		if(key == dropKey) {
+			recordOffs[key] = 0;
+			continue;
+			}
+		uint8_t nBytes = RECORD_OVERHEAD + getRecordLen(offs);
+		for(int i = 0; i < nBytes; ++i)
+			eeWrite(pos + i, eeRead(offs + i));
+		recordOffs[key] = pos;
+		pos += nBytes;
+		}
+	if(pos < newStart + BANK_SIZE)
+		eeWrite(pos, KEY_ERASED);
+	writeBankHeader(newStart, bankSeq + 1);
+	bankStart = newStart;
+	bankSeq += 1;
+	logEnd = pos;
+	}
+
+static void formatLog(void) {
+	// The new log goes in the second bank, clear of the legacy blob, and
+	// its header is written last; until then the next boot migrates again
+	uint8_t legacy[LEGACY_DATA_LEN + 2];
+	int haveLegacy;
+	for(int i = 0; i < sizeof(legacy); ++i)
+		legacy[i] = eeRead(LEGACY_OFFS + i);
+	haveLegacy = calculateCrc(legacy, LEGACY_DATA_LEN)
+		== (legacy[LEGACY_DATA_LEN] | (legacy[LEGACY_DATA_LEN + 1] << 8));
+	bankStart = BANK_SIZE;
+	bankSeq = 0;
+	memset(recordOffs, 0, sizeof(recordOffs));
+	logEnd = bankStart + BANK_HEADER_SIZE;
+	eeWrite(logEnd, KEY_ERASED);
+	if(haveLegacy) {
+		legacy[BOARDID_LEN_MAX] = 0;
+		appendRecord(
+			NVKEY_BOARDID, legacy, strlen((char *)legacy));
+		}
+	writeBankHeader(bankStart, bankSeq);
+	}
+
+static void openLog(void) {
+	uint8_t seqA, seqB;
+	int haveA = !readBankHeader(0, &seqA);
+	int haveB = !readBankHeader(BANK_SIZE, &seqB);
+	if(haveA && haveB) {
+		bankStart = ((int8_t)(seqB - seqA) > 0) ? BANK_SIZE : 0;
+		bankSeq = bankStart ? seqB : seqA;
+		}
+	else if(haveA || haveB) {
+		bankStart = haveA ? 0 : BANK_SIZE;
+		bankSeq = haveA ? seqA : seqB;
+		}
+	else {
+		formatLog();
+		return;
+		}
+	scanBank();
+	}
+
+int nvparams__hasRecord(uint8_t key) {
+	if(key >= NVPARAMS_N_KEYS)
+		return 0;
+	return !!recordOffs[key];
+	}
+
+int nvparams__readRecord(uint8_t key, void *dest, uint8_t maxLen) {
+	if(!nvparams__hasRecord(key))
+		return -1;
+	uint16_t offs = recordOffs[key];
+	uint8_t len = getRecordLen(offs);
+	if(len > maxLen)
+		len = maxLen;
+	for(int i = 0; i < len; ++i)
+		((uint8_t *)dest)[i] = eeRead(offs + 2 + i);
+	return len;
+	}
+
+int nvparams__writeRecord(uint8_t key, const void *src, uint8_t len) {
+	uint16_t needed = RECORD_OVERHEAD + len;
+	uint16_t offs;
+	if(key >= NVPARAMS_N_KEYS || len > NVPARAMS_RECORD_LEN_MAX)
+		return -1;
+	if((offs = recordOffs[key]) && getRecordLen(offs) == len) {
+		int same = 1;
+		for(int i = 0; same && i < len; ++i)
+			same = eeRead(offs + 2 + i) == ((const uint8_t *)src)[i];
+		if(same)
+			return 0;
+		}
+	else if(!offs && !len) {
+		return 0;
+		}
+	if(logEnd + needed > bankStart + BANK_SIZE) {
+		// Only drop the superseded record during compaction if it has to go
+		// to make room; otherwise keep it until the new one is committed
+		if(getLiveBytes(key) + needed > BANK_CAPACITY)
+			return -1;
+		compactLog(
+			(getLiveBytes(KEY_ERASED) + needed > BANK_CAPACITY)
+				? key : KEY_ERASED
+			);
+		}
+	return appendRecord(key, src, len);
+	}
+
+int nvparams__eraseRecord(uint8_t key) {
+	return nvparams__writeRecord(key, NULL, 0);
+	}
+
+int nvparams__getFreeSpace(void) {
+	// Space superseded records take up is free too, since writing a record
+	// that doesn't fit compacts the log first
+	return BANK_CAPACITY - getLiveBytes(KEY_ERASED);
+	}
+
 void nvparams__loadDefaults(nvparams_t *dest) {
 	strncpy((char *)dest->boardId, DEFAULT_SERIALNO_STR, BOARDID_LEN_MAX);
-	dest->boardId[BOARDID_LEN_MAX - 1] = 0;
+	dest->boardId[BOARDID_LEN_MAX] = 0;
+	dest->powerOnOutputs = DEFAULT_POWERON_OUTPUTS;
+	dest->powerOnDirs = DEFAULT_POWERON_DIRS;
 	}
 
 int nvparams__load(nvparams_t *dest) {
-	nvparams_t buf;
-	eeprom_read_block(&buf, EEPROM_START_OFFS, sizeof(nvparams_t));
-	if(calculateCrc(&buf, sizeof(nvparams_t) - sizeof(uint16_t)) != buf.crc)
-		return -1;
-	*dest = buf;
-	return 0;
+	// Fields without a stored record are left as they are
+	uint8_t boardId[BOARDID_LEN_MAX + 1];
+	board_mask_t powerOn[2];
+	int result = -1;
+	int len = nvparams__readRecord(NVKEY_BOARDID, boardId, BOARDID_LEN_MAX);
+	if(len > 0) {
+		boardId[len] = 0;
+		memcpy(dest->boardId, boardId, sizeof(boardId));
+		result = 0;
+		}
+	if(nvparams__readRecord(NVKEY_POWERON, powerOn, sizeof(powerOn))
+			== sizeof(powerOn)) {
+		dest->powerOnOutputs = powerOn[0];
+		dest->powerOnDirs = powerOn[1];
+		result = 0;
+		}
+	return result;
 	}
 
 void nvparams__init(nvparams_t *dest) {
-	if(nvparams__load(dest) < 0)
-		nvparams__loadDefaults(dest);
+	openLog();
+	nvparams__loadDefaults(dest);
+	nvparams__load(dest);
 	}
 
-void nvparams__save(nvparams_t *src) {
-	src->crc =
-		calculateCrc(src, sizeof(nvparams_t) - sizeof(uint16_t));
-	eeprom_write_block(src, EEPROM_START_OFFS, sizeof(nvparams_t));
+int nvparams__save(nvparams_t *src) {
+	board_mask_t powerOn[2] = {src->powerOnOutputs, src->powerOnDirs};
+	if(nvparams__writeRecord(
+			NVKEY_BOARDID,
+			src->boardId,
+			strnlen((char *)src->boardId, BOARDID_LEN_MAX)
+			))
+		return -1;
+	return nvparams__writeRecord(NVKEY_POWERON, powerOn, sizeof(powerOn));
 	}
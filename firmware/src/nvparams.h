@@ -1,16 +1,41 @@
 #pragma once
 
 
+#include <stdint.h>
+
+#include "board.h"
+
+
 #define BOARDID_LEN_MAX 16
 
+// Record keys index a RAM table, so keep them dense and below this limit
+#define NVPARAMS_N_KEYS 40
+#define NVPARAMS_RECORD_LEN_MAX 64
+
+
+typedef enum {
+	NVKEY_BOARDID = 1,
+	NVKEY_POWERON = 2,
+	NVKEY_PRESET_FIRST = 8,
+	// ...one key per preset, see presets.h
+	NVKEY_RULE_FIRST = 28,
+	// ...one key per rule, see rules.h
+	} nvparams_key_t;
 
 typedef struct {
 	uint8_t boardId[BOARDID_LEN_MAX + 1];
-	uint16_t crc;
+	board_mask_t powerOnOutputs;
+	board_mask_t powerOnDirs;
 	} nvparams_t;
 
 
 void nvparams__loadDefaults(nvparams_t *dest);
 int nvparams__load(nvparams_t *dest);
 void nvparams__init(nvparams_t *dest);
-void nvparams__save(nvparams_t *src);
+int nvparams__save(nvparams_t *src);
+int nvparams__readRecord(uint8_t key, void *dest, uint8_t maxLen);
+int nvparams__writeRecord(uint8_t key, const void *src, uint8_t len);
+int nvparams__eraseRecord(uint8_t key);
+int nvparams__hasRecord(uint8_t key);
+int nvparams__getFreeSpace(void);
+// ^ Bytes left for new records, each of which also takes 4 bytes overhead
@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include "mstick.h"
+#include "powersave.h"
+
+
+// Puts the CPU in idle sleep between main loop passes that have nothing to
+// do. Anything that can give the main loop work comes with an interrupt:
+// received bytes (the CDC OUT endpoint's interrupt), USB start-of-frame
+// (every 1 ms while configured), other USB events, timer deadlines and pin
+// changes. Idle mode keeps the clocks to the timers and the USB controller
+// running.
+//
+// Once woken, the main loop handles received commands in the pass it was
+// woken for, or the next one if it was already busy. So a command waits at
+// most one pass after its last byte reaches the board. Passes aren't
+// bounded (an EEPROM write alone takes milliseconds), so what's reported is
+// the longest pass seen since reset, not a guarantee.
+
+static uint32_t passStartUs;
+static uint32_t maxPassUs;
+static uint32_t periodStartUs;
+static uint32_t wakeups;
+static uint32_t asleepUs;
+
+
+void powersave__init(void) {
+	passStartUs = periodStartUs = mstick__getMicros();
+	maxPassUs = 0;
+	wakeups = 0;
+	asleepUs = 0;
+	}
+
+void powersave__endPass(int idle) {
+	// Call with interrupts disabled, so that nothing can hand the main loop
+	// work between deciding it's idle and going to sleep. Returns with
+	// interrupts enabled.
+	uint32_t nowUs = mstick__getMicros();
+	if(nowUs - passStartUs > maxPassUs)
+		maxPassUs = nowUs - passStartUs;
+	if(idle) {
+		uint32_t sleepStartUs = nowUs;
+		set_sleep_mode(SLEEP_MODE_IDLE);
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		// ^ sei() takes effect after the next instruction, so an interrupt
+		// that's already pending wakes the CPU straight back up
+		sleep_disable();
+		cli();
+		nowUs = mstick__getMicros();
+		asleepUs += nowUs - sleepStartUs;
+		// ^ Includes the interrupt that woke the CPU up
+		++wakeups;
+		}
+	passStartUs = nowUs;
+	sei();
+	}
+
+void powersave__takeStats(powersave_stats_t *dest) {
+	// The counters are only touched by the main loop
+	uint32_t nowUs = mstick__getMicros();
+	dest->wakeups = wakeups;
+	dest->asleepUs = asleepUs;
+	dest->elapsedUs = nowUs - periodStartUs;
+	dest->maxPassUs = maxPassUs;
+	wakeups = 0;
+	asleepUs = 0;
+	periodStartUs = nowUs;
+	}
+
+uint32_t powersave__getMaxObservedLatencyUs(void) {
+	return maxPassUs;
+	}
@@ -0,0 +1,20 @@
+#pragma once
+
+
+#include <stdint.h>
+
+
+typedef struct {
+	uint32_t wakeups;
+	uint32_t asleepUs;
+	uint32_t elapsedUs;
+	// ^ Since the previous powersave__takeStats() call
+	uint32_t maxPassUs;
+	// ^ Longest main loop pass seen since reset
+	} powersave_stats_t;
+
+
+void powersave__init(void);
+void powersave__endPass(int idle);
+void powersave__takeStats(powersave_stats_t *dest);
+uint32_t powersave__getMaxObservedLatencyUs(void);
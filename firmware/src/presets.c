@@ -0,0 +1,78 @@
+#include <stdint.h>
+#include <util/atomic.h>
+
+#include "gpio.h"
+#include "inrush.h"
+#include "nvparams.h"
+#include "presets.h"
+
+
+// Each preset is stored as its own nonvolatile record holding a mask of the
+// terminals it affects followed by their states (terminal bitmasks). The
+// records are mirrored in RAM, because presets are also recalled from the
+// vendor interface's interrupt handler, which mustn't touch the EEPROM while
+// the main loop may be in the middle of writing it.
+
+#define PRESET_KEY(presetNo) (NVKEY_PRESET_FIRST + (presetNo) - 1)
+
+
+static board_mask_t presetRecords[PRESETS_N][2];
+// ^ A zero mask means the preset is undefined
+
+
+static inline int isValidPresetNo(uint8_t presetNo) {
+	return presetNo >= 1 && presetNo <= PRESETS_N;
+	}
+
+static void setCached(
+		uint8_t presetNo, board_mask_t mask, board_mask_t values) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		presetRecords[presetNo - 1][0] = mask;
+		presetRecords[presetNo - 1][1] = values;
+		}
+	}
+
+void presets__init(void) {
+	board_mask_t record[2];
+	for(uint8_t i = 1; i <= PRESETS_N; ++i) {
+		if(nvparams__readRecord(PRESET_KEY(i), record, sizeof(record))
+				!= sizeof(record))
+			record[0] = record[1] = 0;
+		setCached(i, record[0], record[1] & record[0]);
+		}
+	}
+
+int presets__define(uint8_t presetNo, board_mask_t mask, board_mask_t values) {
+	board_mask_t record[2] = {mask, values & mask};
+	if(!isValidPresetNo(presetNo))
+		return -1;
+	if(mask & ~gpio__getOutputCapMask())
+		return -1;
+	if(mask ? nvparams__writeRecord(
+			PRESET_KEY(presetNo), record, sizeof(record))
+			: nvparams__eraseRecord(PRESET_KEY(presetNo)))
+		return -1;
+	setCached(presetNo, record[0], record[1]);
+	return 0;
+	}
+
+int presets__get(uint8_t presetNo, board_mask_t *mask, board_mask_t *values) {
+	if(!isValidPresetNo(presetNo))
+		return -1;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		*mask = presetRecords[presetNo - 1][0];
+		*values = presetRecords[presetNo - 1][1];
+		}
+	return *mask ? 0 : -1;
+	}
+
+int presets__isDefined(uint8_t presetNo) {
+	return isValidPresetNo(presetNo) && presetRecords[presetNo - 1][0];
+	}
+
+int presets__recall(uint8_t presetNo) {
+	board_mask_t mask, values;
+	if(presets__get(presetNo, &mask, &values))
+		return -1;
+	return inrush__applyOutputs(mask, values);
+	}
@@ -0,0 +1,17 @@
+#pragma once
+
+
+#include <stdint.h>
+
+#include "board.h"
+
+
+// Presets are numbered from 1
+#define PRESETS_N 20
+
+
+void presets__init(void);
+int presets__define(uint8_t presetNo, board_mask_t mask, board_mask_t values);
+int presets__get(uint8_t presetNo, board_mask_t *mask, board_mask_t *values);
+int presets__isDefined(uint8_t presetNo);
+int presets__recall(uint8_t presetNo);
@@ -0,0 +1,261 @@
+#include <stdint.h>
+#include <string.h>
+#include <util/atomic.h>
+
+#include "gpio.h"
+#include "mstick.h"
+#include "nvparams.h"
+#include "rules.h"
+
+
+// Rules are evaluated from interrupt context: on every pin change interrupt
+// (terminals on port B), and every ms while any rule watches an input
+// without a pin change interrupt or has a level trigger. Pulses end on their
+// own deadline. Everything that needs the terminal table is worked out when
+// a rule is defined, so each evaluation is a single input read followed by
+// at most RULES_N constant time rule checks.
+
+#define RULE_KEY(ruleNo) (NVKEY_RULE_FIRST + (ruleNo) - 1)
+
+
+typedef struct {
+	rules_rule_t def;
+	board_mask_t inputBm;
+	gpio_port_masks_t outputPortMasks;
+	uint32_t pulseEndUs;
+	uint8_t pulseActive;
+	} rule_state_t;
+
+
+static rule_state_t rules[RULES_N];
+static uint8_t ruleDefined[RULES_N];
+static volatile board_mask_t prevInputs;
+static volatile uint16_t maxObservedEvalUs;
+// ^ Longest evaluate() seen since reset, from start to end of the function;
+// the wait before the interrupt gets to run isn't in it
+
+
+static inline int isValidRuleNo(uint8_t ruleNo) {
+	return ruleNo >= 1 && ruleNo <= RULES_N;
+	}
+
+static void updateChangeIrqs(void) {
+	board_mask_t inputMask = 0;
+	int levelTriggered = 0;
+	for(int i = 0; i < RULES_N; ++i) {
+		if(ruleDefined[i] && rules[i].def.enabled) {
+			inputMask |= rules[i].inputBm;
+			if(rules[i].def.trigger == RULE_TRIG_LOW
+					|| rules[i].def.trigger == RULE_TRIG_HIGH)
+				levelTriggered = 1;
+			}
+		}
+	board_mask_t covered = gpio__setChangeIrqMask(GPIO_IRQ_RULES, inputMask);
+	mstick__setPolling(
+		MSTICK_POLL_RULES, levelTriggered || (inputMask & ~covered));
+	}
+
+static void schedulePulseEnd(void) {
+	uint32_t now = mstick__getMicros();
+	int32_t soonest = INT32_MAX;
+	for(int i = 0; i < RULES_N; ++i) {
+		int32_t remaining = rules[i].pulseEndUs - now;
+		if(rules[i].pulseActive && remaining < soonest)
+			soonest = remaining;
+		}
+	if(soonest == INT32_MAX)
+		mstick__cancel(MSTICK_SLOT_RULES);
+	else
+		mstick__scheduleAt(MSTICK_SLOT_RULES, now + soonest);
+	}
+
+static void endPulse(rule_state_t *rule) {
+	if(rule->pulseActive) {
+		gpio__clearPortMasks(&rule->outputPortMasks);
+		rule->pulseActive = 0;
+		}
+	}
+
+static void fireRule(rule_state_t *rule) {
+	switch(rule->def.action) {
+		case RULE_ACTION_SET:
+			gpio__setPortMasks(&rule->outputPortMasks);
+			break;
+		case RULE_ACTION_CLEAR:
+			gpio__clearPortMasks(&rule->outputPortMasks);
+			break;
+		case RULE_ACTION_PULSE:
+			gpio__setPortMasks(&rule->outputPortMasks);
+			rule->pulseEndUs =
+				mstick__getMicros() + rule->def.pulseMs * 1000UL;
+			rule->pulseActive = 1;
+			schedulePulseEnd();
+			break;
+		}
+	}
+
+static void evaluate(void) {
+	uint32_t startUs = mstick__getMicros();
+	board_mask_t inputs = gpio__readInputs();
+	board_mask_t changed = inputs ^ prevInputs;
+	prevInputs = inputs;
+	for(int i = 0; i < RULES_N; ++i) {
+		rule_state_t *rule = &rules[i];
+		int level, edge, fire = 0;
+		if(!ruleDefined[i] || !rule->def.enabled)
+			continue;
+		level = !!(inputs & rule->inputBm);
+		edge = !!(changed & rule->inputBm);
+		switch(rule->def.trigger) {
+			case RULE_TRIG_LOW:
+				fire = !level;
+				break;
+			case RULE_TRIG_HIGH:
+				fire = level;
+				break;
+			case RULE_TRIG_RISING:
+				fire = edge && level;
+				break;
+			case RULE_TRIG_FALLING:
+				fire = edge && !level;
+				break;
+			case RULE_TRIG_EDGE:
+				fire = edge;
+				break;
+			}
+		if(fire)
+			fireRule(rule);
+		}
+	uint16_t evalTimeUs = mstick__getMicros() - startUs;
+	if(evalTimeUs > maxObservedEvalUs)
+		maxObservedEvalUs = evalTimeUs;
+	}
+
+void rules__onInputChange(void) {
+	evaluate();
+	}
+
+void rules__onPoll(void) {
+	evaluate();
+	}
+
+void rules__onPulseDeadline(void) {
+	uint32_t now = mstick__getMicros();
+	for(int i = 0; i < RULES_N; ++i) {
+		rule_state_t *rule = &rules[i];
+		if((int32_t)(rule->pulseEndUs - now) <= 0)
+			endPulse(rule);
+		}
+	schedulePulseEnd();
+	}
+
+int rules__define(uint8_t ruleNo, const rules_rule_t *rule) {
+	// A rule with input terminal 0 clears the slot. Replacing or clearing a
+	// rule ends its pulse, if one is running, rather than leaving the
+	// outputs on with nothing left to turn them off.
+	rule_state_t state = {.def = *rule};
+	if(!isValidRuleNo(ruleNo))
+		return -1;
+	if(!rule->inputTerminalNo) {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			ruleDefined[ruleNo - 1] = 0;
+			endPulse(&rules[ruleNo - 1]);
+			schedulePulseEnd();
+			}
+		updateChangeIrqs();
+		return 0;
+		}
+	if(rule->inputTerminalNo > BOARD_TERMINAL_NO_MAX
+			|| rule->trigger > RULE_TRIG_EDGE
+			|| rule->action > RULE_ACTION_PULSE)
+		return -1;
+	if(rule->action == RULE_ACTION_PULSE && rule->trigger <= RULE_TRIG_HIGH)
+		return -1;
+		// A level trigger fires on every poll, which would restart the
+		// pulse each time so that it never ended
+	state.inputBm = GPIO_TERMINAL_BM(rule->inputTerminalNo);
+	if(!(state.inputBm & gpio__getInputCapMask()))
+		return -1;
+	if(!rule->outputMask
+			|| gpio__getPortMasks(&state.outputPortMasks, rule->outputMask))
+		return -1;
+	state.def.enabled = !!rule->enabled;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		endPulse(&rules[ruleNo - 1]);
+		rules[ruleNo - 1] = state;
+		ruleDefined[ruleNo - 1] = 1;
+		schedulePulseEnd();
+		}
+	updateChangeIrqs();
+	return 0;
+	}
+
+int rules__get(uint8_t ruleNo, rules_rule_t *dest) {
+	if(!rules__isDefined(ruleNo))
+		return -1;
+	*dest = rules[ruleNo - 1].def;
+	return 0;
+	}
+
+int rules__isDefined(uint8_t ruleNo) {
+	return isValidRuleNo(ruleNo) && ruleDefined[ruleNo - 1];
+	}
+
+int rules__setEnabled(uint8_t ruleNo, int enabled) {
+	if(!rules__isDefined(ruleNo))
+		return -1;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		rules[ruleNo - 1].def.enabled = !!enabled;
+		prevInputs = gpio__readInputs();
+		// ^ so that a newly enabled edge rule doesn't see a stale edge
+		}
+	updateChangeIrqs();
+	return 0;
+	}
+
+void rules__clearAll(void) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		memset(ruleDefined, 0, sizeof(ruleDefined));
+		for(int i = 0; i < RULES_N; ++i)
+			endPulse(&rules[i]);
+		schedulePulseEnd();
+		}
+	updateChangeIrqs();
+	}
+
+void rules__loadSaved(void) {
+	rules__clearAll();
+	for(int ruleNo = 1; ruleNo <= RULES_N; ++ruleNo) {
+		rules_rule_t rule;
+		if(nvparams__readRecord(RULE_KEY(ruleNo), &rule, sizeof(rule))
+				== sizeof(rule))
+			rules__define(ruleNo, &rule);
+		}
+	}
+
+int rules__save(void) {
+	int result = 0;
+	for(int ruleNo = 1; ruleNo <= RULES_N; ++ruleNo) {
+		rules_rule_t rule;
+		if(!rules__get(ruleNo, &rule))
+			result |= nvparams__writeRecord(
+				RULE_KEY(ruleNo), &rule, sizeof(rule));
+		else
+			result |= nvparams__eraseRecord(RULE_KEY(ruleNo));
+		}
+	return result;
+	}
+
+uint16_t rules__getMaxObservedEvalUs(void) {
+	uint16_t result;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		result = maxObservedEvalUs;
+		}
+	return result;
+	}
+
+void rules__init(void) {
+	prevInputs = gpio__readInputs();
+	maxObservedEvalUs = 0;
+	rules__loadSaved();
+	}
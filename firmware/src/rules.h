@@ -0,0 +1,48 @@
+#pragma once
+
+
+#include <stdint.h>
+
+#include "board.h"
+
+
+// Rules are numbered from 1
+#define RULES_N 8
+
+
+typedef enum {
+	RULE_TRIG_LOW = 0,
+	RULE_TRIG_HIGH = 1,
+	RULE_TRIG_RISING = 2,
+	RULE_TRIG_FALLING = 3,
+	RULE_TRIG_EDGE = 4,
+	} rules_trigger_t;
+
+typedef enum {
+	RULE_ACTION_SET = 0,
+	RULE_ACTION_CLEAR = 1,
+	RULE_ACTION_PULSE = 2,
+	} rules_action_t;
+
+typedef struct {
+	uint8_t inputTerminalNo;
+	uint8_t trigger;
+	uint8_t action;
+	board_mask_t outputMask;
+	uint16_t pulseMs;
+	uint8_t enabled;
+	} rules_rule_t;
+
+
+void rules__init(void);
+int rules__define(uint8_t ruleNo, const rules_rule_t *rule);
+int rules__get(uint8_t ruleNo, rules_rule_t *dest);
+int rules__isDefined(uint8_t ruleNo);
+int rules__setEnabled(uint8_t ruleNo, int enabled);
+void rules__clearAll(void);
+void rules__loadSaved(void);
+int rules__save(void);
+uint16_t rules__getMaxObservedEvalUs(void);
+void rules__onInputChange(void);
+void rules__onPoll(void);
+void rules__onPulseDeadline(void);
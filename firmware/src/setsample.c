@@ -0,0 +1,63 @@
+#include <stdint.h>
+
+#include "gpio.h"
+#include "inrush.h"
+#include "mstick.h"
+#include "setsample.h"
+
+
+// Applies an output change, then samples every input once a given delay
+// has passed. The sample is taken in the timer interrupt, so its timing
+// doesn't depend on what the main loop is doing. Turn-ons held back by the
+// inrush limiter happen later than the change itself, which is where the
+// delay is measured from.
+
+typedef enum {
+	STATE_IDLE,
+	STATE_WAITING,
+	STATE_DONE,
+	} setsample_state_t;
+
+static volatile setsample_state_t state;
+static uint32_t startUs;
+static setsample_result_t result;
+
+
+void setsample__init(void) {
+	state = STATE_IDLE;
+	}
+
+int setsample__start(
+		board_mask_t mask, board_mask_t values, uint32_t delayUs) {
+	if(state != STATE_IDLE)
+		return -1;
+	if(inrush__applyOutputs(mask, values))
+		return -1;
+	startUs = mstick__getMicros();
+	state = STATE_WAITING;
+	mstick__scheduleAt(MSTICK_SLOT_SAMPLE, startUs + delayUs);
+	return 0;
+	}
+
+int setsample__isBusy(void) {
+	return state != STATE_IDLE;
+	}
+
+int setsample__isDone(void) {
+	return state == STATE_DONE;
+	}
+
+int setsample__takeResult(setsample_result_t *dest) {
+	// Returns -1 until the sample has been taken
+	if(state != STATE_DONE)
+		return -1;
+	*dest = result;
+	state = STATE_IDLE;
+	return 0;
+	}
+
+void setsample__onDeadline(void) {
+	result.inputs = gpio__readInputs();
+	result.elapsedUs = mstick__getMicros() - startUs;
+	state = STATE_DONE;
+	}
@@ -0,0 +1,22 @@
+#pragma once
+
+
+#include <stdint.h>
+
+#include "board.h"
+
+
+typedef struct {
+	board_mask_t inputs;
+	uint32_t elapsedUs;
+	// ^ From applying the outputs to reading the inputs
+	} setsample_result_t;
+
+
+void setsample__init(void);
+int setsample__start(
+	board_mask_t mask, board_mask_t values, uint32_t delayUs);
+int setsample__isBusy(void);
+int setsample__isDone(void);
+int setsample__takeResult(setsample_result_t *dest);
+void setsample__onDeadline(void);
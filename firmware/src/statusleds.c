@@ -1,5 +1,9 @@
 #include <stdint.h>
 #include <avr/io.h>
+#include <util/atomic.h>
+
+#include "mstick.h"
+#include "statusleds.h"
 
 
 #define LED_HBT_PORT PORTD
@@ -9,24 +13,28 @@
 #define LED_USB_DDR DDRB
 #define LED_USB_BM _BV(PB0)
 
-#define HEARTBEAT_HALFPERIOD_MS 500
-#define WINK_DURATION_MS 60
-#define WINK_RECOVERY_MS 40
+#define HEARTBEAT_HALFPERIOD_US 500000UL
+#define WINK_DURATION_US 60000UL
+#define WINK_RECOVERY_US 40000UL
+
+
+// The heartbeat deadline only raises a flag; the LED is toggled from the
+// main loop, so the heartbeat stops if the main loop gets stuck. A wink
+// blanks the USB LED and then holds off the next wink for a recovery time
+// so that a burst of commands still shows up as blinking.
 
+typedef enum {
+	WINK_IDLE,
+	WINK_BLANK,
+	WINK_RECOVERY,
+	} wink_state_t;
 
-volatile uint16_t currentTick;
-volatile uint16_t lastHbtChangeTick;
-volatile uint16_t winkStartTick;
-volatile struct {
-	unsigned int winking :1;
-	unsigned int winkCooldown :1;
-	unsigned int hbt :1;
-	} volFlags;
-struct {
-	unsigned int usbLedSetting :1;
-	unsigned int hbtAck :1;
-	unsigned int startWink :1;
-	} flags;
+
+static uint32_t nextHbtUs;
+static volatile uint8_t hbtDue;
+static volatile uint8_t winkState;
+static volatile uint8_t winkRequested;
+static volatile uint8_t usbLedSetting;
 
 
 inline void setHbtLed(int on) {
@@ -51,18 +59,23 @@ inline void setUsbLed(int on) {
 		}
 	}
 
+static void startWink(void) {
+	setUsbLed(0);
+	winkState = WINK_BLANK;
+	mstick__scheduleIn(MSTICK_SLOT_WINK, WINK_DURATION_US);
+	}
+
 void statusleds__init(void) {
 	setHbtLed(0);
 	setUsbLed(0);
 	LED_HBT_DDR |= LED_HBT_BM;
 	LED_USB_DDR |= LED_USB_BM;
-	lastHbtChangeTick = 0;
-	volFlags.winking = 0;
-	volFlags.winkCooldown = 0;
-	volFlags.hbt = 0;
-	flags.usbLedSetting = 0;
-	flags.hbtAck = 0;
-	flags.startWink = 0;
+	hbtDue = 0;
+	winkState = WINK_IDLE;
+	winkRequested = 0;
+	usbLedSetting = 0;
+	nextHbtUs = mstick__getMicros() + HEARTBEAT_HALFPERIOD_US;
+	mstick__scheduleAt(MSTICK_SLOT_HEARTBEAT, nextHbtUs);
 	}
 
 void statusleds__setHbtLed(int on) {
@@ -70,53 +83,47 @@ void statusleds__setHbtLed(int on) {
 	}
 
 void statusleds__setUsbLed(int on) {
-	flags.usbLedSetting = !!on;
+	usbLedSetting = !!on;
 	setUsbLed(on);
 	}
 
 void statusleds__winkUsbLed(void) {
-	flags.startWink = 1;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if(winkState == WINK_IDLE)
+			startWink();
+		else
+			winkRequested = 1;
+		}
 	}
 
-void statusleds__onMsTick(volatile uint16_t *msCounter) {
-	currentTick = *msCounter;
-	if(flags.hbtAck) {
-		volFlags.hbt = 0;
-		}
-	else if(currentTick - lastHbtChangeTick >= HEARTBEAT_HALFPERIOD_MS) {
-		volFlags.hbt = 1;
-		lastHbtChangeTick = currentTick;
-		}
-	if(volFlags.winkCooldown) {
-		if(currentTick - winkStartTick >= WINK_DURATION_MS + WINK_RECOVERY_MS) {
-			volFlags.winking = 0;
-			volFlags.winkCooldown = 0;
-			}
+void statusleds__onHeartbeatDeadline(void) {
+	hbtDue = 1;
+	nextHbtUs += HEARTBEAT_HALFPERIOD_US;
+	mstick__scheduleAt(MSTICK_SLOT_HEARTBEAT, nextHbtUs);
+	}
+
+void statusleds__onWinkDeadline(void) {
+	if(winkState == WINK_BLANK) {
+		setUsbLed(usbLedSetting);
+		winkState = WINK_RECOVERY;
+		mstick__scheduleIn(MSTICK_SLOT_WINK, WINK_RECOVERY_US);
 		}
-	else if(volFlags.winking) {
-		if(currentTick - winkStartTick >= WINK_DURATION_MS) {
-			setUsbLed(flags.usbLedSetting);
-			volFlags.winkCooldown = 1;
-			}
+	else if(winkRequested) {
+		winkRequested = 0;
+		startWink();
 		}
-	else if(flags.startWink) {
-		winkStartTick = currentTick;
-		setUsbLed(0);
-		volFlags.winking = 1;
+	else {
+		winkState = WINK_IDLE;
 		}
 	}
 
 void statusleds__task(void) {
-	if(flags.hbtAck) {
-		if(!volFlags.hbt)
-			flags.hbtAck = 0;
-		}
-	else if(volFlags.hbt) {
+	if(hbtDue) {
 		toggleHbtLed();
-		flags.hbtAck = 1;
+		hbtDue = 0;
 		}
-	if(flags.startWink) {
-		if(volFlags.winking)
-			flags.startWink = 0;
-		}
-	}
\ No newline at end of file
+	}
+
+int statusleds__hasWork(void) {
+	return hbtDue;
+	}
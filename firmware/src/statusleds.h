@@ -8,5 +8,7 @@ void statusleds__init(void);
 void statusleds__setHbtLed(int on);
 void statusleds__setUsbLed(int on);
 void statusleds__winkUsbLed(void);
-void statusleds__onMsTick(volatile uint16_t *msCounter);
+void statusleds__onHeartbeatDeadline(void);
+void statusleds__onWinkDeadline(void);
 void statusleds__task(void);
+int statusleds__hasWork(void);
@@ -0,0 +1,121 @@
+#include <stdint.h>
+#include <util/atomic.h>
+
+#include "gpio.h"
+#include "syncout.h"
+
+
+// A board is armed with the output states to apply and a trigger terminal.
+// If the trigger terminal is an input, the update is committed from the pin
+// change interrupt on the chosen edge, so every board wired to the same
+// trigger line switches within a few microseconds of the edge. If it's an
+// output, the board is the master: arming parks the trigger at its idle
+// level and FIR drives the edge in the same port write that commits the
+// board's own outputs.
+//
+// The port masks are worked out when arming so that firing is a single
+// gpio__writePortMasks() call.
+
+static volatile uint8_t state;
+static syncout_status_t armed;
+static gpio_port_masks_t commitMask, commitValues;
+static uint8_t triggerIsOutput;
+static const volatile uint8_t *triggerReg;
+static uint8_t triggerBm;
+static uint8_t triggerLevel;
+
+
+static void commit(void) {
+	gpio__writePortMasks(&commitMask, &commitValues);
+	state = SYNCOUT_FIRED;
+	}
+
+void syncout__init(void) {
+	state = SYNCOUT_IDLE;
+	}
+
+void syncout__disarm(void) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if(state == SYNCOUT_ARMED)
+			state = SYNCOUT_IDLE;
+		}
+	gpio__setChangeIrqMask(GPIO_IRQ_SYNCOUT, 0);
+	}
+
+int syncout__arm(
+		board_mask_t mask, board_mask_t values, uint8_t triggerTerminalNo,
+		uint8_t edge) {
+	board_mask_t triggerTermBm = GPIO_TERMINAL_BM(triggerTerminalNo);
+	int dir = gpio__getDirection(triggerTerminalNo);
+	if(dir < 0 || dir == DIR_ANALOG || edge > SYNCOUT_EDGE_RISING
+			|| (mask & triggerTermBm))
+		return -1;
+		// ^ An analog terminal's digital input buffer is off
+	syncout__disarm();
+	if(dir == DIR_OUT) {
+		// Commit the edge along with the outputs
+		if(gpio__getPortMasks(&commitMask, mask | triggerTermBm))
+			return -1;
+		gpio__getPortMasks(
+			&commitValues,
+			(values & mask) | (edge ? triggerTermBm : 0)
+			);
+		gpio__setOutput(triggerTerminalNo, !edge);
+		triggerIsOutput = 1;
+		}
+	else {
+		if(gpio__getPortMasks(&commitMask, mask))
+			return -1;
+		gpio__getPortMasks(&commitValues, values & mask);
+		if(gpio__getInputRef(triggerTerminalNo, &triggerReg, &triggerBm))
+			return -1;
+		triggerIsOutput = 0;
+		}
+	armed.mask = mask;
+	armed.values = values & mask;
+	armed.triggerTerminalNo = triggerTerminalNo;
+	armed.edge = edge;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if(!triggerIsOutput)
+			triggerLevel = !!(*triggerReg & triggerBm);
+		state = SYNCOUT_ARMED;
+		}
+	if(!triggerIsOutput && !(
+			gpio__setChangeIrqMask(GPIO_IRQ_SYNCOUT, triggerTermBm)
+			& triggerTermBm)) {
+		// No pin change interrupt on this terminal
+		syncout__disarm();
+		return -1;
+		}
+	return 0;
+	}
+
+int syncout__fire(void) {
+	// Commits now; on the master this also produces the trigger edge
+	int result = -1;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if(state == SYNCOUT_ARMED) {
+			commit();
+			result = 0;
+			}
+		}
+	if(!result)
+		gpio__setChangeIrqMask(GPIO_IRQ_SYNCOUT, 0);
+	return result;
+	}
+
+void syncout__getStatus(syncout_status_t *dest) {
+	*dest = armed;
+	dest->state = state;
+	}
+
+void syncout__onInputChange(void) {
+	// Called from the pin change interrupt, ahead of anything else
+	uint8_t level;
+	if(state != SYNCOUT_ARMED || triggerIsOutput)
+		return;
+	level = !!(*triggerReg & triggerBm);
+	if(level != triggerLevel && level == armed.edge)
+		commit();
+	triggerLevel = level;
+	}
@@ -0,0 +1,40 @@
+#pragma once
+
+
+#include <stdint.h>
+
+#include "board.h"
+
+
+// Armed output updates: a pending set of output states is committed on an
+// edge of a trigger terminal, so that several boards sharing a trigger line
+// switch together. See syncout.c.
+
+typedef enum {
+	SYNCOUT_IDLE = 0,
+	SYNCOUT_ARMED = 1,
+	SYNCOUT_FIRED = 2,
+	} syncout_state_t;
+
+typedef enum {
+	SYNCOUT_EDGE_FALLING = 0,
+	SYNCOUT_EDGE_RISING = 1,
+	} syncout_edge_t;
+
+typedef struct {
+	uint8_t state;
+	board_mask_t mask;
+	board_mask_t values;
+	uint8_t triggerTerminalNo;
+	uint8_t edge;
+	} syncout_status_t;
+
+
+void syncout__init(void);
+int syncout__arm(
+	board_mask_t mask, board_mask_t values, uint8_t triggerTerminalNo,
+	uint8_t edge);
+void syncout__disarm(void);
+int syncout__fire(void);
+void syncout__getStatus(syncout_status_t *dest);
+void syncout__onInputChange(void);
@@ -1,3 +1,8 @@
+#include <string.h>
+
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
 #include <LUFA/Drivers/USB/USB.h>
 
 #include "statusleds.h"
@@ -26,7 +31,74 @@ USB_ClassInfo_CDC_Device_t cdcInterface = {
 		},
 	};
 
+// Host-to-device bytes are moved out of the OUT endpoint into this ring by
+// the endpoint's own receive interrupt as soon as a packet is in, however
+// long the main loop takes to come back around. The indices are single
+// bytes, so each side can read the other's without locking.
+static volatile uint8_t rxRing[RX_RING_SIZE];
+static volatile uint8_t rxHead;
+static volatile uint8_t rxTail;
+
+// Reports waiting to go out on the vendor interrupt IN endpoint
+static uint8_t vendorTxQueue[VENDOR_TX_QUEUE_LEN][VENDOR_EP_SIZE];
+static volatile uint8_t vendorTxHead;
+static volatile uint8_t vendorTxCount;
+
+
+static void serviceDataOutEndpoint(void) {
+	// Runs in interrupt context, possibly while the main loop has another
+	// endpoint selected
+	uint8_t prevEndpoint = Endpoint_GetCurrentEndpoint();
+	Endpoint_SelectEndpoint(cdcInterface.Config.DataOUTEndpoint.Address);
+	if(Endpoint_IsOUTReceived()) {
+		while(Endpoint_BytesInEndpoint()) {
+			uint8_t next = (rxHead + 1) & (RX_RING_SIZE - 1);
+			if(next == rxTail)
+				break;
+				// Ring is full; leave the rest in the bank (NAKing the host)
+				// until the main loop catches up
+			rxRing[rxHead] = Endpoint_Read_8();
+			rxHead = next;
+			}
+		if(!Endpoint_BytesInEndpoint()) {
+			Endpoint_ClearOUT();
+			UEIENX |= _BV(RXOUTE);
+			}
+		else {
+			UEIENX &= ~_BV(RXOUTE);
+			// ^ The flag stays set until the bank is emptied, so the
+			// interrupt would fire back to back; the start-of-frame event
+			// picks up the rest once the ring has room
+			}
+		}
+	Endpoint_SelectEndpoint(prevEndpoint);
+	}
 
+static void serviceVendorEndpoints(void) {
+	uint8_t prevEndpoint = Endpoint_GetCurrentEndpoint();
+	uint8_t report[VENDOR_EP_SIZE];
+	Endpoint_SelectEndpoint(VOUT_EP_ADDR);
+	if(vendorTxCount < VENDOR_TX_QUEUE_LEN && Endpoint_IsOUTReceived()) {
+		// A request is only taken once there's room for its reply; until
+		// then the host gets NAKed
+		uint8_t nBytes = Endpoint_BytesInEndpoint();
+		for(int i = 0; i < VENDOR_EP_SIZE; ++i)
+			report[i] = (i < nBytes) ? Endpoint_Read_8() : 0;
+		Endpoint_ClearOUT();
+		if(nBytes)
+			usbcdc__vendorReportEvent(report);
+		}
+	Endpoint_SelectEndpoint(VIN_EP_ADDR);
+	if(vendorTxCount && Endpoint_IsINReady()) {
+		uint8_t tail = (vendorTxHead + VENDOR_TX_QUEUE_LEN - vendorTxCount)
+			% VENDOR_TX_QUEUE_LEN;
+		for(int i = 0; i < VENDOR_EP_SIZE; ++i)
+			Endpoint_Write_8(vendorTxQueue[tail][i]);
+		Endpoint_ClearIN();
+		vendorTxCount -= 1;
+		}
+	Endpoint_SelectEndpoint(prevEndpoint);
+	}
 
 void usbcdc__init(const char *serNo) {
 	usbcdc__initSerialNo(serNo);
@@ -35,7 +107,8 @@ void usbcdc__init(const char *serNo) {
 	}
 
 void usbcdc__task(void) {
-	USB_USBTask();
+	// Control requests and received data are handled from the endpoint
+	// interrupt, so all that's left here is flushing pending IN data
 	CDC_Device_USBTask(&cdcInterface);
 	}
 
@@ -44,11 +117,16 @@ void usbcdc__detach(void) {
 	}
 
 int usbcdc__hasInputWaiting(void) {
-	return !!CDC_Device_BytesReceived(&cdcInterface);
+	return rxHead != rxTail;
 	}
 
 int16_t usbcdc__getNextInputChar(void) {
-	return CDC_Device_ReceiveByte(&cdcInterface);
+	uint8_t ch;
+	if(rxHead == rxTail)
+		return -1;
+	ch = rxRing[rxTail];
+	rxTail = (rxTail + 1) & (RX_RING_SIZE - 1);
+	return ch;
 	}
 
 void usbcdc__sendString(const char *str) {
@@ -60,21 +138,97 @@ void usbcdc__sendStringNoFlush(const char *str) {
 	CDC_Device_SendString(&cdcInterface, str);
 	}
 
+void usbcdc__sendString_P(const char *str) {
+	usbcdc__sendStringNoFlush_P(str);
+	CDC_Device_Flush(&cdcInterface);
+	}
+
+void usbcdc__sendStringNoFlush_P(const char *str) {
+	CDC_Device_SendString_P(&cdcInterface, str);
+	}
+
+int usbcdc__queueVendorReport(const uint8_t *report) {
+	int result = -1;
+	if(USB_DeviceState != DEVICE_STATE_Configured)
+		return -1;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if(vendorTxCount < VENDOR_TX_QUEUE_LEN) {
+			memcpy(vendorTxQueue[vendorTxHead], report, VENDOR_EP_SIZE);
+			vendorTxHead = (vendorTxHead + 1) % VENDOR_TX_QUEUE_LEN;
+			vendorTxCount += 1;
+			result = 0;
+			}
+		}
+	return result;
+	}
+
 void EVENT_USB_Device_ControlRequest(void) {
 	CDC_Device_ProcessControlRequest(&cdcInterface);
 	}
 
+void EVENT_USB_Device_Reset(void) {
+	// The control endpoint has just been reconfigured, which clears its
+	// interrupt enables
+	Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+	UEIENX |= _BV(RXSTPE);
+	}
+
 void EVENT_USB_Device_Connect(void) {
 	statusleds__setUsbLed(0);
 	}
 
 void EVENT_USB_Device_Disconnect(void) {
 	statusleds__setUsbLed(0);
+	USB_Device_DisableSOFEvents();
+	rxTail = rxHead;
+	vendorTxCount = 0;
+	}
+
+void EVENT_USB_Device_StartOfFrame(void) {
+	if(USB_DeviceState == DEVICE_STATE_Configured) {
+		serviceDataOutEndpoint();
+		serviceVendorEndpoints();
+		}
 	}
 
 void EVENT_USB_Device_ConfigurationChanged(void) {
 	statusleds__setUsbLed(0);
 	int result = CDC_Device_ConfigureEndpoints(&cdcInterface);
-	if(result)
+	vendorTxCount = 0;
+	result = result && Endpoint_ConfigureEndpoint(
+		VIN_EP_ADDR, EP_TYPE_INTERRUPT, VENDOR_EP_SIZE, 1);
+	result = result && Endpoint_ConfigureEndpoint(
+		VOUT_EP_ADDR, EP_TYPE_INTERRUPT, VENDOR_EP_SIZE, 1);
+	if(result) {
+		Endpoint_SelectEndpoint(DOUT_EP_ADDR);
+		UEIENX |= _BV(RXOUTE);
+		Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+		USB_Device_EnableSOFEvents();
 		statusleds__setUsbLed(1);
+		usbcdc__configuredEvent();
+		}
+	}
+
+ISR(USB_COM_vect) {
+	// Endpoint interrupts: SETUP packets on the control endpoint and data on
+	// the CDC OUT endpoint. This takes the place of LUFA's handler for
+	// INTERRUPT_CONTROL_ENDPOINT, which only knows about the control
+	// endpoint and would leave the OUT endpoint's flag set.
+	uint8_t prevEndpoint = Endpoint_GetCurrentEndpoint();
+	if(USB_DeviceState == DEVICE_STATE_Configured)
+		serviceDataOutEndpoint();
+	Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+	if((UEIENX & _BV(RXSTPE)) && Endpoint_IsSETUPReceived()) {
+		UEIENX &= ~_BV(RXSTPE);
+		sei();
+		// ^ Control requests can take a while (string descriptors, line
+		// coding), so let other interrupts in; data that arrives meanwhile
+		// re-enters this handler, which skips the control endpoint while
+		// its interrupt is off
+		USB_Device_ProcessControlRequest();
+		cli();
+		Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+		UEIENX |= _BV(RXSTPE);
+		}
+	Endpoint_SelectEndpoint(prevEndpoint);
 	}
@@ -12,3 +12,15 @@ int usbcdc__hasInputWaiting(void);
 int16_t usbcdc__getNextInputChar(void);
 void usbcdc__sendString(const char *str);
 void usbcdc__sendStringNoFlush(const char *str);
+void usbcdc__sendString_P(const char *str);
+void usbcdc__sendStringNoFlush_P(const char *str);
+// ^ For strings in program memory
+int usbcdc__queueVendorReport(const uint8_t *report);
+
+void usbcdc__configuredEvent(void);
+// Application defines this
+
+void usbcdc__vendorReportEvent(const uint8_t *report);
+// Application defines this; called from interrupt context with
+// VENDOR_EP_SIZE bytes. At least one usbcdc__queueVendorReport() call is
+// guaranteed to succeed from within it.
@@ -1,11 +1,9 @@
 #pragma once
 
 
-#define MFR_STRING L"CZBSF BioE"
-#define PROD_STRING L"UXIB-DN12 12-channel solenoid controller"
-#define VENDOR_ID 0x4743
-#define PRODUCT_ID 0xB499
-#define RELEASENUMBER VERSION_BCD(0,0,1)
+#include "board.h"
+// ^ MFR_STRING, PROD_STRING, VENDOR_ID, PRODUCT_ID, RELEASENUMBER
+#include "vendorrpt.h"
 
 #define CONTROL_EP_SIZE 8
 
@@ -17,3 +15,13 @@
 #define DATA_IO_EP_SIZE 16
 #define DIN_EP_SIZE DATA_IO_EP_SIZE
 #define DOUT_EP_SIZE DATA_IO_EP_SIZE
+
+#define VENDOR_INTERFACE_NUMBER 2
+#define VIN_EP_ADDR (ENDPOINT_DIR_IN | 4)
+#define VOUT_EP_ADDR (ENDPOINT_DIR_OUT | 5)
+#define VENDOR_EP_SIZE VENDORRPT_LEN
+#define VENDOR_EP_POLL_MS 1
+#define VENDOR_TX_QUEUE_LEN 4
+
+#define RX_RING_SIZE 64
+// ^ Must be a power of two no bigger than 256
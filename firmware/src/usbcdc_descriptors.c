@@ -31,9 +31,9 @@ const USB_Descriptor_Device_t PROGMEM deviceDescriptor = {
 		.Type = DTYPE_Device,
 		},
 	.USBSpecification = VERSION_BCD(1, 1, 0),
-	.Class = CDC_CSCP_CDCClass,
-	.SubClass = CDC_CSCP_NoSpecificSubclass,
-	.Protocol = CDC_CSCP_NoSpecificProtocol,
+	.Class = USB_CSCP_IADDeviceClass,
+	.SubClass = USB_CSCP_IADDeviceSubclass,
+	.Protocol = USB_CSCP_IADDeviceProtocol,
 	.Endpoint0Size = ENDPOINT_CONTROLEP_DEFAULT_SIZE,
 	.VendorID = VENDOR_ID,
 	.ProductID = PRODUCT_ID,
@@ -46,6 +46,7 @@ const USB_Descriptor_Device_t PROGMEM deviceDescriptor = {
 
 struct config_descriptor {
 	USB_Descriptor_Configuration_Header_t configHeader;
+	USB_Descriptor_Interface_Association_t cdcIad;
 	USB_Descriptor_Interface_t cciInterface;
 	USB_CDC_Descriptor_FunctionalHeader_t cciHeaderFunctional;
 	USB_CDC_Descriptor_FunctionalACM_t acmFunctional;
@@ -54,6 +55,9 @@ struct config_descriptor {
 	USB_Descriptor_Interface_t dciInterface;
 	USB_Descriptor_Endpoint_t dataOutEp;
 	USB_Descriptor_Endpoint_t dataInEp;
+	USB_Descriptor_Interface_t vendorInterface;
+	USB_Descriptor_Endpoint_t vendorInEp;
+	USB_Descriptor_Endpoint_t vendorOutEp;
 	};
 
 const struct config_descriptor PROGMEM configDescriptor = {
@@ -67,7 +71,21 @@ const struct config_descriptor PROGMEM configDescriptor = {
 		.ConfigurationStrIndex = NO_DESCRIPTOR,
 		.MaxPowerConsumption = USB_CONFIG_POWER_MA(50),
 		.TotalConfigurationSize = sizeof(struct config_descriptor),
+		.TotalInterfaces = 3,
+		},
+	.cdcIad = {
+		// Keeps the two CDC interfaces bound together now that the device
+		// has a third, unrelated one
+		.Header = {
+			.Size = sizeof(USB_Descriptor_Interface_Association_t),
+			.Type = DTYPE_InterfaceAssociation,
+			},
+		.FirstInterfaceIndex = 0,
 		.TotalInterfaces = 2,
+		.Class = CDC_CSCP_CDCClass,
+		.SubClass = CDC_CSCP_ACMSubclass,
+		.Protocol = CDC_CSCP_NoSpecificProtocol,
+		.IADStrIndex = NO_DESCRIPTOR,
 		},
 	.cciInterface = {
 		.Header = {
@@ -151,6 +169,41 @@ const struct config_descriptor PROGMEM configDescriptor = {
 		.Attributes = 
 			EP_TYPE_BULK | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA,
 		},
+	.vendorInterface = {
+		.Header = {
+			.Size = sizeof(USB_Descriptor_Interface_t),
+			.Type = DTYPE_Interface,
+			},
+		.AlternateSetting = 0,
+		.InterfaceNumber = VENDOR_INTERFACE_NUMBER,
+		.InterfaceStrIndex = NO_DESCRIPTOR,
+		.Class = USB_CSCP_VendorSpecificClass,
+		.SubClass = USB_CSCP_NoDeviceSubclass,
+		.Protocol = USB_CSCP_NoDeviceProtocol,
+		.TotalEndpoints = 2,
+		},
+	.vendorInEp = {
+		.Header = {
+			.Size = sizeof(USB_Descriptor_Endpoint_t),
+			.Type = DTYPE_Endpoint,
+			},
+		.EndpointAddress = VIN_EP_ADDR,
+		.EndpointSize = VENDOR_EP_SIZE,
+		.Attributes = 
+			EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA,
+		.PollingIntervalMS = VENDOR_EP_POLL_MS,
+		},
+	.vendorOutEp = {
+		.Header = {
+			.Size = sizeof(USB_Descriptor_Endpoint_t),
+			.Type = DTYPE_Endpoint,
+			},
+		.EndpointAddress = VOUT_EP_ADDR,
+		.EndpointSize = VENDOR_EP_SIZE,
+		.Attributes = 
+			EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA,
+		.PollingIntervalMS = VENDOR_EP_POLL_MS,
+		},
 	};
 
 
@@ -0,0 +1,82 @@
+#include <stdint.h>
+
+#include "gpio.h"
+#include "inrush.h"
+#include "mstick.h"
+#include "presets.h"
+#include "usbcdc.h"
+#include "vendorctl.h"
+#include "vendorrpt.h"
+
+
+// Handles requests arriving on the vendor-class USB interface. Everything
+// here runs in interrupt context (USB start-of-frame and the input poll
+// deadline), which never nest with each other, so the state below needs no
+// extra locking. Anything shared with the main loop must be safe to use from
+// an interrupt: presets are recalled from their RAM copies, never from the
+// EEPROM, which the main loop may be writing at the time.
+
+static board_mask_t eventMask;
+static board_mask_t prevInputs;
+static uint8_t eventFlags;
+
+
+static uint8_t execute(const vendorrpt_request_t *req) {
+	switch(req->op) {
+		case VENDORRPT_OP_READ:
+			return VENDORRPT_STATUS_OK;
+		case VENDORRPT_OP_WRITE_OUTPUTS:
+			if(inrush__applyOutputs(req->arg0, req->arg1))
+				return VENDORRPT_STATUS_BAD_VAL;
+			return VENDORRPT_STATUS_OK;
+		case VENDORRPT_OP_RECALL_PRESET:
+			if(req->arg0 > 0xFF || presets__recall(req->arg0))
+				return VENDORRPT_STATUS_BAD_VAL;
+			return VENDORRPT_STATUS_OK;
+		case VENDORRPT_OP_SET_EVENT_MASK:
+			if(req->arg0 & ~gpio__getInputCapMask())
+				return VENDORRPT_STATUS_BAD_VAL;
+			eventMask = req->arg0;
+			prevInputs = gpio__readInputs();
+			mstick__setPolling(MSTICK_POLL_VENDORCTL, !!eventMask);
+			return VENDORRPT_STATUS_OK;
+		}
+	return VENDORRPT_STATUS_BAD_OP;
+	}
+
+void vendorctl__init(void) {
+	eventMask = 0;
+	eventFlags = 0;
+	prevInputs = gpio__readInputs();
+	}
+
+void vendorctl__onReport(const uint8_t *report) {
+	// usbcdc only hands over a request when there's room to queue the reply
+	vendorrpt_request_t req;
+	uint8_t reply[VENDORRPT_LEN];
+	uint8_t status;
+	vendorrpt__decodeRequest(&req, report);
+	status = execute(&req);
+	vendorrpt__encodeReply(
+		reply, &req, status, gpio__readOutputs(), gpio__readInputs());
+	usbcdc__queueVendorReport(reply);
+	}
+
+void vendorctl__onPoll(void) {
+	uint8_t report[VENDORRPT_LEN];
+	board_mask_t inputs;
+	board_mask_t changed;
+	if(!eventMask)
+		return;
+	inputs = gpio__readInputs();
+	changed = (inputs ^ prevInputs) & eventMask;
+	if(!changed)
+		return;
+	prevInputs = inputs;
+	vendorrpt__encodeEvent(
+		report, eventFlags, mstick__getTicks(), inputs, changed);
+	if(usbcdc__queueVendorReport(report))
+		eventFlags |= VENDORRPT_EVENTFLAG_OVERRUN;
+	else
+		eventFlags = 0;
+	}
@@ -0,0 +1,9 @@
+#pragma once
+
+
+#include <stdint.h>
+
+
+void vendorctl__init(void);
+void vendorctl__onReport(const uint8_t *report);
+void vendorctl__onPoll(void);
@@ -0,0 +1,64 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "vendorrpt.h"
+
+
+// Nothing in here touches the hardware, so it builds as-is on the host
+
+
+static inline void putU16(uint8_t *dest, uint16_t val) {
+	dest[0] = val & 0xFF;
+	dest[1] = val >> 8;
+	}
+
+static inline void putMask(uint8_t *dest, board_mask_t val) {
+	for(int i = 0; i < VENDORRPT_MASK_LEN; ++i)
+		dest[i] = val >> (8 * i);
+	}
+
+static inline board_mask_t getMask(const uint8_t *src) {
+	board_mask_t val = 0;
+	for(int i = 0; i < VENDORRPT_MASK_LEN; ++i)
+		val |= (board_mask_t)src[i] << (8 * i);
+	return val;
+	}
+
+void vendorrpt__decodeRequest(
+		vendorrpt_request_t *dest, const uint8_t *report) {
+	dest->op = report[0];
+	dest->tag = report[1];
+	dest->arg0 = getMask(&report[2]);
+	dest->arg1 = getMask(&report[2 + VENDORRPT_MASK_LEN]);
+	}
+
+void vendorrpt__encodeRequest(
+		uint8_t *report, const vendorrpt_request_t *src) {
+	memset(report, 0, VENDORRPT_LEN);
+	report[0] = src->op;
+	report[1] = src->tag;
+	putMask(&report[2], src->arg0);
+	putMask(&report[2 + VENDORRPT_MASK_LEN], src->arg1);
+	}
+
+void vendorrpt__encodeReply(
+		uint8_t *report, const vendorrpt_request_t *req, uint8_t status,
+		board_mask_t outputs, board_mask_t inputs) {
+	memset(report, 0, VENDORRPT_LEN);
+	report[0] = req->op | VENDORRPT_REPLY_FLAG;
+	report[1] = req->tag;
+	report[2] = status;
+	putMask(&report[4], outputs);
+	putMask(&report[4 + VENDORRPT_MASK_LEN], inputs);
+	}
+
+void vendorrpt__encodeEvent(
+		uint8_t *report, uint8_t flags, uint16_t timestamp, board_mask_t inputs,
+		board_mask_t changed) {
+	memset(report, 0, VENDORRPT_LEN);
+	report[0] = VENDORRPT_TYPE_EVENT;
+	report[1] = flags;
+	putU16(&report[2], timestamp);
+	putMask(&report[4], inputs);
+	putMask(&report[4 + VENDORRPT_MASK_LEN], changed);
+	}
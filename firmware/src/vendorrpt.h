@@ -0,0 +1,70 @@
+#pragma once
+
+
+#include <stdint.h>
+
+#include "board.h"
+
+
+// Fixed-size reports exchanged over the vendor-class interrupt endpoints.
+// Multi-byte fields are little-endian. Every request gets exactly one reply
+// carrying the same op and tag; event reports are sent unprompted.
+//
+// Request:  [0] op  [1] tag  [2..3] arg0  [4..5] arg1  [6..7] reserved
+// Reply:    [0] op | VENDORRPT_REPLY_FLAG  [1] tag  [2] status  [3] 0
+//           [4..5] output levels  [6..7] input levels
+// Event:    [0] VENDORRPT_TYPE_EVENT  [1] flags  [2..3] ms timestamp
+//           [4..5] input levels  [6..7] inputs that changed
+//
+// That is for boards with 16-bit terminal masks. On boards with 32-bit ones
+// the args and levels take 4 bytes each, in the same order, and the report
+// is 16 bytes long with the unused tail zeroed:
+//
+// Request:  [0] op  [1] tag  [2..5] arg0  [6..9] arg1  [10..15] reserved
+// Reply:    [0] op | VENDORRPT_REPLY_FLAG  [1] tag  [2] status  [3] 0
+//           [4..7] output levels  [8..11] input levels  [12..15] 0
+// Event:    [0] VENDORRPT_TYPE_EVENT  [1] flags  [2..3] ms timestamp
+//           [4..7] input levels  [8..11] inputs that changed  [12..15] 0
+
+#define VENDORRPT_MASK_LEN (BOARD_MASK_BITS / 8)
+#define VENDORRPT_LEN (BOARD_MASK_BITS > 16 ? 16 : 8)
+// ^ Also the endpoint size, so a power of two
+
+#define VENDORRPT_REPLY_FLAG 0x80
+#define VENDORRPT_TYPE_EVENT 0xC0
+
+#define VENDORRPT_EVENTFLAG_OVERRUN 0x01
+// ^ Set when earlier events had to be discarded
+
+
+typedef enum {
+	VENDORRPT_OP_READ = 0x01,
+	VENDORRPT_OP_WRITE_OUTPUTS = 0x02,   // arg0: mask, arg1: values
+	VENDORRPT_OP_RECALL_PRESET = 0x03,   // arg0: preset number
+	VENDORRPT_OP_SET_EVENT_MASK = 0x04,  // arg0: input terminal mask
+	} vendorrpt_op_t;
+
+typedef enum {
+	VENDORRPT_STATUS_OK = 0,
+	VENDORRPT_STATUS_BAD_OP = 1,
+	VENDORRPT_STATUS_BAD_VAL = 2,
+	} vendorrpt_status_t;
+
+typedef struct {
+	uint8_t op;
+	uint8_t tag;
+	board_mask_t arg0;
+	board_mask_t arg1;
+	} vendorrpt_request_t;
+
+
+void vendorrpt__decodeRequest(
+	vendorrpt_request_t *dest, const uint8_t *report);
+void vendorrpt__encodeRequest(
+	uint8_t *report, const vendorrpt_request_t *src);
+void vendorrpt__encodeReply(
+	uint8_t *report, const vendorrpt_request_t *req, uint8_t status,
+	board_mask_t outputs, board_mask_t inputs);
+void vendorrpt__encodeEvent(
+	uint8_t *report, uint8_t flags, uint16_t timestamp, board_mask_t inputs,
+	board_mask_t changed);
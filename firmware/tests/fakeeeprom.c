@@ -0,0 +1,45 @@
+#include <setjmp.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "fakeeeprom.h"
+
+
+uint8_t fakeeeprom__data[FAKEEEPROM_SIZE];
+uint32_t fakeeeprom__writes;
+
+static jmp_buf *cutEnv;
+static uint32_t writesLeft;
+
+
+uint8_t eeprom_read_byte(const uint8_t *addr) {
+	return fakeeeprom__data[(uintptr_t)addr % FAKEEEPROM_SIZE];
+	}
+
+void eeprom_update_byte(uint8_t *addr, uint8_t val) {
+	uint8_t *cell = &fakeeeprom__data[(uintptr_t)addr % FAKEEEPROM_SIZE];
+	if(*cell == val)
+		return;
+	if(cutEnv) {
+		if(!writesLeft)
+			longjmp(*cutEnv, 1);
+		writesLeft -= 1;
+		}
+	*cell = val;
+	fakeeeprom__writes += 1;
+	}
+
+void fakeeeprom__erase(void) {
+	memset(fakeeeprom__data, 0xFF, sizeof(fakeeeprom__data));
+	fakeeeprom__writes = 0;
+	cutEnv = NULL;
+	}
+
+void fakeeeprom__armPowerCut(jmp_buf *env, uint32_t afterWrites) {
+	cutEnv = env;
+	writesLeft = afterWrites;
+	}
+
+void fakeeeprom__disarm(void) {
+	cutEnv = NULL;
+	}
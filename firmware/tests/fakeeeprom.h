@@ -0,0 +1,24 @@
+#pragma once
+
+
+#include <setjmp.h>
+#include <stdint.h>
+
+#include <avr/eeprom.h>
+
+
+// Array-backed EEPROM for host tests. Arming a power cut makes the write
+// that would change the given byte count jump back to the jmp_buf instead,
+// leaving every earlier write in place, as a brown-out between byte writes
+// would.
+
+#define FAKEEEPROM_SIZE (E2END + 1)
+
+extern uint8_t fakeeeprom__data[FAKEEEPROM_SIZE];
+extern uint32_t fakeeeprom__writes;
+// ^ Byte writes that changed a value since the last reset of this counter
+
+
+void fakeeeprom__erase(void);
+void fakeeeprom__armPowerCut(jmp_buf *env, uint32_t afterWrites);
+void fakeeeprom__disarm(void);
@@ -0,0 +1,74 @@
+#include <stdint.h>
+
+#include <avr/io.h>
+
+#include "faketimer1.h"
+
+
+volatile uint8_t TCCR1A;
+volatile uint8_t TCCR1B;
+volatile uint16_t TCNT1;
+volatile uint16_t OCR1A;
+volatile uint8_t TIFR1;
+volatile uint8_t TIMSK1;
+
+static uint32_t now;
+
+void TIMER1_COMPA_vect(void);
+void TIMER1_OVF_vect(void);
+
+
+void faketimer1__reset(void) {
+	now = 0;
+	TCCR1A = TCCR1B = 0;
+	TCNT1 = OCR1A = 0;
+	TIFR1 = TIMSK1 = 0;
+	}
+
+uint32_t faketimer1__now(void) {
+	return now;
+	}
+
+static int runToNext(uint32_t end) {
+	// Advances to the next interrupt and handles it, unless that's later
+	// than end. An overflow that lands on the same count as a compare match
+	// is handled first, so no overflow is ever pending while firmware code
+	// runs; mstick.c copes with either order, since both handlers dispatch
+	// every due deadline.
+	uint32_t next = (now | 0xFFFF) + 1;
+	int overflow = 1;
+	if(TIMSK1 & _BV(OCIE1A)) {
+		uint16_t toMatch = OCR1A - (uint16_t)now;
+		uint32_t match = now + (toMatch ? toMatch : 0x10000);
+		if(match < next) {
+			next = match;
+			overflow = 0;
+			}
+		}
+	if((int32_t)(next - end) > 0)
+		return 0;
+	now = next;
+	TCNT1 = (uint16_t)now;
+	TIFR1 = 0;
+	if(!overflow)
+		TIMER1_COMPA_vect();
+	else if(TIMSK1 & _BV(TOIE1))
+		TIMER1_OVF_vect();
+	else
+		return 0;
+	return 1;
+	}
+
+void faketimer1__run(uint32_t counts) {
+	uint32_t end = now + counts;
+	TIFR1 = 0;
+	while(runToNext(end))
+		;
+	now = end;
+	TCNT1 = (uint16_t)now;
+	}
+
+int faketimer1__runToInterrupt(void) {
+	TIFR1 = 0;
+	return runToNext(now + 0x10000);
+	}
@@ -0,0 +1,16 @@
+#pragma once
+
+
+#include <stdint.h>
+
+
+// Timer1 for host tests of mstick.c: the counter advances only when a test
+// calls faketimer1__run() or faketimer1__runToInterrupt(), which call the
+// overflow and compare match handlers as the count passes those points.
+// Time is in timer counts, from when the test started the timer.
+
+void faketimer1__reset(void);
+void faketimer1__run(uint32_t counts);
+int faketimer1__runToInterrupt(void);
+// ^ Returns 0, with the count unchanged, if no interrupt is enabled
+uint32_t faketimer1__now(void);
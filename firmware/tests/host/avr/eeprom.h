@@ -0,0 +1,14 @@
+#pragma once
+
+
+#include <stdint.h>
+
+
+// Stands in for avr-libc's EEPROM access when firmware modules are built on
+// the host for testing; backed by the array in fakeeeprom.c
+
+#define E2END 0x3FF
+
+
+uint8_t eeprom_read_byte(const uint8_t *addr);
+void eeprom_update_byte(uint8_t *addr, uint8_t val);
@@ -0,0 +1,12 @@
+#pragma once
+
+
+#include <avr/io.h>
+
+
+// Interrupt handlers become plain functions, called by the fake peripherals
+
+#define ISR(vector) void vector(void)
+
+#define sei()
+#define cli()
@@ -0,0 +1,27 @@
+#pragma once
+
+
+#include <stdint.h>
+
+
+// Stands in for avr-libc's register definitions when firmware modules are
+// built on the host for testing. Only Timer1, which faketimer1.c drives, is
+// here. Flag registers are plain variables, so writing a 1 to clear a flag
+// sets it instead; faketimer1.c zeroes TIFR1 whenever it runs the timer, and
+// tests do so after code that clears flags before the timer has run.
+
+#define _BV(bit) (1 << (bit))
+
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t OCR1A;
+extern volatile uint8_t TIFR1;
+extern volatile uint8_t TIMSK1;
+
+#define TOV1 0
+#define OCF1A 1
+#define TOIE1 0
+#define OCIE1A 1
+#define CS10 0
+#define CS11 1
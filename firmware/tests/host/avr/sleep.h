@@ -0,0 +1,13 @@
+#pragma once
+
+
+// Sleep mode selection does nothing on the host; the test that links a
+// module using sleep_cpu() defines what sleeping does
+
+#define SLEEP_MODE_IDLE 0
+
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_disable()
+
+void sleep_cpu(void);
@@ -0,0 +1,9 @@
+#pragma once
+
+
+// Host tests run firmware code and the fake peripherals' interrupt handlers
+// on one thread, so an atomic block is just a block
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_BLOCK(type) \
+	for(int atomicOnce_ = 1; atomicOnce_; atomicOnce_ = 0)
@@ -0,0 +1,14 @@
+#pragma once
+
+
+#include <stdint.h>
+
+
+// Same algorithm as avr-libc's _crc16_update() (CRC-16/ARC, reflected 0xA001)
+
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a) {
+	crc ^= a;
+	for(int i = 0; i < 8; ++i)
+		crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+	return crc;
+	}
@@ -0,0 +1,31 @@
+#pragma once
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// Minimal assertions for the host-built firmware tests; a failed check
+// reports where it was and exits with status 1
+
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", \
+			__FILE__, __LINE__, #cond); \
+		exit(1); \
+		} \
+	} while(0)
+
+#define CHECK_EQ(actual, expected) do { \
+	long long a_ = (actual), e_ = (expected); \
+	if(a_ != e_) { \
+		fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", \
+			__FILE__, __LINE__, #actual, a_, e_); \
+		exit(1); \
+		} \
+	} while(0)
+
+#define RUN_TEST(fn) do { \
+	fn(); \
+	printf("ok %s\n", #fn); \
+	} while(0)
@@ -0,0 +1,179 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <avr/io.h>
+
+#include "faketimer1.h"
+#include "hosttest.h"
+#include "mstick.h"
+
+
+// Host tests of the deadline scheduler in src/mstick.c on a simulated
+// Timer1. Time only passes in faketimer1__run(), so handlers take no time
+// and the load counters see wakeups but no busy time. The wakeup rates are
+// printed for comparison with the fixed 1 ms tick that mstick.c replaced,
+// which woke the CPU 1000 times a second whatever was going on.
+
+#define US_PER_COUNT 4
+#define COUNTS_PER_S (1000000UL / US_PER_COUNT)
+#define HEARTBEAT_HALFPERIOD_US 500000UL
+// ^ As in statusleds.c
+#define MAX_LATE_US (3 * US_PER_COUNT)
+// ^ Rounding up to a whole count, plus MIN_LEAD_COUNTS for deadlines that
+// are already due when they're scheduled
+
+
+static uint32_t firedCount[MSTICK_N_SLOTS];
+static uint32_t firedAtUs[MSTICK_N_SLOTS];
+static int heartbeatRunning;
+static uint32_t nextHbtUs;
+
+
+void mstick__deadlineEvent(mstick_slot_t slot) {
+	++firedCount[slot];
+	firedAtUs[slot] = faketimer1__now() * US_PER_COUNT;
+	if(slot == MSTICK_SLOT_HEARTBEAT && heartbeatRunning) {
+		nextHbtUs += HEARTBEAT_HALFPERIOD_US;
+		mstick__scheduleAt(MSTICK_SLOT_HEARTBEAT, nextHbtUs);
+		}
+	}
+
+static void freshTimer(void) {
+	faketimer1__reset();
+	memset(firedCount, 0, sizeof(firedCount));
+	heartbeatRunning = 0;
+	mstick__init();
+	TIFR1 = 0;
+	// ^ mstick__init() writes ones to clear the flags, which the fake
+	// register keeps
+	}
+
+static void startHeartbeat(void) {
+	heartbeatRunning = 1;
+	nextHbtUs = mstick__getMicros() + HEARTBEAT_HALFPERIOD_US;
+	mstick__scheduleAt(MSTICK_SLOT_HEARTBEAT, nextHbtUs);
+	}
+
+static void runUntilFired(mstick_slot_t slot, uint32_t limitCounts) {
+	uint32_t before = firedCount[slot];
+	for(uint32_t i = 0; i < limitCounts && firedCount[slot] == before; ++i)
+		faketimer1__run(1);
+	CHECK_EQ(firedCount[slot], before + 1);
+	}
+
+
+static void test_clockFollowsTimer(void) {
+	freshTimer();
+	faketimer1__run(3 * 0x10000UL + 1234);
+	CHECK_EQ(mstick__getMicros(), (3 * 0x10000UL + 1234) * US_PER_COUNT);
+	CHECK_EQ(mstick__getTicks(), (3 * 0x10000UL + 1234) * US_PER_COUNT / 1000);
+	faketimer1__run(20 * COUNTS_PER_S);
+	CHECK_EQ(mstick__getTicks(),
+		(uint16_t)(faketimer1__now() * US_PER_COUNT / 1000));
+	}
+
+static void test_idleWakeups(void) {
+	// Heartbeat only, which is what an idle board has scheduled
+	mstick_load_t load;
+	freshTimer();
+	startHeartbeat();
+	mstick__takeLoad(&load);
+	faketimer1__run(10 * COUNTS_PER_S);
+	mstick__takeLoad(&load);
+	CHECK_EQ(firedCount[MSTICK_SLOT_HEARTBEAT], 20);
+	CHECK_EQ(load.elapsedUs, 10000000UL);
+	CHECK_EQ(load.wakeups, 20 + 10 * COUNTS_PER_S / 0x10000);
+	// ^ Heartbeats plus overflows
+	CHECK_EQ(load.busyUs, 0);
+	printf("idle: %lu wakeups in 10 s (%.1f/s; fixed tick: 1000/s)\n",
+		(unsigned long)load.wakeups, load.wakeups / 10.);
+	}
+
+static void test_pollingWakeups(void) {
+	mstick_load_t load;
+	freshTimer();
+	startHeartbeat();
+	mstick__setPolling(MSTICK_POLL_RULES, 1);
+	mstick__setPolling(MSTICK_POLL_EDGECAP, 1);
+	mstick__takeLoad(&load);
+	faketimer1__run(COUNTS_PER_S);
+	mstick__takeLoad(&load);
+	CHECK_EQ(firedCount[MSTICK_SLOT_POLL], 1000);
+	CHECK(load.wakeups >= 1000 && load.wakeups <= 1010);
+	printf("polling: %lu wakeups in 1 s\n", (unsigned long)load.wakeups);
+
+	mstick__setPolling(MSTICK_POLL_RULES, 0);
+	faketimer1__run(COUNTS_PER_S);
+	CHECK_EQ(firedCount[MSTICK_SLOT_POLL], 2000);
+	// ^ Still one user left
+	mstick__setPolling(MSTICK_POLL_EDGECAP, 0);
+	mstick__takeLoad(&load);
+	faketimer1__run(COUNTS_PER_S);
+	mstick__takeLoad(&load);
+	CHECK_EQ(firedCount[MSTICK_SLOT_POLL], 2000);
+	CHECK(load.wakeups <= 10);
+	printf("polling stopped: %lu wakeups in 1 s\n",
+		(unsigned long)load.wakeups);
+	}
+
+static void test_deadlineResolution(void) {
+	// Deadlines from a few us to over a second, scheduled at odd points in
+	// the overflow period so that some of them span one or more overflows
+	static const uint32_t delaysUs[] = {
+		0, 4, 5, 10, 250, 1234, 65535, 70000, 262144, 300000, 1500001,
+		};
+	uint32_t worstUs = 0;
+	freshTimer();
+	for(unsigned i = 0; i < sizeof(delaysUs) / sizeof(delaysUs[0]); ++i) {
+		for(uint32_t skew = 0; skew < 0x10000; skew += 0x3A71) {
+			uint32_t startUs, lateUs;
+			faketimer1__run(skew);
+			startUs = faketimer1__now() * US_PER_COUNT;
+			mstick__scheduleIn(MSTICK_SLOT_WINK, delaysUs[i]);
+			runUntilFired(MSTICK_SLOT_WINK,
+				delaysUs[i] / US_PER_COUNT + 0x10000);
+			lateUs = firedAtUs[MSTICK_SLOT_WINK] - (startUs + delaysUs[i]);
+			CHECK(firedAtUs[MSTICK_SLOT_WINK] >= startUs + delaysUs[i]);
+			CHECK(lateUs <= MAX_LATE_US);
+			if(lateUs > worstUs)
+				worstUs = lateUs;
+			}
+		}
+	printf("deadlines: at most %lu us late\n", (unsigned long)worstUs);
+	}
+
+static void test_scheduleAtInPastFiresNow(void) {
+	freshTimer();
+	faketimer1__run(COUNTS_PER_S);
+	mstick__scheduleAt(MSTICK_SLOT_RULES, 1000);
+	runUntilFired(MSTICK_SLOT_RULES, 10);
+	}
+
+static void test_slotsFireInOrder(void) {
+	freshTimer();
+	mstick__scheduleIn(MSTICK_SLOT_SAMPLE, 300000);
+	mstick__scheduleIn(MSTICK_SLOT_RULES, 1000);
+	mstick__scheduleIn(MSTICK_SLOT_INRUSH, 80000);
+	mstick__scheduleIn(MSTICK_SLOT_WINK, 200000);
+	mstick__cancel(MSTICK_SLOT_WINK);
+	faketimer1__run(2 * COUNTS_PER_S);
+	CHECK_EQ(firedCount[MSTICK_SLOT_RULES], 1);
+	CHECK_EQ(firedCount[MSTICK_SLOT_INRUSH], 1);
+	CHECK_EQ(firedCount[MSTICK_SLOT_SAMPLE], 1);
+	CHECK_EQ(firedCount[MSTICK_SLOT_WINK], 0);
+	CHECK_EQ(firedAtUs[MSTICK_SLOT_RULES], 1000);
+	CHECK_EQ(firedAtUs[MSTICK_SLOT_INRUSH], 80000);
+	CHECK_EQ(firedAtUs[MSTICK_SLOT_SAMPLE], 300000);
+	}
+
+
+int main(void) {
+	RUN_TEST(test_clockFollowsTimer);
+	RUN_TEST(test_idleWakeups);
+	RUN_TEST(test_pollingWakeups);
+	RUN_TEST(test_deadlineResolution);
+	RUN_TEST(test_scheduleAtInPastFiresNow);
+	RUN_TEST(test_slotsFireInOrder);
+	return 0;
+	}
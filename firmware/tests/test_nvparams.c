@@ -0,0 +1,340 @@
+#include <setjmp.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <util/crc16.h>
+
+#include "board_info.h"
+#include "fakeeeprom.h"
+#include "hosttest.h"
+#include "nvparams.h"
+
+
+// Host tests of the parameter log in src/nvparams.c, run against an
+// array-backed EEPROM. "Rebooting" is nvparams__init(), which rebuilds the
+// RAM index from the EEPROM contents alone.
+
+#define BANK_SIZE (FAKEEEPROM_SIZE / 2)
+#define BANK_CAPACITY (BANK_SIZE - 4)
+#define KEY_A 10
+#define KEY_B 11
+#define KEY_C 12
+
+
+static nvparams_t params;
+
+
+static void reboot(void) {
+	nvparams__init(&params);
+	}
+
+static void freshBoard(void) {
+	fakeeeprom__erase();
+	reboot();
+	}
+
+static void checkRecord(uint8_t key, const void *expected, uint8_t len) {
+	uint8_t buf[NVPARAMS_RECORD_LEN_MAX];
+	CHECK_EQ(nvparams__readRecord(key, buf, sizeof(buf)), len);
+	CHECK(!memcmp(buf, expected, len));
+	}
+
+static void fillValue(uint8_t *dest, uint8_t len, uint32_t seed) {
+	for(int i = 0; i < len; ++i)
+		dest[i] = (uint8_t)(seed * 31 + i * 7);
+	}
+
+static int headersChanged(const uint8_t *before) {
+	return memcmp(before, fakeeeprom__data, 4)
+		|| memcmp(before + BANK_SIZE, fakeeeprom__data + BANK_SIZE, 4);
+	}
+
+
+static void test_blankEepromGetsDefaults(void) {
+	freshBoard();
+	CHECK(!strcmp((char *)params.boardId, DEFAULT_SERIALNO_STR));
+	CHECK_EQ(params.powerOnOutputs, DEFAULT_POWERON_OUTPUTS);
+	CHECK_EQ(params.powerOnDirs, DEFAULT_POWERON_DIRS);
+	for(int key = 0; key < NVPARAMS_N_KEYS; ++key)
+		CHECK(!nvparams__hasRecord(key));
+	CHECK_EQ(nvparams__getFreeSpace(), BANK_CAPACITY);
+	}
+
+static void test_appendOverwriteErase(void) {
+	uint16_t words[2] = {0x1234, 0xABCD};
+	uint32_t writes;
+	freshBoard();
+	CHECK_EQ(nvparams__writeRecord(KEY_A, "abc", 3), 0);
+	CHECK_EQ(nvparams__writeRecord(KEY_B, words, sizeof(words)), 0);
+	CHECK_EQ(nvparams__getFreeSpace(), BANK_CAPACITY - 7 - 8);
+	reboot();
+	checkRecord(KEY_A, "abc", 3);
+	checkRecord(KEY_B, words, sizeof(words));
+	CHECK(!nvparams__hasRecord(KEY_C));
+
+	CHECK_EQ(nvparams__writeRecord(KEY_A, "defgh", 5), 0);
+	reboot();
+	checkRecord(KEY_A, "defgh", 5);
+	checkRecord(KEY_B, words, sizeof(words));
+	CHECK_EQ(nvparams__getFreeSpace(), BANK_CAPACITY - 9 - 8);
+
+	writes = fakeeeprom__writes;
+	CHECK_EQ(nvparams__writeRecord(KEY_A, "defgh", 5), 0);
+	CHECK_EQ(fakeeeprom__writes, writes);
+	// ^ Rewriting the same value costs nothing
+
+	CHECK_EQ(nvparams__eraseRecord(KEY_B), 0);
+	reboot();
+	CHECK(!nvparams__hasRecord(KEY_B));
+	CHECK_EQ(nvparams__readRecord(KEY_B, words, sizeof(words)), -1);
+	checkRecord(KEY_A, "defgh", 5);
+	writes = fakeeeprom__writes;
+	CHECK_EQ(nvparams__eraseRecord(KEY_C), 0);
+	CHECK_EQ(fakeeeprom__writes, writes);
+	}
+
+static void test_readTruncatesToBuffer(void) {
+	uint8_t buf[2];
+	freshBoard();
+	nvparams__writeRecord(KEY_A, "abcdef", 6);
+	CHECK_EQ(nvparams__readRecord(KEY_A, buf, sizeof(buf)), 2);
+	CHECK(!memcmp(buf, "ab", 2));
+	}
+
+static void test_rejectsBadKeysAndLengths(void) {
+	uint8_t big[NVPARAMS_RECORD_LEN_MAX + 1] = {0};
+	freshBoard();
+	CHECK_EQ(nvparams__writeRecord(NVPARAMS_N_KEYS, "x", 1), -1);
+	CHECK_EQ(nvparams__writeRecord(KEY_A, big, sizeof(big)), -1);
+	CHECK(!nvparams__hasRecord(NVPARAMS_N_KEYS));
+	}
+
+static void test_compactionAcrossBanks(void) {
+	// Overwriting one record many times forces the log through several
+	// compactions, each moving it to the other bank
+	uint8_t value[16];
+	uint16_t words[2] = {0x0FF0, 0x5AA5};
+	int compactions = 0;
+	freshBoard();
+	nvparams__writeRecord(KEY_B, words, sizeof(words));
+	nvparams__writeRecord(NVKEY_BOARDID, "SN42", 4);
+	for(uint32_t i = 0; i < 300; ++i) {
+		uint8_t before[FAKEEEPROM_SIZE];
+		memcpy(before, fakeeeprom__data, sizeof(before));
+		fillValue(value, sizeof(value), i);
+		CHECK_EQ(nvparams__writeRecord(KEY_A, value, sizeof(value)), 0);
+		compactions += headersChanged(before);
+		if(i % 7 == 0)
+			reboot();
+		checkRecord(KEY_A, value, sizeof(value));
+		checkRecord(KEY_B, words, sizeof(words));
+		checkRecord(NVKEY_BOARDID, "SN42", 4);
+		CHECK_EQ(nvparams__getFreeSpace(), BANK_CAPACITY - 20 - 8 - 8);
+		}
+	reboot();
+	CHECK(!strcmp((char *)params.boardId, "SN42"));
+	CHECK(compactions >= 8);
+	}
+
+static void test_fullLog(void) {
+	uint8_t value[NVPARAMS_RECORD_LEN_MAX] = {0};
+	int key = KEY_A;
+	freshBoard();
+	while(nvparams__getFreeSpace() >= 4 + sizeof(value))
+		CHECK_EQ(nvparams__writeRecord(key++, value, sizeof(value)), 0);
+	CHECK_EQ(nvparams__writeRecord(key, value, sizeof(value)), -1);
+	CHECK(!nvparams__hasRecord(key));
+	value[0] = 1;
+	CHECK_EQ(nvparams__writeRecord(KEY_A, value, sizeof(value)), 0);
+	// ^ Replacing a record of the same size still fits
+	reboot();
+	checkRecord(KEY_A, value, sizeof(value));
+	}
+
+static void checkPowerCuts(
+		uint8_t key, const void *oldValue, uint8_t oldLen,
+		const void *newValue, uint8_t newLen) {
+	// Repeats the write with the power cut after every byte it changes,
+	// starting from the same EEPROM contents each time. Whatever the point,
+	// the record must come back as either its old or its new value, and the
+	// other records (KEY_B and the board ID) must be intact
+	uint8_t start[FAKEEEPROM_SIZE];
+	uint16_t words[2];
+	uint8_t buf[NVPARAMS_RECORD_LEN_MAX];
+	uint32_t total;
+	jmp_buf env;
+	memcpy(start, fakeeeprom__data, sizeof(start));
+	nvparams__readRecord(KEY_B, words, sizeof(words));
+	fakeeeprom__writes = 0;
+	CHECK_EQ(nvparams__writeRecord(key, newValue, newLen), 0);
+	total = fakeeeprom__writes;
+	CHECK(total > 0);
+	for(uint32_t cut = 0; cut <= total; ++cut) {
+		volatile int finished = 0;
+		int len;
+		memcpy(fakeeeprom__data, start, sizeof(start));
+		reboot();
+		if(!setjmp(env)) {
+			fakeeeprom__armPowerCut(&env, cut);
+			CHECK_EQ(nvparams__writeRecord(key, newValue, newLen), 0);
+			finished = 1;
+			}
+		fakeeeprom__disarm();
+		reboot();
+		len = nvparams__readRecord(key, buf, sizeof(buf));
+		if(finished || cut == total)
+			CHECK(len == newLen && !memcmp(buf, newValue, newLen));
+		else
+			CHECK((len == newLen && !memcmp(buf, newValue, newLen))
+				|| (len == oldLen && !memcmp(buf, oldValue, oldLen)));
+		checkRecord(KEY_B, words, sizeof(words));
+		CHECK(!strcmp((char *)params.boardId, "SN42"));
+		CHECK_EQ(nvparams__writeRecord(KEY_C, "after", 5), 0);
+		reboot();
+		checkRecord(KEY_C, "after", 5);
+		// ^ The log still takes new records after the interrupted write
+		}
+	}
+
+static void test_powerCutDuringAppend(void) {
+	uint16_t words[2] = {1, 2};
+	freshBoard();
+	nvparams__writeRecord(NVKEY_BOARDID, "SN42", 4);
+	nvparams__writeRecord(KEY_B, words, sizeof(words));
+	nvparams__writeRecord(KEY_A, "old", 3);
+	checkPowerCuts(KEY_A, "old", 3, "newer", 5);
+	}
+
+static void test_powerCutDuringCompaction(void) {
+	// Finds the next write that compacts the log, then cuts the power at
+	// every byte of it: the copied records and the new bank header
+	uint8_t value[16], oldValue[16];
+	uint16_t words[2] = {3, 4};
+	uint8_t before[FAKEEEPROM_SIZE];
+	uint32_t i = 0;
+	freshBoard();
+	nvparams__writeRecord(NVKEY_BOARDID, "SN42", 4);
+	nvparams__writeRecord(KEY_B, words, sizeof(words));
+	for(;; ++i) {
+		memcpy(before, fakeeeprom__data, sizeof(before));
+		fillValue(value, sizeof(value), i);
+		nvparams__writeRecord(KEY_A, value, sizeof(value));
+		if(i && headersChanged(before))
+			break;
+		memcpy(oldValue, value, sizeof(value));
+		}
+	memcpy(fakeeeprom__data, before, sizeof(before));
+	reboot();
+	checkPowerCuts(KEY_A, oldValue, sizeof(oldValue), value, sizeof(value));
+	}
+
+static void test_badCrcEndsLog(void) {
+	// A record failing its CRC, and everything after it, is ignored, so a
+	// key falls back to its last good value
+	uint8_t *data = fakeeeprom__data;
+	int offs = -1;
+	freshBoard();
+	nvparams__writeRecord(KEY_A, "first", 5);
+	nvparams__writeRecord(KEY_A, "second", 6);
+	nvparams__writeRecord(KEY_B, "b", 1);
+	for(int i = 0; i + 6 <= FAKEEEPROM_SIZE; ++i) {
+		if(!memcmp(&data[i], "second", 6))
+			offs = i;
+		}
+	CHECK(offs >= 0);
+	data[offs] ^= 0x20;
+	reboot();
+	checkRecord(KEY_A, "first", 5);
+	CHECK(!nvparams__hasRecord(KEY_B));
+	CHECK_EQ(nvparams__writeRecord(KEY_B, "b2", 2), 0);
+	reboot();
+	checkRecord(KEY_A, "first", 5);
+	checkRecord(KEY_B, "b2", 2);
+	}
+
+static void test_badHeaderCrcFallsBackToOtherBank(void) {
+	// Corrupting the newest bank header brings back the bank it was
+	// compacted from, which still holds the state from before compaction
+	uint8_t value[16];
+	uint8_t before[FAKEEEPROM_SIZE];
+	uint8_t oldValue[16];
+	uint16_t newBank;
+	freshBoard();
+	for(uint32_t i = 0;; ++i) {
+		memcpy(before, fakeeeprom__data, sizeof(before));
+		fillValue(value, sizeof(value), i);
+		nvparams__writeRecord(KEY_A, value, sizeof(value));
+		if(i && headersChanged(before))
+			break;
+		memcpy(oldValue, value, sizeof(value));
+		}
+	newBank = memcmp(before, fakeeeprom__data, 4) ? 0 : BANK_SIZE;
+	fakeeeprom__data[newBank + 2] ^= 0x01;
+	reboot();
+	checkRecord(KEY_A, oldValue, sizeof(oldValue));
+	}
+
+static void writeLegacy(const char *boardId) {
+	uint8_t blob[BOARDID_LEN_MAX + 1] = {0};
+	uint16_t crc = 0xFFFF;
+	strncpy((char *)blob, boardId, BOARDID_LEN_MAX);
+	for(int i = 0; i < sizeof(blob); ++i)
+		crc = _crc16_update(crc, blob[i]);
+	fakeeeprom__erase();
+	memcpy(fakeeeprom__data, blob, sizeof(blob));
+	fakeeeprom__data[sizeof(blob)] = crc & 0xFF;
+	fakeeeprom__data[sizeof(blob) + 1] = crc >> 8;
+	}
+
+static void test_migratesLegacyBoardId(void) {
+	writeLegacy("OLDSN7");
+	reboot();
+	CHECK(!strcmp((char *)params.boardId, "OLDSN7"));
+	checkRecord(NVKEY_BOARDID, "OLDSN7", 6);
+	CHECK_EQ(params.powerOnDirs, DEFAULT_POWERON_DIRS);
+	nvparams__writeRecord(KEY_A, "x", 1);
+	reboot();
+	CHECK(!strcmp((char *)params.boardId, "OLDSN7"));
+	checkRecord(KEY_A, "x", 1);
+
+	writeLegacy("OLDSN7");
+	fakeeeprom__data[3] ^= 0xFF;
+	reboot();
+	CHECK(!strcmp((char *)params.boardId, DEFAULT_SERIALNO_STR));
+	// ^ A blob failing its CRC is not migrated
+	}
+
+static void test_powerCutDuringMigration(void) {
+	uint32_t total;
+	jmp_buf env;
+	writeLegacy("OLDSN7");
+	reboot();
+	total = fakeeeprom__writes;
+	for(uint32_t cut = 0; cut < total; ++cut) {
+		writeLegacy("OLDSN7");
+		if(!setjmp(env)) {
+			fakeeeprom__armPowerCut(&env, cut);
+			reboot();
+			}
+		fakeeeprom__disarm();
+		reboot();
+		CHECK(!strcmp((char *)params.boardId, "OLDSN7"));
+		}
+	}
+
+
+int main(void) {
+	RUN_TEST(test_blankEepromGetsDefaults);
+	RUN_TEST(test_appendOverwriteErase);
+	RUN_TEST(test_readTruncatesToBuffer);
+	RUN_TEST(test_rejectsBadKeysAndLengths);
+	RUN_TEST(test_compactionAcrossBanks);
+	RUN_TEST(test_fullLog);
+	RUN_TEST(test_powerCutDuringAppend);
+	RUN_TEST(test_powerCutDuringCompaction);
+	RUN_TEST(test_badCrcEndsLog);
+	RUN_TEST(test_badHeaderCrcFallsBackToOtherBank);
+	RUN_TEST(test_migratesLegacyBoardId);
+	RUN_TEST(test_powerCutDuringMigration);
+	return 0;
+	}
@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include <avr/io.h>
+
+#include "faketimer1.h"
+#include "hosttest.h"
+#include "mstick.h"
+#include "powersave.h"
+
+
+// Host tests of the idle statistics in src/powersave.c, with mstick.c on a
+// simulated Timer1 as the only source of wakeups. Sleeping runs the timer to
+// its next interrupt; a main loop pass takes as long as the test advances
+// the timer for. USB start-of-frame interrupts, which wake a configured
+// board every 1 ms, aren't simulated, so these are the figures for a board
+// that isn't enumerated, or is suspended.
+
+#define US_PER_COUNT 4
+#define COUNTS_PER_S (1000000UL / US_PER_COUNT)
+#define HEARTBEAT_HALFPERIOD_US 500000UL
+// ^ As in statusleds.c
+
+
+static int heartbeatRunning;
+static uint32_t nextHbtUs;
+static uint32_t sleeps;
+
+
+void mstick__deadlineEvent(mstick_slot_t slot) {
+	if(slot == MSTICK_SLOT_HEARTBEAT && heartbeatRunning) {
+		nextHbtUs += HEARTBEAT_HALFPERIOD_US;
+		mstick__scheduleAt(MSTICK_SLOT_HEARTBEAT, nextHbtUs);
+		}
+	}
+
+void sleep_cpu(void) {
+	++sleeps;
+	CHECK(faketimer1__runToInterrupt());
+	}
+
+static void freshBoard(void) {
+	powersave_stats_t stats;
+	faketimer1__reset();
+	mstick__init();
+	TIFR1 = 0;
+	// ^ mstick__init() writes ones to clear the flags, which the fake
+	// register keeps
+	heartbeatRunning = 1;
+	nextHbtUs = mstick__getMicros() + HEARTBEAT_HALFPERIOD_US;
+	mstick__scheduleAt(MSTICK_SLOT_HEARTBEAT, nextHbtUs);
+	powersave__init();
+	powersave__takeStats(&stats);
+	sleeps = 0;
+	}
+
+static void runMainLoop(uint32_t forCounts, uint32_t passCounts) {
+	// Every pass does passCounts of work, then sleeps
+	uint32_t end = faketimer1__now() + forCounts;
+	while((int32_t)(faketimer1__now() - end) < 0) {
+		faketimer1__run(passCounts);
+		powersave__endPass(1);
+		}
+	}
+
+static double percent(uint32_t part, uint32_t whole) {
+	return part * 100. / whole;
+	}
+
+
+static void test_idleBoardSleeps(void) {
+	powersave_stats_t stats;
+	freshBoard();
+	runMainLoop(10 * COUNTS_PER_S, 0);
+	powersave__takeStats(&stats);
+	CHECK_EQ(stats.wakeups, sleeps);
+	CHECK_EQ(stats.wakeups, 20 + 10 * COUNTS_PER_S / 0x10000);
+	// ^ Heartbeats plus timer overflows
+	CHECK_EQ(stats.elapsedUs, faketimer1__now() * US_PER_COUNT);
+	CHECK_EQ(stats.asleepUs, stats.elapsedUs);
+	CHECK_EQ(stats.maxPassUs, 0);
+	CHECK_EQ(powersave__getMaxObservedLatencyUs(), 0);
+	printf("idle: %lu wakeups in 10 s, asleep %.2f%%\n",
+		(unsigned long)stats.wakeups,
+		percent(stats.asleepUs, stats.elapsedUs));
+	}
+
+static void test_passTimeIsAwake(void) {
+	// Each wakeup costs a 200 us pass, so the board is awake for that long
+	// per wakeup and the longest command latency grows by it
+	powersave_stats_t stats;
+	freshBoard();
+	runMainLoop(10 * COUNTS_PER_S, 200 / US_PER_COUNT);
+	powersave__takeStats(&stats);
+	CHECK_EQ(stats.maxPassUs, 200);
+	CHECK_EQ(stats.elapsedUs - stats.asleepUs, stats.wakeups * 200);
+	// ^ The last wakeup is at the 10 s heartbeat, which ends the loop
+	// before its pass, and the first pass has no wakeup before it
+	CHECK_EQ(powersave__getMaxObservedLatencyUs(), 200);
+	printf("idle with 200 us passes: %lu wakeups in 10 s, awake %.3f%%, "
+		"max observed latency %lu us\n", (unsigned long)stats.wakeups,
+		percent(stats.elapsedUs - stats.asleepUs, stats.elapsedUs),
+		(unsigned long)powersave__getMaxObservedLatencyUs());
+	}
+
+static void test_pollingWakesEveryMs(void) {
+	powersave_stats_t stats;
+	freshBoard();
+	mstick__setPolling(MSTICK_POLL_RULES, 1);
+	runMainLoop(COUNTS_PER_S, 100 / US_PER_COUNT);
+	powersave__takeStats(&stats);
+	CHECK(stats.wakeups >= 1000 && stats.wakeups <= 1010);
+	printf("polling with 100 us passes: %lu wakeups in 1 s, awake %.1f%%\n",
+		(unsigned long)stats.wakeups,
+		percent(stats.elapsedUs - stats.asleepUs, stats.elapsedUs));
+	}
+
+static void test_busyPassesDontSleep(void) {
+	powersave_stats_t stats;
+	freshBoard();
+	faketimer1__run(300 / US_PER_COUNT);
+	powersave__endPass(0);
+	faketimer1__run(1200 / US_PER_COUNT);
+	powersave__endPass(0);
+	faketimer1__run(500 / US_PER_COUNT);
+	powersave__endPass(0);
+	powersave__takeStats(&stats);
+	CHECK_EQ(sleeps, 0);
+	CHECK_EQ(stats.wakeups, 0);
+	CHECK_EQ(stats.asleepUs, 0);
+	CHECK_EQ(stats.elapsedUs, 2000);
+	CHECK_EQ(stats.maxPassUs, 1200);
+	powersave__takeStats(&stats);
+	CHECK_EQ(stats.elapsedUs, 0);
+	CHECK_EQ(stats.maxPassUs, 1200);
+	// ^ Kept since reset
+	}
+
+
+int main(void) {
+	RUN_TEST(test_idleBoardSleeps);
+	RUN_TEST(test_passTimeIsAwake);
+	RUN_TEST(test_pollingWakesEveryMs);
+	RUN_TEST(test_busyPassesDontSleep);
+	return 0;
+	}
@@ -0,0 +1,110 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "hosttest.h"
+#include "vendorrpt.h"
+
+
+// Host tests of the vendor interface report encoding in src/vendorrpt.c,
+// built once for a board with 16-bit terminal masks and once (as
+// test_vendorrpt_wide) for one with 32-bit masks. The byte strings here are
+// also checked against the driver's decoder in driver/tests/test_vendor.py.
+
+#if BOARD_MASK_BITS > 16
+#define ARG0 0x89AB1234UL
+#define ARG1 0x0102ABCDUL
+#define OUTPUTS 0x00FF0FFFUL
+#define INPUTS 0x00FE3000UL
+#define CHANGED 0x00801000UL
+static const uint8_t requestBytes[VENDORRPT_LEN] = {
+	0x02, 0x07, 0x34, 0x12, 0xAB, 0x89, 0xCD, 0xAB, 0x02, 0x01,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+static const uint8_t replyBytes[VENDORRPT_LEN] = {
+	0x82, 0x07, 0x02, 0x00, 0xFF, 0x0F, 0xFF, 0x00, 0x00, 0x30, 0xFE, 0x00,
+	0x00, 0x00, 0x00, 0x00};
+static const uint8_t eventBytes[VENDORRPT_LEN] = {
+	0xC0, 0x01, 0x10, 0x27, 0x00, 0x30, 0xFE, 0x00, 0x00, 0x10, 0x80, 0x00,
+	0x00, 0x00, 0x00, 0x00};
+#else
+#define ARG0 0x1234
+#define ARG1 0xABCD
+#define OUTPUTS 0x0FFF
+#define INPUTS 0x3000
+#define CHANGED 0x1000
+static const uint8_t requestBytes[VENDORRPT_LEN] = {
+	0x02, 0x07, 0x34, 0x12, 0xCD, 0xAB, 0x00, 0x00};
+static const uint8_t replyBytes[VENDORRPT_LEN] = {
+	0x82, 0x07, 0x02, 0x00, 0xFF, 0x0F, 0x00, 0x30};
+static const uint8_t eventBytes[VENDORRPT_LEN] = {
+	0xC0, 0x01, 0x10, 0x27, 0x00, 0x30, 0x00, 0x10};
+#endif
+
+
+static void test_decodeRequest(void) {
+	vendorrpt_request_t req;
+	vendorrpt__decodeRequest(&req, requestBytes);
+	CHECK_EQ(req.op, VENDORRPT_OP_WRITE_OUTPUTS);
+	CHECK_EQ(req.tag, 7);
+	CHECK_EQ(req.arg0, ARG0);
+	CHECK_EQ(req.arg1, ARG1);
+	}
+
+static void test_encodeRequest(void) {
+	vendorrpt_request_t req = {VENDORRPT_OP_WRITE_OUTPUTS, 7, ARG0, ARG1};
+	uint8_t report[VENDORRPT_LEN];
+	memset(report, 0xEE, sizeof(report));
+	vendorrpt__encodeRequest(report, &req);
+	CHECK(!memcmp(report, requestBytes, VENDORRPT_LEN));
+	// ^ Including the zeroed reserved bytes
+	}
+
+static void test_requestRoundTrip(void) {
+	static const board_mask_t args[] = {
+		0, 1, 0x00FF, 0x0100, 0x8000, (board_mask_t)~0,
+		(board_mask_t)1 << (BOARD_MASK_BITS - 1)};
+	const int nArgs = sizeof(args) / sizeof(args[0]);
+	for(int op = 0; op < 0x100; op += 0x11) {
+		for(int i = 0; i < nArgs; ++i) {
+			vendorrpt_request_t req = {
+				op, 0xFF - op, args[i], args[nArgs - 1 - i]};
+			vendorrpt_request_t decoded;
+			uint8_t report[VENDORRPT_LEN];
+			vendorrpt__encodeRequest(report, &req);
+			vendorrpt__decodeRequest(&decoded, report);
+			CHECK_EQ(decoded.op, req.op);
+			CHECK_EQ(decoded.tag, req.tag);
+			CHECK_EQ(decoded.arg0, req.arg0);
+			CHECK_EQ(decoded.arg1, req.arg1);
+			}
+		}
+	}
+
+static void test_encodeReply(void) {
+	vendorrpt_request_t req;
+	uint8_t report[VENDORRPT_LEN];
+	vendorrpt__decodeRequest(&req, requestBytes);
+	memset(report, 0xEE, sizeof(report));
+	vendorrpt__encodeReply(
+		report, &req, VENDORRPT_STATUS_BAD_VAL, OUTPUTS, INPUTS);
+	CHECK(!memcmp(report, replyBytes, VENDORRPT_LEN));
+	CHECK(report[0] & VENDORRPT_REPLY_FLAG);
+	CHECK(report[0] != VENDORRPT_TYPE_EVENT);
+	}
+
+static void test_encodeEvent(void) {
+	uint8_t report[VENDORRPT_LEN];
+	memset(report, 0xEE, sizeof(report));
+	vendorrpt__encodeEvent(
+		report, VENDORRPT_EVENTFLAG_OVERRUN, 10000, INPUTS, CHANGED);
+	CHECK(!memcmp(report, eventBytes, VENDORRPT_LEN));
+	}
+
+
+int main(void) {
+	RUN_TEST(test_decodeRequest);
+	RUN_TEST(test_encodeRequest);
+	RUN_TEST(test_requestRoundTrip);
+	RUN_TEST(test_encodeReply);
+	RUN_TEST(test_encodeEvent);
+	return 0;
+	}
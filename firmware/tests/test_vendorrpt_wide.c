@@ -0,0 +1,3 @@
+// The vendor report tests again, built against the generated headers of
+// tests/boards/wide24.json so that the 32-bit mask layout is covered too
+#include "test_vendorrpt.c"
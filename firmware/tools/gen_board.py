@@ -0,0 +1,369 @@
+#!/usr/bin/env python3
+"""
+Generates the board-specific firmware tables from a board description file.
+
+Usage: gen_board.py [-o OUTDIR] boards/<board>.json
+
+Emits, into OUTDIR (default _gen):
+  board.h       model/USB strings, power-on defaults, capability masks
+  board_gpio.h  terminal definitions and lookup tables, for gpio.c only
+  commands.c    cmdproc__commandSpecs
+
+A board file may pull in shared sections (such as the command list) from
+other files in the same directory with "include". Files are only rewritten
+when their contents change, so an unrelated edit doesn't force a rebuild.
+"""
+import argparse
+import json
+import os
+import sys
+
+
+# Pins bonded out on each supported MCU, by port letter
+MCU_PINS = {
+    "atmega32u4": {
+        "B": range(0, 8),
+        "C": (6, 7),
+        "D": range(0, 8),
+        "E": (2, 6),
+        "F": (0, 1, 4, 5, 6, 7),
+        },
+    }
+
+# ADC channel of each pin that has one
+MCU_ADC_CHANNELS = {
+    "atmega32u4": {
+        "PF0": 0, "PF1": 1, "PF4": 4, "PF5": 5, "PF6": 6, "PF7": 7,
+        "PD4": 8, "PD6": 9, "PD7": 10, "PB4": 11, "PB5": 12, "PB6": 13,
+        },
+    }
+
+MAX_TERMINAL_NO = 32
+# ^ Terminal bitmasks (board_mask_t) are at most 32 bits wide
+
+ARG_TYPES = ("string", "uint8", "uint16", "uint32", "int8", "int16", "mask")
+# ^ "mask" is a terminal bitmask, as wide as the board's board_mask_t
+CMD_TYPES = ("do", "query", "set")
+MNEM_MAX_LEN = 3
+NO_TERMINAL = 0xFF
+NO_ADC_CHANNEL = 0xFF
+
+HEADER_NOTE = (
+    "// Generated by tools/gen_board.py from {source}; do not edit\n")
+
+
+class BoardError(Exception):
+    pass
+
+
+def load_description(path):
+    with open(path) as f:
+        desc = json.load(f)
+    merged = {}
+    for inc in desc.pop("include", []):
+        merged.update(
+            load_description(os.path.join(os.path.dirname(path), inc)))
+    merged.update(desc)
+    return merged
+
+
+def parse_pin(pin, mcu):
+    if len(pin) != 3 or pin[0] != "P" or not pin[2].isdigit():
+        raise BoardError(f"Bad pin name {pin!r}")
+    port, bit = pin[1], int(pin[2])
+    if bit not in MCU_PINS[mcu].get(port, ()):
+        raise BoardError(f"{mcu} has no pin {pin}")
+    return port, bit
+
+
+def bm(terminal_no):
+    return 1 << (terminal_no - 1)
+
+
+def mask_bits(desc):
+    # 16-bit masks are cheaper on an 8-bit MCU, so only go wide when needed
+    return 16 if max(t["no"] for t in desc["terminals"]) <= 16 else 32
+
+
+def c_mask(desc, mask):
+    if mask_bits(desc) == 16:
+        return f"0x{mask:04X}"
+    return f"0x{mask:08X}UL"
+
+
+def c_wstring(text):
+    return 'L"' + text.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+
+def c_string(text):
+    return '"' + text.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+
+def check_board(desc):
+    mcu = desc["mcu"]
+    if mcu not in MCU_PINS:
+        raise BoardError(f"Unsupported MCU {mcu!r}")
+    seen_nos, seen_pins = set(), set()
+    for term in desc["terminals"]:
+        no = term["no"]
+        if not 1 <= no <= MAX_TERMINAL_NO:
+            raise BoardError(f"Terminal number {no} out of range")
+        if no in seen_nos:
+            raise BoardError(f"Duplicate terminal number {no}")
+        seen_nos.add(no)
+        pin = parse_pin(term["pin"], mcu)
+        if pin in seen_pins:
+            raise BoardError(f"Pin {term['pin']} used more than once")
+        seen_pins.add(pin)
+        modes = term["modes"]
+        if not modes or set(modes) - {"in", "out", "an"}:
+            raise BoardError(f"Terminal {no}: bad modes {modes!r}")
+        if "an" in modes and "in" not in modes:
+            raise BoardError(f"Terminal {no}: analog mode needs input mode")
+        if "an" in modes and term["pin"] not in MCU_ADC_CHANNELS[mcu]:
+            raise BoardError(f"Terminal {no}: {term['pin']} has no ADC")
+        if term.get("default_dir", modes[0]) not in modes:
+            raise BoardError(f"Terminal {no}: default_dir not in modes")
+        if term.get("default_dir", modes[0]) == "an":
+            raise BoardError(f"Terminal {no}: can't power on in analog mode")
+        if term.get("default_on") and "out" not in modes:
+            raise BoardError(f"Terminal {no}: default_on needs output mode")
+    if len(desc["model"]) > 16 or len(desc["default_serial_no"]) > 16:
+        raise BoardError("Model and serial number are limited to 16 chars")
+    seen_cmds = set()
+    for cmd in desc["commands"]:
+        key = (cmd["mnem"], cmd["type"])
+        if cmd["type"] not in CMD_TYPES:
+            raise BoardError(f"{cmd['mnem']}: bad command type")
+        if not 0 < len(cmd["mnem"]) <= MNEM_MAX_LEN:
+            raise BoardError(f"{cmd['mnem']}: bad mnemonic length")
+        if key in seen_cmds:
+            raise BoardError(f"Duplicate command {key}")
+        seen_cmds.add(key)
+        for arg in cmd.get("left", []) + cmd.get("right", []):
+            if arg not in ARG_TYPES:
+                raise BoardError(f"{cmd['mnem']}: bad arg type {arg!r}")
+        for side in ("left", "right"):
+            if cmd.get(f"{side}_variadic") and not cmd.get(side):
+                raise BoardError(
+                    f"{cmd['mnem']}: {side}_variadic needs an arg type")
+
+
+def gen_board_h(desc, source):
+    terms = desc["terminals"]
+    usb = desc["usb"]
+    output_cap = sum(bm(t["no"]) for t in terms if "out" in t["modes"])
+    input_cap = sum(bm(t["no"]) for t in terms if "in" in t["modes"])
+    analog_cap = sum(bm(t["no"]) for t in terms if "an" in t["modes"])
+    poweron_dirs = sum(
+        bm(t["no"]) for t in terms
+        if t.get("default_dir", t["modes"][0]) == "out"
+        )
+    poweron_outputs = sum(bm(t["no"]) for t in terms if t.get("default_on"))
+    ports = sorted({t["pin"][1] for t in terms if "out" in t["modes"]})
+    release = [int(x) for x in usb["release"].split(".")]
+    bits = mask_bits(desc)
+    lines = [
+        HEADER_NOTE.format(source=source),
+        "#pragma once\n\n\n",
+        "#include <inttypes.h>\n",
+        "#include <stdint.h>\n\n\n",
+        "// Terminal bitmask type, as wide as the highest terminal number "
+        "needs;\n",
+        "// printed with \"%\" BOARD_MASK_PRI\n",
+        f"typedef uint{bits}_t board_mask_t;\n",
+        f"#define BOARD_MASK_BITS {bits}\n",
+        f"#define BOARD_MASK_PRI PRIu{bits}\n",
+        "\n",
+        f"#define BOARD_MODEL_STR {c_string(desc['model'])}\n",
+        "#define DEFAULT_SERIALNO_STR "
+        f"{c_string(desc['default_serial_no'])}\n",
+        "\n",
+        "// Terminal bitmasks, bit n-1 = terminal n; DIRS bit set = output\n",
+        f"#define DEFAULT_POWERON_OUTPUTS {c_mask(desc, poweron_outputs)}\n",
+        f"#define DEFAULT_POWERON_DIRS {c_mask(desc, poweron_dirs)}\n",
+        "\n",
+        f"#define MFR_STRING {c_wstring(usb['manufacturer'])}\n",
+        f"#define PROD_STRING {c_wstring(usb['product'])}\n",
+        f"#define VENDOR_ID {usb['vendor_id']}\n",
+        f"#define PRODUCT_ID {usb['product_id']}\n",
+        f"#define RELEASENUMBER VERSION_BCD({','.join(map(str, release))})\n",
+        f"#define FW_VERSION_STR {c_string(usb['release'])}\n",
+        "// ^ Reported by FWV?; the same number as the USB device release\n",
+        "\n",
+        f"#define BOARD_N_TERMINALS {len(terms)}\n",
+        f"#define BOARD_TERMINAL_NO_MAX {max(t['no'] for t in terms)}\n",
+        "#define BOARD_N_INPUTS "
+        f"{sum(1 for t in terms if 'in' in t['modes'])}\n",
+        f"#define BOARD_OUTPUT_CAP_MASK {c_mask(desc, output_cap)}\n",
+        f"#define BOARD_INPUT_CAP_MASK {c_mask(desc, input_cap)}\n",
+        "#define BOARD_N_ANALOG "
+        f"{sum(1 for t in terms if 'an' in t['modes'])}\n",
+        f"#define BOARD_ANALOG_CAP_MASK {c_mask(desc, analog_cap)}\n",
+        "\n",
+        "// Ports with at least one output terminal, in gpio_port_masks_t "
+        "order\n",
+        f"#define GPIO_N_PORTS {len(ports)}\n",
+        f"#define GPIO_PORT_LETTERS \"{''.join(ports)}\"\n",
+        "\n",
+        "_Static_assert(BOARD_TERMINAL_NO_MAX <= BOARD_MASK_BITS,\n"
+        "\t\"Terminal bitmasks are too narrow for the terminal numbers\");\n",
+        ]
+    return "".join(lines)
+
+
+def gen_board_gpio_h(desc, source):
+    mcu = desc["mcu"]
+    terms = desc["terminals"]
+    ports = sorted({t["pin"][1] for t in terms if "out" in t["modes"]})
+    max_no = max(t["no"] for t in terms)
+    idx_by_no = [NO_TERMINAL] * (max_no + 1)
+    out_bits = [(NO_TERMINAL, 0)] * (max_no + 1)
+    def_lines = []
+    for idx, term in enumerate(terms):
+        port, bit = parse_pin(term["pin"], mcu)
+        idx_by_no[term["no"]] = idx
+        has_in = "in" in term["modes"]
+        has_out = "out" in term["modes"]
+        adc = (MCU_ADC_CHANNELS[mcu][term["pin"]] if "an" in term["modes"]
+               else NO_ADC_CHANNEL)
+        def_lines.append(
+            f"\t{{{term['no']}, &DDR{port}, "
+            f"{'&PIN' + port if has_in else 'NULL'}, "
+            f"{'&PORT' + port if has_out else 'NULL'}, "
+            f"P{port}{bit}, 0x{adc:02X}}},\n"
+            )
+        if has_out:
+            out_bits[term["no"]] = (ports.index(port), 1 << bit)
+    input_idxs = [i for i, t in enumerate(terms) if "in" in t["modes"]]
+    lines = [
+        HEADER_NOTE.format(source=source),
+        "// Included by gpio.c only, after gpio_terminal_def_t is defined\n",
+        "#pragma once\n\n\n",
+        f"#define GPIO_NO_TERMINAL 0x{NO_TERMINAL:02X}\n",
+        f"#define GPIO_NO_ADC_CHANNEL 0x{NO_ADC_CHANNEL:02X}\n\n",
+        "static const gpio_terminal_def_t PROGMEM "
+        "gpioTerminalDefs[BOARD_N_TERMINALS] = {\n",
+        *def_lines,
+        "\t};\n\n",
+        "// Index into gpioTerminalDefs by terminal number, "
+        "GPIO_NO_TERMINAL for none\n",
+        "static const uint8_t PROGMEM "
+        "gpioTerminalIdxs[BOARD_TERMINAL_NO_MAX + 1] = {\n",
+        "\t" + ", ".join(str(x) for x in idx_by_no) + ",\n",
+        "\t};\n\n",
+        "// Output port index and bit by terminal number, so a terminal "
+        "bitmask can be\n",
+        "// turned into port masks without touching gpioTerminalDefs\n",
+        "static const uint8_t PROGMEM "
+        "gpioOutputBits[BOARD_TERMINAL_NO_MAX + 1][2] = {\n",
+        *(f"\t{{0x{p:02X}, 0x{b:02X}}},\n" for p, b in out_bits),
+        "\t};\n\n",
+        "static const uint8_t PROGMEM "
+        "gpioInputTerminalIdxs[BOARD_N_INPUTS] = {\n",
+        "\t" + ", ".join(str(x) for x in input_idxs) + ",\n",
+        "\t};\n\n",
+        "// Index into gpio_port_masks_t.bm\n",
+        "static volatile uint8_t * const gpioOutputPorts[GPIO_N_PORTS] = {\n",
+        "\t" + ", ".join(f"&PORT{p}" for p in ports) + ",\n",
+        "\t};\n\n",
+        "_Static_assert(\n",
+        "\tsizeof(gpioTerminalDefs) / sizeof(gpioTerminalDefs[0])\n",
+        "\t\t== BOARD_N_TERMINALS,\n",
+        "\t\"Terminal table doesn't match BOARD_N_TERMINALS\");\n",
+        "_Static_assert(BOARD_N_TERMINALS < GPIO_NO_TERMINAL,\n",
+        "\t\"Terminal index would collide with the no-terminal marker\");\n",
+        ]
+    return "".join(lines)
+
+
+def arg_type_name(desc, arg):
+    if arg == "mask":
+        arg = f"uint{mask_bits(desc)}"
+    return f"ARGTYPE_{arg.upper()}"
+
+
+def gen_commands_c(desc, source):
+    max_left = max(len(c.get("left", [])) for c in desc["commands"])
+    max_right = max(len(c.get("right", [])) for c in desc["commands"])
+    lines = [
+        HEADER_NOTE.format(source=source),
+        "#include <avr/pgmspace.h>\n\n",
+        "#include \"cmdproc.h\"\n\n\n",
+        f"_Static_assert({max_left} <= CMDPROC_MAX_N_LEFTARGS,\n",
+        "\t\"A command has more left args than cmdproc allows\");\n",
+        f"_Static_assert({max_right} <= CMDPROC_MAX_N_RIGHTARGS,\n",
+        "\t\"A command has more right args than cmdproc allows\");\n",
+        f"_Static_assert({MNEM_MAX_LEN} <= CMDPROC_MNEM_MAX_LEN,\n",
+        "\t\"Mnemonics were checked against a longer limit\");\n\n",
+        "const cmdproc_cmd_spec_t PROGMEM cmdproc__commandSpecs[] = {\n",
+        ]
+    for cmd in desc["commands"]:
+        left = cmd.get("left", [])
+        right = cmd.get("right", [])
+        lines += [
+            "\t{\n",
+            f"\t\t.cmdType = CMDTYPE_{cmd['type'].upper()},\n",
+            f"\t\t.mnem=\"{cmd['mnem']}\",\n",
+            ]
+        cmd_flags = [
+            flag for key, flag in (
+                ("left_variadic", "CMDFLAG_LEFT_VARIADIC"),
+                ("right_variadic", "CMDFLAG_RIGHT_VARIADIC"),
+                )
+            if cmd.get(key)
+            ]
+        if cmd_flags:
+            lines.append(f"\t\t.flags={' | '.join(cmd_flags)},\n")
+        lines += [
+            f"\t\t.nLeftArgs={len(left)},\n",
+            f"\t\t.nRightArgs={len(right)},\n",
+            ]
+        for field, args in (("leftArgTypes", left), ("rightArgTypes", right)):
+            if args:
+                types = ", ".join(arg_type_name(desc, a) for a in args)
+                lines.append(f"\t\t.{field}={{{types}}},\n")
+        lines.append("\t\t},\n")
+    lines += [
+        "\t};\n\n",
+        "const int cmdproc__commandSpecsLen =\n",
+        "\tsizeof(cmdproc__commandSpecs) / sizeof(cmdproc__commandSpecs[0]);\n",
+        ]
+    return "".join(lines)
+
+
+def write_if_changed(path, text):
+    # CRLF to match the hand-written sources
+    data = text.replace("\n", "\r\n").encode("ascii")
+    try:
+        with open(path, "rb") as f:
+            if f.read() == data:
+                return
+    except FileNotFoundError:
+        pass
+    with open(path, "wb") as f:
+        f.write(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    parser.add_argument("board_file")
+    parser.add_argument("-o", "--outdir", default="_gen")
+    args = parser.parse_args()
+    source = args.board_file.replace(os.sep, "/")
+    try:
+        desc = load_description(args.board_file)
+        check_board(desc)
+    except (BoardError, KeyError, ValueError) as e:
+        sys.exit(f"{args.board_file}: {e}")
+    os.makedirs(args.outdir, exist_ok=True)
+    for name, gen in [
+            ("board.h", gen_board_h),
+            ("board_gpio.h", gen_board_gpio_h),
+            ("commands.c", gen_commands_c),
+            ]:
+        write_if_changed(os.path.join(args.outdir, name), gen(desc, source))
+
+
+if __name__ == "__main__":
+    main()